@@ -0,0 +1,41 @@
+#pragma once
+
+#include "globals.h"
+
+#include "ImageIO.h"
+
+// The block compressed formats GPUs sample directly. Each one stores 4x4 texels in a fixed number of
+// bytes:
+//   BC1: RGB in 8 bytes (two 5:6:5 colors and 2-bit indices between them)
+//   BC4: one channel in 8 bytes (two 8-bit values and 3-bit indices), e.g. height maps
+//   BC5: two BC4 channels in 16 bytes, e.g. the x and y of a normal map
+//   BC7: RGBA in 16 bytes, the best quality of them
+MAKE_ENUM(BlockFormat, int, None, BC1, BC4, BC5, BC7);
+
+// CPU encoders and decoders for the block formats. Blocks are laid out a row of blocks at a time in
+// the same row order as the image, so the encoded data uploads as is with glCompressedTexImage2D.
+namespace BlockCompression
+{
+	// Bytes per 4x4 block
+	int blockBytes(BlockFormat format);
+
+	// Channels the format keeps: 1 for BC4, 2 for BC5, 3 for BC1 and 4 for BC7
+	int channelCount(BlockFormat format);
+
+	// Bytes taken by a width x height image, partial blocks at the edges included
+	size_t compressedSize(BlockFormat format, int width, int height);
+
+	// Compresses an 8 or 16-bit image. Gray images count as RGB with the gray in every channel and
+	// images without alpha as opaque; channels the format doesn't keep are ignored. Edges that don't
+	// fill a whole block repeat the last row and column. The blocks are spread over the JobSystem's
+	// threads.
+	//
+	// BC7 is always written in mode 6 (a single pair of RGBA endpoints with 4-bit indices), which
+	// is fast to search and does well on smooth images, but can't match the multi-subset modes of a
+	// full encoder on sharp edges between colors.
+	std::vector<unsigned char> encode(const ImageIO::DecodedImage& image, BlockFormat format);
+
+	// Decodes blocks back to an 8-bit image with channelCount(format) channels. BC7 blocks in modes
+	// other than 6 decode to black.
+	ImageIO::DecodedImage decode(const unsigned char* blocks, int width, int height, BlockFormat format);
+}
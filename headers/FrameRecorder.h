@@ -0,0 +1,98 @@
+#pragma once
+
+#include "globals.h"
+
+#include "JobSystem.h"
+
+#include <future>
+
+class Texture;
+class TextureMemory;
+
+MAKE_ENUM(CaptureFormat, int, PNG, PFM, Raw);
+
+// Records a framebuffer attachment as an image sequence while the program keeps running at full
+// speed. Frames are read back through the TextureReadback ring into memory of their own and
+// written to disk on the JobSystem's threads, so the frame loop neither waits on the GPU nor on the
+// encoder. At most maxQueued frames are being read back or written at a time; frames that come
+// while the queue is full are dropped and counted, never waited for.
+//
+// Each recording goes to a folder of its own under directory, as frame_000000.png and so on. PNG
+// and PFM need float attachments with at least three channels; Raw writes the memory as it is, and
+// describes it in the folder's capture.json.
+class FrameRecorder
+{
+public:
+	struct Stats {
+		size_t captured = 0;
+		size_t dropped = 0;
+		size_t written = 0;
+		size_t failed = 0;
+	};
+
+	static FrameRecorder& get();
+
+	std::string directory = "captures";
+	CaptureFormat format = CaptureFormat::PNG;
+
+	// Captures every Nth frame
+	int every = 1;
+
+	// Frames being read back or written at once
+	int maxQueued = 8;
+
+	// Starts a recording of the texture's memory, which has to be a framebuffer attachment. Logs and
+	// returns false when the folder can't be made.
+	bool start(s_ptr<Texture> texture);
+
+	// Stops capturing. Frames already queued are still written.
+	void stop();
+
+	bool isRecording() const;
+
+	// Hands finished readbacks to the writers and captures this frame. Call once a frame after
+	// TextureReadback::update(), on the thread that owns the GL context.
+	void update();
+
+	// Frames being read back or written
+	size_t queueDepth() const;
+
+	Stats getStats() const;
+
+	// The settings and the stats
+	void renderUI();
+
+private:
+	struct Frame {
+		unsigned long number = 0;
+		s_ptr<TextureMemory> memory;
+		std::shared_future<bool> read;
+	};
+
+	FrameRecorder() = default;
+
+	void capture();
+	void write(Frame frame);
+
+	w_ptr<Texture> texture;
+	bool recording = false;
+	std::string folder;
+	CaptureFormat recordingFormat = CaptureFormat::PNG;
+
+	unsigned long frameCounter = 0;
+	unsigned long frameNumber = 0;
+
+	std::deque<Frame> reading;
+	std::atomic<int> writing{ 0 };
+
+	size_t captured = 0;
+	size_t dropped = 0;
+	std::atomic<size_t> written{ 0 };
+	std::atomic<size_t> failed{ 0 };
+
+	// Why writes failed, logged by update(): the console can't be written from the writers' threads
+	std::vector<std::string> writeErrors;
+	std::mutex writeErrorsMutex;
+
+	JobSystem::TaskGroup writers;
+};
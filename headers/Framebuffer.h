@@ -97,4 +97,7 @@ class Framebuffer
 		void initTexture(int index, GBufferMode indexMode);
 
 		std::map<s_ptr<Texture>, bool> uiVisibleTextures;
+
+		// Channel ranges of each texture the last time it was inspected
+		std::map<s_ptr<Texture>, std::string> uiInspections;
 };
\ No newline at end of file
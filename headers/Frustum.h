@@ -0,0 +1,41 @@
+#pragma once
+
+#include "globals.h"
+
+// The six planes of a view-projection matrix's clip volume, in world space, facing inwards and
+// normalized: a point p is inside plane i when dot(planes[i], vec4(p, 1)) >= 0
+struct Frustum
+{
+	vec4 planes[6];
+
+	// The planes of -w <= x, y, z <= w (Gribb and Hartmann)
+	static Frustum fromMatrix(const mat4& viewProjection);
+
+	bool intersectsSphere(vec3 center, float radius) const;
+};
+
+// World-space bounding spheres kept as separate arrays of x, y, z and radius, so a frustum's planes
+// are tested against 4 of them at a time with SSE2 (one at a time without it). The arrays are
+// padded to a multiple of 4 with spheres that are never visible.
+class SphereCuller
+{
+public:
+	// Sets the number of spheres, keeping the first ones
+	void resize(size_t count);
+	size_t size() const { return count; }
+
+	void set(size_t i, vec3 center, float radius)
+	{
+		x[i] = center.x;
+		y[i] = center.y;
+		z[i] = center.z;
+		r[i] = radius;
+	}
+
+	// Replaces visible with the indices, in order, of the spheres at least partly inside the frustum
+	void cull(const Frustum& frustum, std::vector<int>& visible) const;
+
+private:
+	size_t count = 0;
+	std::vector<float> x, y, z, r;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "globals.h"
+
+#include <GL/glew.h>
+
+#include <map>
+#include <tuple>
+
+// Remembers the program, vertex array, textures, samplers and uniform buffer ranges it last bound,
+// and skips binding them again. Only what goes through it is tracked, and other code (ImGui, the
+// other assignments) changes the same state behind its back, so a frame that relies on it starts
+// with invalidate().
+//
+// Also hands out sampler objects, one per combination of parameters, so textures don't need their
+// glTexParameteri calls repeated each time they're bound.
+class GLState
+{
+public:
+	struct Stats {
+		// Calls made to GL, and calls skipped because the state already matched
+		size_t issued = 0;
+		size_t elided = 0;
+	};
+
+	static GLState& get();
+
+	// Forgets what's bound, so the next bind of everything is issued
+	void invalidate();
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vertexArray);
+	void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+	// Sampler 0 lets the texture's own parameters apply again
+	void bindSampler(GLuint unit, GLuint sampler);
+
+	void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+	// A sampler object with these parameters, made the first time they're asked for. Clamping to
+	// the border uses a white border, like depth textures.
+	GLuint sampler(GLenum wrapS, GLenum wrapT, GLenum minFilter, GLenum magFilter);
+
+	const Stats& getStats() const { return stats; }
+	void resetStats() { stats = Stats(); }
+
+private:
+	GLState() = default;
+
+	// Counts the call and returns whether it's needed, remembering the new value
+	template<typename T>
+	bool change(T& current, const T& value)
+	{
+		if (current == value) {
+			stats.elided++;
+			return false;
+		}
+
+		current = value;
+		stats.issued++;
+		return true;
+	}
+
+	// Not a name GL hands out, so the first bind after invalidate() is always issued
+	static const GLuint unknown = ~0u;
+
+	GLuint program = unknown;
+	GLuint vertexArray = unknown;
+	GLuint activeUnit = unknown;
+
+	// Units and binding points not bound since invalidate() aren't in these
+	std::map<std::pair<GLuint, GLenum>, GLuint> textures;
+	std::map<GLuint, GLuint> samplers;
+	std::map<std::pair<GLenum, GLuint>, std::tuple<GLuint, GLintptr, GLsizeiptr>> bufferRanges;
+
+	std::map<std::tuple<GLenum, GLenum, GLenum, GLenum>, GLuint> samplerObjects;
+
+	Stats stats;
+};
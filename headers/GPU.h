@@ -1,6 +1,8 @@
 #pragma once
 
 #include "globals.h"
+#include "GLState.h"
+#include "Lighting.h"
 #include "Primitives.h"
 #include "Renderer.h"
 
@@ -178,6 +180,83 @@ struct TriangleMeshAOS {
 	}
 };
 
+// An active uniform or attribute of a linked program, as glGetActiveUniform and
+// glGetActiveAttrib describe it
+struct ShaderVariable {
+	std::string name;
+	GLint location = -1;
+	GLenum type = 0;
+	GLint size = 0;
+
+	// The last value set through Shader::set, empty until then
+	std::vector<unsigned char> value;
+};
+
+// An array of std140 uniform blocks in one buffer. Elements are written to a CPU copy,
+// uploaded together once a frame and bound one at a time with glBindBufferRange, so
+// moving to the next object is a single call. A buffer of one element is bound whole.
+// The C++ structs mirroring the blocks have to keep std140's layout: vec3s are padded
+// to 16 bytes, or followed by a float.
+struct UniformBuffer {
+	GLuint buffer = 0;
+	GLuint binding = 0;
+
+	// Bytes of one element, and between elements (a multiple of the offset alignment). Each
+	// element's range is bound stride bytes long, which covers the std140 padding at the end of
+	// the shader's block that the C++ struct may not have.
+	size_t elementSize = 0;
+	size_t stride = 0;
+
+	size_t count = 0;
+
+	// Bytes the GL buffer has room for
+	size_t capacity = 0;
+
+	std::vector<unsigned char> staging;
+
+	void init(GLuint bindingPoint, size_t size) {
+		binding = bindingPoint;
+		elementSize = size;
+
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		stride = (size + alignment - 1) / alignment * alignment;
+
+		glGenBuffers(1, &buffer);
+	}
+
+	void resize(size_t elements) {
+		count = elements;
+		staging.resize(count * stride);
+	}
+
+	template<typename T>
+	void write(size_t index, const T& value) {
+		memcpy(staging.data() + index * stride, &value, sizeof(T));
+	}
+
+	// Replaces the buffer's storage rather than writing into it, so the GPU can keep
+	// reading last frame's while this one's is written
+	void upload() {
+		if (staging.empty()) return;
+
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		capacity = std::max(capacity, staging.size());
+		glBufferData(GL_UNIFORM_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, staging.size(), staging.data());
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	// Through GLState, so binding the range that's already bound is skipped
+	void bind(size_t index = 0) {
+		GLState::get().bindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, index * stride, stride);
+	}
+};
+
+// Index into Shader::uniforms, -1 for names the program doesn't have (or the compiler
+// optimized out), which Shader::set ignores
+using UniformHandle = int;
+
 struct Shader {
 	GLuint vertexShader = 0;
 	GLuint fragmentShader = 0;
@@ -185,6 +264,130 @@ struct Shader {
 	GLuint tessEvalShader = 0;
 	GLuint program = 0;
 
+	// Filled in at link time
+	std::vector<ShaderVariable> uniforms;
+	std::vector<ShaderVariable> attributes;
+
+	// glUniform calls made and skipped (the value hadn't changed) by set, since the
+	// caller last reset them
+	size_t uniformsSet = 0;
+	size_t uniformsSkipped = 0;
+
+	// Looks a uniform up by name. Meant to be called once, after init, with the handle
+	// kept for the calls to set.
+	UniformHandle uniform(const std::string& name) const {
+		for (size_t i = 0; i < uniforms.size(); i++) {
+			if (uniforms[i].name == name) return (UniformHandle)i;
+		}
+		return -1;
+	}
+
+	// Connects a uniform block of the program to a binding point (what layout(binding)
+	// does from GL 4.2 on). Returns false when the program has no such block.
+	bool bindBlock(const std::string& name, GLuint binding) {
+		GLuint index = glGetUniformBlockIndex(program, name.c_str());
+		if (index == GL_INVALID_INDEX) return false;
+
+		glUniformBlockBinding(program, index, binding);
+		return true;
+	}
+
+	// Bytes the block takes (GL_UNIFORM_BLOCK_DATA_SIZE), 0 if the program doesn't have it. A
+	// range bound to the block has to be at least this long.
+	GLint blockSize(const std::string& name) const {
+		GLuint index = glGetUniformBlockIndex(program, name.c_str());
+		if (index == GL_INVALID_INDEX) return 0;
+
+		GLint size = 0;
+		glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+		return size;
+	}
+
+	GLint attribute(const std::string& name) const {
+		for (auto& a : attributes) {
+			if (a.name == name) return a.location;
+		}
+		return -1;
+	}
+
+	// Sets a uniform of the program, which has to be in use, unless it already has the
+	// value. Values are compared by their bytes.
+	void set(UniformHandle handle, GLint value) {
+		if (changed(handle, &value, sizeof(value))) glUniform1i(uniforms[handle].location, value);
+	}
+
+	void set(UniformHandle handle, bool value) {
+		set(handle, (GLint)value);
+	}
+
+	void set(UniformHandle handle, GLfloat value) {
+		if (changed(handle, &value, sizeof(value))) glUniform1f(uniforms[handle].location, value);
+	}
+
+	void set(UniformHandle handle, const vec3& value) {
+		if (changed(handle, &value, sizeof(value))) glUniform3fv(uniforms[handle].location, 1, glm::value_ptr(value));
+	}
+
+	void set(UniformHandle handle, const vec4& value) {
+		if (changed(handle, &value, sizeof(value))) glUniform4fv(uniforms[handle].location, 1, glm::value_ptr(value));
+	}
+
+	void set(UniformHandle handle, const mat4& value) {
+		if (changed(handle, &value, sizeof(value))) glUniformMatrix4fv(uniforms[handle].location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+
+	// Records the value and returns whether it differs from the last one
+	bool changed(UniformHandle handle, const void* value, size_t size) {
+		if (handle < 0 || handle >= (int)uniforms.size()) return false;
+
+		std::vector<unsigned char>& last = uniforms[handle].value;
+		if (last.size() == size && memcmp(last.data(), value, size) == 0) {
+			uniformsSkipped++;
+			return false;
+		}
+
+		last.assign((const unsigned char*)value, (const unsigned char*)value + size);
+		uniformsSet++;
+		return true;
+	}
+
+	// Lists the program's active uniforms and attributes. Uniforms in blocks have no
+	// location and are left out. Arrays are listed once, by the name without "[0]".
+	void reflect() {
+		uniforms.clear();
+		attributes.clear();
+
+		GLint count = 0;
+		char name[256];
+
+		glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+		for (GLint i = 0; i < count; i++) {
+			ShaderVariable variable;
+			GLsizei length = 0;
+			glGetActiveUniform(program, i, sizeof(name), &length, &variable.size, &variable.type, name);
+			variable.name.assign(name, length);
+			variable.location = glGetUniformLocation(program, name);
+
+			if (variable.location < 0) continue;
+
+			if (variable.name.size() > 3 && variable.name.compare(variable.name.size() - 3, 3, "[0]") == 0) {
+				variable.name.resize(variable.name.size() - 3);
+			}
+
+			uniforms.push_back(variable);
+		}
+
+		glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+		for (GLint i = 0; i < count; i++) {
+			ShaderVariable variable;
+			GLsizei length = 0;
+			glGetActiveAttrib(program, i, sizeof(name), &length, &variable.size, &variable.type, name);
+			variable.name.assign(name, length);
+			variable.location = glGetAttribLocation(program, name);
+			attributes.push_back(variable);
+		}
+	}
+
 	bool compileShader(const char* shaderSrc, GLenum shaderType, GLuint& shader) {
 		shader = glCreateShader(shaderType);
 
@@ -232,6 +435,8 @@ struct Shader {
 			return false;
 		}
 
+		reflect();
+
 		return true;
 	}
 
@@ -285,49 +490,3 @@ struct Shader {
 		return true;
 	}
 };
-
-struct Lighting {
-	// Ambient terms
-	float Ia = 0.05f;		// intensity
-	vec3 Ka = vec3(1.f);	// color
-
-	// Diffuse terms
-	float Id = 1.0f;
-	vec3 Kd = vec3(1.f);
-
-	// Specular terms
-	float shininess = 32.f;
-	vec3 Ks = vec3(1.f);
-
-	vec3 lightDirection = vec3(0, -1, 0);
-
-	bool autoOrbit = false;
-
-	vec3 orbitAxis = vec3(0, 1, 0);
-
-	bool point = false;
-	vec3 position = vec3(0.f);
-	float intensity = 10.f;
-	float radius = 2.0f;
-
-	void renderUI() {
-		if (ImGui::CollapsingHeader("Lighting")) {
-			ImGui::InputFloat("Ambient intensity", &Ia);
-			ImGui::ColorEdit3("Ambient color", glm::value_ptr(Ka));
-			ImGui::InputFloat("Diffuse intensity", &Id);
-			ImGui::ColorEdit3("Diffuse color", glm::value_ptr(Kd));
-			ImGui::InputFloat("Shininess", &shininess);
-			ImGui::ColorEdit3("Specular color", glm::value_ptr(Ks));
-			ImGui::InputFloat3("Light direction", glm::value_ptr(lightDirection));
-			ImGui::Checkbox("Point light", &point);
-			if (point) {
-				ImGui::InputFloat3("Position", glm::value_ptr(position));
-				ImGui::InputFloat("Intensity", &intensity);
-				ImGui::InputFloat("Radius", &radius);
-			}
-
-			ImGui::Checkbox("Auto-orbit", &autoOrbit);
-			ImGui::InputFloat3("Orbit on axis", glm::value_ptr(orbitAxis));
-		}
-	}
-};
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Image file input and output that doesn't need OpenGL. Pixels are floats with "stride" components per pixel,
+// stored bottom row first the way glReadPixels and the CPU labs lay them out. Only RGB is written
+// since the software rasterizer keeps depth in the alpha channel.
+namespace ImageIO
+{
+	// An image as stb_image decodes it: 8 (or 16) bits per channel, rows bottom first, no padding
+	struct DecodedImage {
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+		// 2 for 16-bit images, whose pixels hold native-endian uint16_t values
+		int bytesPerChannel = 1;
+		std::vector<unsigned char> pixels;
+	};
+	// 8-bit PNG through stb_image_write. Colors are clamped to [0, 1]. The writers log failures
+	// unless given error to put the message in (from the JobSystem's threads).
+	bool writePNG(const std::string & filename, const float * pixels, int width, int height, int stride = 4,
+		std::string * error = nullptr);
+
+	// Portable float map (.pfm): unclamped 32-bit RGB, useful for comparing renders exactly.
+	bool writePFM(const std::string & filename, const float * pixels, int width, int height, int stride = 4,
+		std::string * error = nullptr);
+
+	// Picks the writer from the filename's extension (.png or .pfm)
+	bool writeImage(const std::string & filename, const float * pixels, int width, int height, int stride = 4,
+		std::string * error = nullptr);
+
+	// Reads any 8-bit image stb_image understands into RGBA floats in [0, 1], bottom row first
+	bool readImage(const std::string & filename, std::vector<float> & pixels, int & width, int & height);
+
+	// Decodes an image file with its own number of channels, or with channels of them when that
+	// isn't 0. Rows come bottom first unless bottomFirst is false (cube map faces are stored top
+	// first). 16-bit files are reduced to 8 bits unless keep16Bit is set. Safe to call from several
+	// threads at once; pass error there to get the reason for a failure instead of having it logged.
+	bool decodeImage(const std::string & filename, DecodedImage & image, int channels = 0, bool bottomFirst = true,
+		bool keep16Bit = false, std::string * error = nullptr);
+
+	// Peak signal-to-noise ratio in dB between the RGB of two images of the same size. Both are
+	// clamped and rounded to 8 bits first, so a render compares fairly with a PNG written from it.
+	// Identical images return infinity.
+	double psnr(const float * a, int strideA, const float * b, int strideB, int width, int height);
+}
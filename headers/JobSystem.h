@@ -0,0 +1,129 @@
+#pragma once
+
+#include "globals.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// The one thread pool of the program, shared by the software rasterizers, OBJ parsing, mip
+// generation and texture decoding instead of each of them spawning threads of its own.
+//
+// Every worker owns a deque of jobs. Jobs pushed from a worker go to the back of its own deque and
+// it takes them back from there (the most recent job is the one whose data is still in cache),
+// while idle workers steal from the front of the others' deques. The thread that called start() is
+// worker 0: it has a deque like the others but only runs jobs while it waits on a TaskGroup or a
+// parallelFor (only that group's jobs) or calls runOne(), so nothing runs behind the back of code
+// that doesn't wait.
+class JobSystem
+{
+public:
+	using Job = std::function<void()>;
+
+	struct WorkerStats {
+		// Time spent inside jobs
+		double busySeconds = 0.0;
+		size_t jobs = 0;
+		// Jobs taken from another worker's deque
+		size_t steals = 0;
+	};
+
+	// Jobs that are waited on together. The waiting thread runs the group's own jobs that haven't
+	// started yet, and sleeps while the rest finish on other threads; it never picks up unrelated
+	// work, so waiting on the GL thread doesn't run someone else's long job in the middle of a frame.
+	// Jobs can start and wait on groups of their own without tying up a worker.
+	class TaskGroup
+	{
+	public:
+		TaskGroup();
+		~TaskGroup();
+
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+
+		void run(Job job);
+
+		// Returns once every job of the group has finished, rethrowing the first exception one of
+		// them threw
+		void wait();
+
+	private:
+		friend class JobSystem;
+
+		void finish();
+
+		std::atomic<int> pending{ 0 };
+		std::mutex mutex;
+		std::condition_variable done;
+		std::exception_ptr exception;
+	};
+
+	static JobSystem& get();
+
+	~JobSystem();
+
+	// (Re)starts the pool with numThreads threads in total, the calling one included. 0 uses one
+	// thread per hardware thread. Jobs already queued are kept. Restarting joins every worker, so
+	// it's meant to be done once, from the main thread, while no jobs are running. With pinThreads, thread i is kept on core i where the platform
+	// allows it, which makes timings steadier but hurts when other programs need the cores.
+	void start(int numThreads = 0, bool pinThreads = false);
+	void stop();
+
+	// Threads jobs can run on, the calling one included. 1 until start() is called.
+	int threadCount() const;
+
+	// Calls body(chunkBegin, chunkEnd) for consecutive chunks of at most grain items covering
+	// [begin, end) and returns once all of them are done. Chunks are handed out one at a time, so
+	// threads that get cheap chunks simply take more of them. At most maxThreads threads take part
+	// (0 means all of them), the calling one included.
+	void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body, int maxThreads = 0);
+
+	// Runs one queued job on the calling thread: one of its own or, failing that, one stolen from
+	// another worker. Returns false when every deque was empty. Lets a thread that has nothing to
+	// wait on keep queued work moving, e.g. when the pool has no threads of its own.
+	bool runOne();
+
+	// Stats per worker since the last resetStats(), worker 0 first
+	std::vector<WorkerStats> getStats() const;
+	void resetStats();
+
+private:
+	struct Entry {
+		Job job;
+		// The group the job belongs to, if any
+		TaskGroup* group = nullptr;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Entry> jobs;
+		std::thread thread;
+
+		std::atomic<int64_t> busyNanoseconds{ 0 };
+		std::atomic<size_t> jobCount{ 0 };
+		std::atomic<size_t> stealCount{ 0 };
+	};
+
+	JobSystem();
+
+	std::vector<u_ptr<Worker>> workers;
+
+	// Jobs in all the deques, so sleeping workers know when to wake up
+	std::atomic<int> queued{ 0 };
+	std::atomic<bool> running{ false };
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	void push(Job job, TaskGroup* group = nullptr);
+
+	// Runs one queued job of the group on the calling thread, if any hasn't started yet
+	bool runOne(TaskGroup* group);
+
+	void run(Entry& entry, bool stolen);
+
+	void workerLoop(int index, bool pin);
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "globals.h"
+#include "imgui.h"
+
+// The Blinn-Phong terms src/shaders/fragment.frag is lit with. Kept apart from GPU.h so the CPU
+// shading paths can use it without OpenGL.
+struct Lighting {
+	// Ambient terms
+	float Ia = 0.05f;		// intensity
+	vec3 Ka = vec3(1.f);	// color
+
+	// Diffuse terms
+	float Id = 1.0f;
+	vec3 Kd = vec3(1.f);
+
+	// Specular terms
+	float shininess = 32.f;
+	vec3 Ks = vec3(1.f);
+
+	vec3 lightDirection = vec3(0, -1, 0);
+
+	bool autoOrbit = false;
+
+	vec3 orbitAxis = vec3(0, 1, 0);
+
+	bool point = false;
+	vec3 position = vec3(0.f);
+	float intensity = 10.f;
+	float radius = 2.0f;
+
+	void renderUI() {
+		if (ImGui::CollapsingHeader("Lighting")) {
+			ImGui::InputFloat("Ambient intensity", &Ia);
+			ImGui::ColorEdit3("Ambient color", glm::value_ptr(Ka));
+			ImGui::InputFloat("Diffuse intensity", &Id);
+			ImGui::ColorEdit3("Diffuse color", glm::value_ptr(Kd));
+			ImGui::InputFloat("Shininess", &shininess);
+			ImGui::ColorEdit3("Specular color", glm::value_ptr(Ks));
+			ImGui::InputFloat3("Light direction", glm::value_ptr(lightDirection));
+			ImGui::Checkbox("Point light", &point);
+			if (point) {
+				ImGui::InputFloat3("Position", glm::value_ptr(position));
+				ImGui::InputFloat("Intensity", &intensity);
+				ImGui::InputFloat("Radius", &radius);
+			}
+
+			ImGui::Checkbox("Auto-orbit", &autoOrbit);
+			ImGui::InputFloat3("Orbit on axis", glm::value_ptr(orbitAxis));
+		}
+	}
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "globals.h"
+
+#include <mutex>
+
+// Recycles large buffers, such as the CPU copies of framebuffer attachments (TextureMemory), so
+// resizing a window or re-rendering a scene reuses the memory of the last size instead of
+// allocating and freeing it every time.
+//
+// Sizes are rounded up to size classes, four to every power of two, so a buffer can be reused for
+// any size within a quarter of it. Released buffers are kept per class until maxPooledBytes is
+// reached; past that they're freed. Every buffer starts on a 64-byte boundary, a cache line and
+// the widest SIMD load.
+class MemoryPool
+{
+public:
+	struct Stats {
+		// Acquires served from the pool and acquires that had to allocate
+		size_t hits = 0;
+		size_t misses = 0;
+
+		// Bytes handed out and not released yet, and bytes kept for reuse
+		size_t usedBytes = 0;
+		size_t pooledBytes = 0;
+	};
+
+	static const size_t alignment = 64;
+
+	static MemoryPool& get();
+
+	// Bytes of released buffers kept for reuse at most
+	size_t maxPooledBytes = 256 * 1024 * 1024;
+
+	// Returns a buffer of at least size bytes and stores its real size (its size class) in
+	// capacity, which release() needs back. Returns nullptr for size 0 or when out of memory.
+	void* acquire(size_t size, size_t& capacity);
+	void release(void* buffer, size_t capacity);
+
+	// Frees every pooled buffer
+	void trim();
+
+	Stats getStats() const;
+	void resetStats();
+
+	// The size class size is rounded up to
+	static size_t sizeClass(size_t size);
+
+private:
+	MemoryPool() = default;
+
+	mutable std::mutex mutex;
+	Stats stats;
+
+	// Free buffers by size class
+	std::map<size_t, std::vector<void*>> buckets;
+};
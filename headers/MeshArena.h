@@ -0,0 +1,76 @@
+#pragma once
+
+#include "globals.h"
+
+#include <GL/glew.h>
+
+struct OBJMeshVertex;
+struct Shader;
+
+// What glMultiDrawElementsIndirect reads for each draw
+struct DrawElementsIndirectCommand
+{
+	GLuint count = 0;
+	GLuint instanceCount = 0;
+	GLuint firstIndex = 0;
+	GLint baseVertex = 0;
+	GLuint baseInstance = 0;
+};
+
+// The vertices and indices of every mesh in one shared vertex buffer and one index buffer behind a
+// single VAO, so objects with different meshes are drawn without switching buffers: each mesh is a
+// range of indices (firstIndex, count) over its own vertices (baseVertex). Meshes are appended;
+// when a buffer runs out of room it's replaced by one twice the size and the old contents copied
+// over on the GPU.
+class MeshArena
+{
+public:
+	struct Range {
+		GLuint firstIndex = 0;
+		GLuint indexCount = 0;
+		GLint baseVertex = 0;
+		GLuint vertexCount = 0;
+	};
+
+	GLuint VAO = 0;
+	GLuint VBO = 0;
+	GLuint IBO = 0;
+
+	// One per mesh, in the order they were added
+	std::vector<Range> ranges;
+
+	MeshArena() = default;
+	~MeshArena();
+
+	MeshArena(const MeshArena&) = delete;
+	MeshArena& operator=(const MeshArena&) = delete;
+
+	// Creates the VAO with shader's vertex attributes (vPosition, vNormal, texCoord, vTangent and
+	// vBitangent) pointing into the shared vertex buffer
+	void init(const Shader& shader);
+
+	// Appends a mesh and returns its index in ranges
+	int add(const OBJMeshVertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount);
+
+	// A command drawing instanceCount instances of a mesh, the first of them baseInstance
+	DrawElementsIndirectCommand command(int mesh, GLuint instanceCount, GLuint baseInstance) const;
+
+	// Bytes of the two buffers, used and allocated
+	size_t usedBytes() const;
+	size_t capacityBytes() const;
+
+	// glMultiDrawElementsIndirect with instance offsets (GL 4.3, or the ARB extensions)
+	static bool multiDrawSupported();
+
+private:
+	// Makes room for more bytes in buffer, copying what's in it to a larger one
+	void reserve(GLuint& buffer, size_t& capacity, size_t used, size_t needed);
+	void pointAttributes();
+
+	std::vector<GLint> attributeLocations;
+
+	size_t vertexBytes = 0;
+	size_t vertexCapacity = 0;
+	size_t indexBytes = 0;
+	size_t indexCapacity = 0;
+};
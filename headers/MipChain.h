@@ -0,0 +1,84 @@
+#pragma once
+
+#include "globals.h"
+
+#include "BlockCompression.h"
+#include "ImageIO.h"
+
+class TextureFile;
+
+MAKE_ENUM(MipFilter, int, Box, Kaiser);
+
+// What an image holds. Decides how its mip chain is filtered and, in the OpenGL renderer, the
+// format it's stored in (see Texture::storagePolicy). Data is for the other non-color images, such
+// as roughness or occlusion.
+MAKE_ENUM(TextureRole, int, Albedo, Normal, Height, Displacement, Data);
+
+// How the smaller levels of a mip chain are filtered from the image
+struct MipSettings {
+	TextureRole role = TextureRole::Albedo;
+
+	// Box averages 2x2 texels. Kaiser is a windowed sinc over 6x6 texels: sharper, at a few times
+	// the cost.
+	MipFilter filter = MipFilter::Box;
+
+	// RGB is sRGB encoded, so it's averaged in linear space and encoded again. Off for data such as
+	// height maps, which are averaged as they are.
+	bool srgb = true;
+
+	// RGB holds a normal mapped to [0, 1]. Averaging shortens normals, so each texel is normalized
+	// again after filtering.
+	bool normalMap = false;
+
+	// A height or displacement map. Only the first channel is kept, with 16 bits where the file has
+	// them.
+	bool heightMap = false;
+
+	// Keep the levels block compressed (see BlockCompression): BC5 for normal maps, BC4 for height
+	// maps and gray images, BC7 for images with alpha and BC1 for the other colors
+	bool compress = false;
+
+	// The settings that suit a role. Compression is left off.
+	static MipSettings forRole(TextureRole role);
+
+	// Guesses the role from the name of an image file: normal maps (normal, nrm), displacement
+	// (disp), height maps (height, bump) and other data (roughness, ...)
+	static MipSettings forFile(const std::string& filename);
+};
+
+// An image and all of its mip levels down to 1x1, every level half the size of the one before
+// (rounded down) like glGenerateMipmap makes them. All levels have the same number of channels.
+struct MipChain {
+	std::vector<ImageIO::DecodedImage> levels;
+
+	// With compression the levels' pixels hold blocks of this format instead of pixels (their
+	// channels are still the image's)
+	BlockFormat format = BlockFormat::None;
+
+	// Where load() keeps the chains it builds, one file per image and settings. Empty turns the
+	// cache off.
+	static std::string cacheDirectory;
+
+	// Replaces levels with image and the levels filtered from it, compressed if the settings ask
+	// for it. The work is spread over the JobSystem's threads.
+	void build(ImageIO::DecodedImage image, MipSettings settings);
+
+	// Decodes compressed levels back to pixels. BC5 normal maps come back as RGB, with z rebuilt.
+	void decompress();
+
+	// Reads the chain for an image file from the cache, or decodes the image, builds the chain and
+	// writes it to the cache. Cached chains are rebuilt when the file's size or modification time
+	// changes. The cache holds TextureFiles, which are memory mapped.
+	//
+	// TextureFiles load as they are, without the cache; their compressed levels are decompressed
+	// unless the settings ask for compression.
+	//
+	// Problems are logged, or with error given (on the JobSystem's threads) put there instead. A
+	// cache that can't be written doesn't fail the load but is still reported.
+	//
+	// With mapped given, a chain read from a texture file (the cache's included) is left in the
+	// mapping instead of being copied: mapped is opened on the file and levels stays empty. Files
+	// that have to be decompressed are still copied, and mapped is left closed.
+	bool load(const std::string& filename, MipSettings settings, std::string* error = nullptr,
+		TextureFile* mapped = nullptr);
+};
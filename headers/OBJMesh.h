@@ -7,6 +7,7 @@
 #include "Framebuffer.h"
 #include "GPU.h"
 #include "Input.h"
+#include "JobSystem.h"
 #include "Primitives.h"
 #include "Renderer.h"
 #include "StringUtil.h"
@@ -32,12 +33,47 @@ struct OBJMesh {
   GLuint VBO = 0;
   GLuint IBO = 0;
 
+  // Bounds in the mesh's own space, set by computeBounds(): the box around
+  // its vertices, and a sphere around the box's center
+  vec3 boundsMin = vec3(0);
+  vec3 boundsMax = vec3(0);
+  vec3 boundsCenter = vec3(0);
+  float boundsRadius = 0.0f;
+
+  void computeBounds() {
+    if (vertices.empty()) {
+      return;
+    }
+
+    boundsMin = boundsMax = vertices[0].position;
+    for (const OBJMeshVertex &vertex : vertices) {
+      boundsMin = glm::min(boundsMin, vertex.position);
+      boundsMax = glm::max(boundsMax, vertex.position);
+    }
+
+    // Tighter than half the box's diagonal unless the mesh fills the corners
+    boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    float radius2 = 0.0f;
+    for (const OBJMeshVertex &vertex : vertices) {
+      vec3 offset = vertex.position - boundsCenter;
+      radius2 = glm::max(radius2, glm::dot(offset, offset));
+    }
+    boundsRadius = glm::sqrt(radius2);
+  }
+
   bool isValid() {
     return VAO != 0 && VBO != 0 && IBO != 0 && !vertices.empty() &&
            !indices.empty();
   }
 
-  static OBJMesh import(const char *objFile, GLuint shaderProgram) {
+  // Reads the vertices and indices of an OBJ file into CPU memory without
+  // touching OpenGL, so the software renderers can use the mesh too.
+  //
+  // The file is read in one go and cut into chunks at line breaks that the
+  // JobSystem parses in parallel. Faces only refer to vertices by index, so
+  // once every chunk is parsed the vertex lists are joined and each chunk
+  // builds its faces' vertices straight into its slice of the mesh.
+  static OBJMesh parse(const char *objFile) {
     OBJMesh mesh;
 
     std::ifstream fin(objFile);
@@ -47,138 +83,78 @@ struct OBJMesh {
       return mesh;
     }
 
-    std::string line;
+    std::stringstream buffer;
+    buffer << fin.rdbuf();
+    const std::string text = buffer.str();
 
-    std::vector<vec3> vertices;
-    std::vector<vec3> normals;
-    std::vector<vec2> texCoords;
+    const size_t chunkSize = 256 * 1024;
+    size_t numChunks = glm::max<size_t>(1, text.size() / chunkSize);
 
-    GLuint faceIndex = 0;
+    std::vector<size_t> chunkStarts(numChunks + 1, text.size());
+    chunkStarts[0] = 0;
+    for (size_t i = 1; i < numChunks; i++) {
+      size_t lineBreak = text.find('\n', i * text.size() / numChunks);
+      chunkStarts[i] = glm::max(chunkStarts[i - 1], lineBreak == std::string::npos ? text.size() : lineBreak + 1);
+    }
 
-    while (std::getline(fin, line)) {
-      auto lineEntries = StringUtil::split(line, ' ');
+    std::vector<ParseChunk> chunks(numChunks);
 
-      if (lineEntries.empty()) {
-        continue;
+    JobSystem::get().parallelFor(0, (int)numChunks, 1, [&](int begin, int end) {
+      for (int i = begin; i < end; i++) {
+        chunks[i].parse(text.c_str() + chunkStarts[i], text.c_str() + chunkStarts[i + 1]);
       }
+    });
 
-      if (lineEntries[0] == "v" || lineEntries[0] == "vn") {
-        vec3 v;
-        v[0] = std::atof(lineEntries[1].c_str());
-        v[1] = std::atof(lineEntries[2].c_str());
-        v[2] = std::atof(lineEntries[3].c_str());
-
-        if (lineEntries[0] == "v") {
-          vertices.push_back(v);
-        } else if (lineEntries[0] == "vn") {
-          normals.push_back(v);
-        }
-      } else if (lineEntries[0] == "vt") {
-        vec2 uv;
-        uv[0] = std::atof(lineEntries[1].c_str());
-        uv[1] = std::atof(lineEntries[2].c_str());
-
-        texCoords.push_back(uv);
-      } else if (lineEntries[0] == "f") {
-        if (StringUtil::contains(line, "/")) {
-          for (int i = 1; i < lineEntries.size(); i++) {
-            int positionIndex = -1, normalIndex = -1, texCoordIndex = -1;
-
-            auto faceComponents = StringUtil::split(lineEntries[i], '/', false);
-
-            if (faceComponents.size() == 2) {
-              positionIndex = std::stoi(faceComponents[0]) - 1;
-              texCoordIndex = std::stoi(faceComponents[1]) - 1;
-            } else if (faceComponents.size() == 3) {
-              positionIndex = std::stoi(faceComponents[0]) - 1;
-              if (faceComponents[1] != "") {
-                texCoordIndex = std::stoi(faceComponents[1]) - 1;
-              }
-              normalIndex = std::stoi(faceComponents[2]) - 1;
-            }
-
-            OBJMeshVertex omv;
-            omv.position = vertices[positionIndex];
-            if (normals.empty()) {
-              omv.normal = glm::normalize(omv.position);
-            } else {
-              omv.normal = normals[normalIndex];
-            }
+    std::vector<vec3> vertices;
+    std::vector<vec3> normals;
+    std::vector<vec2> texCoords;
 
-            if (texCoordIndex > -1) {
-              omv.texCoord = texCoords[texCoordIndex];
-            }
+    // Where each chunk's vertices start in the mesh
+    std::vector<size_t> chunkVertices(numChunks + 1, 0);
 
-            mesh.vertices.push_back(omv);
-            mesh.indices.push_back(faceIndex++);
-          }
+    for (size_t i = 0; i < numChunks; i++) {
+      ParseChunk &chunk = chunks[i];
+      chunk.normalsBefore = normals.size();
 
-          // 2 tris per face (quad)
-          if (lineEntries.size() == 5) {
-            // Turn (0, 1, 2, 3) into two separate tris: (0, 1, 2) and (2, 3,
-            // 0). (0, 1, 2) is already in the mesh. Create (2, 3, 0);
-
-            // Get vertex 3 which has already been pushed on.
-            auto v3 = mesh.vertices.back();
-            mesh.vertices.pop_back();
-
-            // Get vertex 2 which has to be copied
-            auto v2 = mesh.vertices.back();
-
-            // Get vertex 0 which is 2 behind this one
-            auto v0 = mesh.vertices[mesh.vertices.size() - 3];
-            mesh.vertices.push_back(v2);
-            mesh.vertices.push_back(v3);
-            mesh.vertices.push_back(v0);
-            mesh.indices.push_back(faceIndex++);
-            mesh.indices.push_back(faceIndex++);
-          }
+      vertices.insert(vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+      normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+      texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
 
-          // Compute tangent and bitangent vectors from the last 3 entries.
-          size_t nv = mesh.vertices.size();
-          vec3 pos1 = mesh.vertices[nv - 3].position;
-          vec3 pos2 = mesh.vertices[nv - 2].position;
-          vec3 pos3 = mesh.vertices[nv - 1].position;
-          vec2 uv1 = mesh.vertices[nv - 3].texCoord;
-          vec2 uv2 = mesh.vertices[nv - 2].texCoord;
-          vec2 uv3 = mesh.vertices[nv - 1].texCoord;
-
-          vec3 edge1 = pos2 - pos1;
-          vec3 edge2 = pos3 - pos1;
-          vec2 deltaUV1 = uv2 - uv1;
-          vec2 deltaUV2 = uv3 - uv1;
-
-          float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-          vec3 tangent, bitangent;
-
-          tangent.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-          tangent.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-          tangent.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-
-          bitangent.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-          bitangent.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-          bitangent.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-
-          for (int i = 3; i > 0; i--) {
-            mesh.vertices[nv - i].tangent = tangent;
-            mesh.vertices[nv - i].bitangent = bitangent;
-          }
-        } else {
-          for (int i = 1; i < lineEntries.size(); i++) {
+      chunkVertices[i + 1] = chunkVertices[i] + chunk.vertexCount;
+    }
 
-            int positionIndex = std::stoi(lineEntries[i]) - 1;
+    mesh.vertices.resize(chunkVertices[numChunks]);
+    mesh.indices.resize(chunkVertices[numChunks]);
 
-            OBJMeshVertex omv;
-            omv.position = vertices[positionIndex];
-            omv.normal = vec3(0.f);
+    JobSystem::get().parallelFor(0, (int)numChunks, 1, [&](int begin, int end) {
+      for (int i = begin; i < end; i++) {
+        chunks[i].build(vertices, normals, texCoords, mesh.vertices.data() + chunkVertices[i]);
 
-            mesh.vertices.push_back(omv);
-            mesh.indices.push_back(faceIndex++);
-          }
+        for (size_t v = chunkVertices[i]; v < chunkVertices[i + 1]; v++) {
+          mesh.indices[v] = (GLuint)v;
         }
       }
+    });
+
+    mesh.computeBounds();
+    return mesh;
+  }
+
+  static OBJMesh import(const char *objFile, GLuint shaderProgram) {
+    OBJMesh mesh = parse(objFile);
+
+    if (mesh.vertices.empty()) {
+      return mesh;
     }
 
+    mesh.upload(shaderProgram);
+    return mesh;
+  }
+
+  // Creates the VAO, VBO and IBO for the parsed vertices and indices.
+  void upload(GLuint shaderProgram) {
+    OBJMesh &mesh = *this;
+
     glGenVertexArrays(1, &mesh.VAO);
     glBindVertexArray(mesh.VAO);
 
@@ -227,35 +203,43 @@ struct OBJMesh {
                  (const void *)mesh.indices.data(), GL_STATIC_DRAW);
 
     glBindVertexArray(0);
-    return mesh;
   }
 
-  static OBJMesh getSphere(GLuint shaderProgram) {
+  // The vertices and indices of the default sphere, in CPU memory only
+  static OBJMesh makeSphere() {
     OBJMesh sphere;
-    glGenVertexArrays(1, &sphere.VAO);
-    glBindVertexArray(sphere.VAO);
-
-    glGenBuffers(1, &sphere.VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, sphere.VBO);
 
     for (auto &vertex : Sphere::instance.positions) {
-      OBJMeshVertex omv;
+      OBJMeshVertex omv = {};
       omv.position = vertex;
       omv.normal = glm::normalize(omv.position);
       sphere.vertices.push_back(omv);
     }
 
+    for (auto &tri : Sphere::instance.indices) {
+      for (int i = 0; i < 3; i++) {
+        sphere.indices.push_back(tri[i]);
+      }
+    }
+
+    sphere.computeBounds();
+    return sphere;
+  }
+
+  static OBJMesh getSphere(GLuint shaderProgram) {
+    OBJMesh sphere = makeSphere();
+    glGenVertexArrays(1, &sphere.VAO);
+    glBindVertexArray(sphere.VAO);
+
+    glGenBuffers(1, &sphere.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, sphere.VBO);
+
     glBufferData(GL_ARRAY_BUFFER,
                  sizeof(OBJMeshVertex) * sphere.vertices.size(),
                  (const void *)sphere.vertices.data(), GL_STATIC_DRAW);
 
     glGenBuffers(1, &sphere.IBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere.IBO);
-    for (auto &tri : Sphere::instance.indices) {
-      for (int i = 0; i < 3; i++) {
-        sphere.indices.push_back(tri[i]);
-      }
-    }
 
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                  sizeof(GLuint) * sphere.indices.size(),
@@ -277,4 +261,218 @@ struct OBJMesh {
 
     return sphere;
   }
+private:
+  // One corner of a face as written in the file, 0-based, -1 when missing
+  struct FaceCorner {
+    int position = -1;
+    int texCoord = -1;
+    int normal = -1;
+  };
+
+  struct Face {
+    size_t firstCorner = 0;
+    size_t cornerCount = 0;
+
+    // Written with slashes (v/vt/vn), faces with only positions get no
+    // normals or texture coordinates
+    bool slashed = false;
+
+    // Normals declared earlier in the chunk. Until the file declares its first
+    // one, normals come from the positions.
+    size_t normalsBefore = 0;
+  };
+
+  // The lines of one piece of an OBJ file
+  struct ParseChunk {
+    std::vector<vec3> vertices;
+    std::vector<vec3> normals;
+    std::vector<vec2> texCoords;
+
+    std::vector<Face> faces;
+    std::vector<FaceCorner> corners;
+
+    // Mesh vertices the faces turn into
+    size_t vertexCount = 0;
+
+    // Normals declared in the chunks before this one
+    size_t normalsBefore = 0;
+
+    // Like std::atof and std::stoi, but past the end of the line they read 0
+    // instead of whatever comes next in the file
+    static float readFloat(const std::vector<std::pair<const char *, const char *>> &tokens, size_t i) {
+      return i < tokens.size() ? (float)std::atof(tokens[i].first) : 0.f;
+    }
+
+    static int readIndex(const char *begin, const char *end) {
+      return begin < end ? (int)std::strtol(begin, nullptr, 10) - 1 : -1;
+    }
+
+    void parse(const char *begin, const char *end) {
+      // Space separated words of the current line, as (begin, end) pointers
+      std::vector<std::pair<const char *, const char *>> tokens;
+
+      while (begin < end) {
+        const char *lineEnd = std::find(begin, end, '\n');
+        const char *next = lineEnd + 1;
+
+        // Files saved on Windows end their lines with \r\n (sphere.obj even
+        // with \r\r\n). Left in, a \r would count as one more corner of faces
+        // written with a trailing space.
+        while (lineEnd > begin && lineEnd[-1] == '\r') {
+          lineEnd--;
+        }
+
+        tokens.clear();
+        for (const char *c = begin; c < lineEnd;) {
+          const char *tokenEnd = std::find(c, lineEnd, ' ');
+          if (tokenEnd > c) {
+            tokens.emplace_back(c, tokenEnd);
+          }
+          c = tokenEnd + 1;
+        }
+
+        const char *lineBegin = begin;
+        begin = next;
+
+        if (tokens.empty()) {
+          continue;
+        }
+
+        std::string type(tokens[0].first, tokens[0].second);
+
+        if (type == "v" || type == "vn") {
+          vec3 v(readFloat(tokens, 1), readFloat(tokens, 2), readFloat(tokens, 3));
+
+          if (type == "v") {
+            vertices.push_back(v);
+          } else {
+            normals.push_back(v);
+          }
+        } else if (type == "vt") {
+          texCoords.push_back(vec2(readFloat(tokens, 1), readFloat(tokens, 2)));
+        } else if (type == "f") {
+          Face face;
+          face.firstCorner = corners.size();
+          face.cornerCount = tokens.size() - 1;
+          face.slashed = std::find(lineBegin, lineEnd, '/') != lineEnd;
+          face.normalsBefore = normals.size();
+
+          for (size_t i = 1; i < tokens.size(); i++) {
+            FaceCorner corner;
+
+            if (face.slashed) {
+              // v/vt or v/vt/vn, where vt can be left out (v//vn)
+              const char *components[4] = {tokens[i].first};
+              int numComponents = 1;
+
+              for (const char *c = tokens[i].first; c < tokens[i].second && numComponents < 4; c++) {
+                if (*c == '/') {
+                  components[numComponents++] = c + 1;
+                }
+              }
+
+              // A trailing slash doesn't start another component
+              if (components[numComponents - 1] == tokens[i].second) {
+                numComponents--;
+              }
+
+              if (numComponents == 2 || numComponents == 3) {
+                corner.position = readIndex(components[0], components[1] - 1);
+                corner.texCoord = readIndex(components[1], numComponents == 3 ? components[2] - 1 : tokens[i].second);
+              }
+              if (numComponents == 3) {
+                corner.normal = readIndex(components[2], tokens[i].second);
+              }
+            } else {
+              corner.position = readIndex(tokens[i].first, tokens[i].second);
+            }
+
+            corners.push_back(corner);
+          }
+
+          // 2 tris per face (quad)
+          vertexCount += face.slashed && face.cornerCount == 4 ? 6 : face.cornerCount;
+          faces.push_back(face);
+        }
+      }
+    }
+
+    // Writes the vertices of the chunk's faces to out, given the vertices of
+    // the whole file
+    void build(const std::vector<vec3> &vertices, const std::vector<vec3> &normals,
+               const std::vector<vec2> &texCoords, OBJMeshVertex *out) const {
+      for (const Face &face : faces) {
+        OBJMeshVertex *faceVertices = out;
+
+        for (size_t i = 0; i < face.cornerCount; i++) {
+          const FaceCorner &corner = corners[face.firstCorner + i];
+
+          OBJMeshVertex omv = {};
+          if (corner.position >= 0 && corner.position < (int)vertices.size()) {
+            omv.position = vertices[corner.position];
+          }
+
+          if (face.slashed) {
+            if (normalsBefore + face.normalsBefore == 0) {
+              omv.normal = glm::normalize(omv.position);
+            } else if (corner.normal >= 0 && corner.normal < (int)normals.size()) {
+              omv.normal = normals[corner.normal];
+            }
+
+            if (corner.texCoord >= 0 && corner.texCoord < (int)texCoords.size()) {
+              omv.texCoord = texCoords[corner.texCoord];
+            }
+          }
+
+          *out++ = omv;
+        }
+
+        if (!face.slashed) {
+          continue;
+        }
+
+        if (face.cornerCount == 4) {
+          // Turn (0, 1, 2, 3) into two separate tris: (0, 1, 2) and (2, 3, 0)
+          OBJMeshVertex v3 = faceVertices[3];
+          faceVertices[3] = faceVertices[2];
+          faceVertices[4] = v3;
+          faceVertices[5] = faceVertices[0];
+          out = faceVertices + 6;
+        }
+
+        if (out - faceVertices < 3) {
+          continue;
+        }
+
+        // Compute tangent and bitangent vectors from the last 3 entries.
+        vec3 pos1 = out[-3].position;
+        vec3 pos2 = out[-2].position;
+        vec3 pos3 = out[-1].position;
+        vec2 uv1 = out[-3].texCoord;
+        vec2 uv2 = out[-2].texCoord;
+        vec2 uv3 = out[-1].texCoord;
+
+        vec3 edge1 = pos2 - pos1;
+        vec3 edge2 = pos3 - pos1;
+        vec2 deltaUV1 = uv2 - uv1;
+        vec2 deltaUV2 = uv3 - uv1;
+
+        float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
+        vec3 tangent, bitangent;
+
+        tangent.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
+        tangent.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
+        tangent.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
+
+        bitangent.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
+        bitangent.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
+        bitangent.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
+
+        for (int i = 3; i > 0; i--) {
+          out[-i].tangent = tangent;
+          out[-i].bitangent = bitangent;
+        }
+      }
+    }
+  };
 };
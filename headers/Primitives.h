@@ -377,6 +377,10 @@ struct Transform2D {
 
 	bool autoFall = false;
 
+	// Set when the UI edits the transform, and by code that changes it, so cached matrices
+	// (TransformCache) are recomputed
+	bool dirty = true;
+
 	// Computes a 4x4 matrix that can transform 2D and 3D points by the translation, rotation, and scale listed above
 	mat4 getMatrix() {
 		mat4 S;
@@ -443,12 +447,12 @@ struct Transform2D {
 	}
 
 	void renderUI() {
-		ImGui::InputFloat3("Translate", glm::value_ptr(translation));
-		ImGui::SliderFloat3("Translate sliders", glm::value_ptr(translation), -10.0f, 10.0f);
+		dirty |= ImGui::InputFloat3("Translate", glm::value_ptr(translation));
+		dirty |= ImGui::SliderFloat3("Translate sliders", glm::value_ptr(translation), -10.0f, 10.0f);
 		ImGui::Text("Rotation");
-		ImGui::InputFloat3("Axis", glm::value_ptr(rotation));
-		ImGui::SliderFloat("Angle", &rotation.w, 0.0f, glm::two_pi<float>());
-		ImGui::InputFloat3("Scale", glm::value_ptr(scale));
+		dirty |= ImGui::InputFloat3("Axis", glm::value_ptr(rotation));
+		dirty |= ImGui::SliderFloat("Angle", &rotation.w, 0.0f, glm::two_pi<float>());
+		dirty |= ImGui::InputFloat3("Scale", glm::value_ptr(scale));
 	}
 };
 
@@ -528,6 +532,10 @@ struct SceneObject {
 	bool useModelMatrix = false;
 	bool autoOrbit = false;
 	vec4 orbitalRotation = vec4(0);
+	// Index of the object's texture in a TextureAtlas, -1 for none
+	int atlasTexture = -1;
+	// Index of the object's mesh, -1 for the active one
+	int mesh = -1;
 
 	void renderUI() {
 		ImGui::PushID((const void*)this);
@@ -539,6 +547,8 @@ struct SceneObject {
 			ImGui::Checkbox("Auto-orbit", &autoOrbit);
 			ImGui::InputFloat3("Orbit on axis", glm::value_ptr(orbitalRotation));
 			ImGui::SliderFloat("Orbital rotation", &orbitalRotation.w, 0, glm::two_pi<float>());
+			ImGui::InputInt("Atlas texture", &atlasTexture);
+			ImGui::InputInt("Mesh", &mesh);
 
 			if (ImGui::Button("Delete")) {
 				shouldDelete = true;
@@ -556,4 +566,62 @@ void renderTriangleOutline(Triangle& tri, float* pixels, int stride, int width,
 void renderTriangleParametric(Triangle& tri, float* pixels, int stride, int width, int height);
 void renderTriangleBoundingBox(Triangle& tri, float* pixels, int stride, int width, int height);
 
-void renderIcosphere(Icosphere& ico, float* pixels, int stride, int width, int height, bool useColors = true);
\ No newline at end of file
+// Triangles are sampled at whole pixel coordinates, so one whose bounding box holds no sample can't
+// cover anything, and one whose box holds at most 2x2 samples (most of them, with dense meshes) is
+// cheaper to test sample by sample than to set up a bounding-box traversal for.
+MAKE_ENUM(RasterPath, int, Culled, Micro, BoundingBox);
+
+struct RasterSetup {
+	RasterPath path = RasterPath::Culled;
+	// The first sample inside the triangle's bounding box (clipped to the screen), and how many
+	// samples the box holds in x and y
+	ivec2 sample = ivec2(0);
+	ivec2 samples = ivec2(0);
+};
+
+RasterSetup classifyTriangle(const Triangle& tri, int width, int height);
+
+// Micro triangle samples waiting to be tested, one triangle and sample per lane. The inside tests for
+// a whole batch run together (in SSE2 lanes when available), then the samples that pass are depth
+// tested and written in the order they were added, so the result matches renderTriangleBoundingBox.
+class MicroTriangleBatch {
+public:
+	static const int Size = 8;
+
+	bool full() const { return count == Size; }
+
+	// pixel is where the triangle's sample lives in the target
+	void add(Triangle& tri, ivec2 sample, float* pixel);
+	void flush();
+
+private:
+	int count = 0;
+
+	Triangle* triangles[Size];
+	float* pixels[Size];
+
+	alignas(16) float x0[Size], y0[Size], x1[Size], y1[Size], x2[Size], y2[Size];
+	alignas(16) float sampleX[Size], sampleY[Size];
+};
+
+void renderIcosphere(Icosphere& ico, float* pixels, int stride, int width, int height, bool useColors = true);
+
+// Projects an object-space point into window coordinates: x and y in pixels, z in [0, 1]
+vec3 WorldToScreen(vec3 world, mat4 modelview, mat4 projection, int viewportWidth, int viewportHeight);
+
+void renderSphere(mat4 model, mat4 view, mat4 projection, vec3 color, float* pixels, int stride, int width, int height, vec3* lightSource = nullptr);
+
+// Triangle setup shared by the CPU labs and the headless renderer. Instead of drawing right away, these
+// append screen-space triangles that are ready to be passed to renderTriangleBoundingBox.
+
+// Moves the icosphere's vertices by M and renormalizes their depth into [0, 1] the way Lab 04 does
+void transformIcosphere(Icosphere& ico, const mat4& M);
+void appendIcosphereTriangles(const Icosphere& ico, std::vector<Triangle>& triangles, bool useColors = true);
+
+// Projects indexed triangles with the given camera. When lightSource is set, each triangle is lit by
+// its face normal the same way Lab 05 lights its planets. Otherwise it gets the flat color.
+void appendMeshTriangles(const vec3* positions, const unsigned int* indices, size_t numIndices,
+	mat4 model, mat4 view, mat4 projection, vec3 color, int width, int height,
+	std::vector<Triangle>& triangles, const vec3* lightSource = nullptr);
+void appendSphereTriangles(mat4 model, mat4 view, mat4 projection, vec3 color, int width, int height,
+	std::vector<Triangle>& triangles, const vec3* lightSource = nullptr);
\ No newline at end of file
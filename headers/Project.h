@@ -2,7 +2,64 @@
 
 #include "Assignment.h"
 
+#include "Frustum.h"
+#include "GLState.h"
 #include "GPU.h"
+#include "MeshArena.h"
+#include "TextureAtlas.h"
+#include "TransformCache.h"
+
+struct OBJMesh;
+
+// The uniform blocks of the shaders in src/shaders, in std140 layout: each vec3 is
+// followed by a float
+struct FrameConstants {
+  mat4 viewProjection;
+  vec3 cameraPosition;
+  float Ia;
+  vec3 Ka;
+  float Id;
+  vec3 Kd;
+  float shininess;
+  vec3 Ks;
+  float padding0;
+  vec3 lightDirection;
+  float padding1;
+  vec3 outerTesselation;
+  float padding2;
+  vec3 innerTesselation;
+  float padding3;
+};
+
+struct ObjectConstants {
+  mat4 mvp;
+  mat4 model;
+  mat4 normalMatrix;
+  vec4 atlasRect;
+  float atlasLayer;
+  GLint useAtlas;
+  float padding0;
+  float padding1;
+};
+
+// std140 rounds a block's size up to a multiple of 16 bytes
+static_assert(sizeof(FrameConstants) % 16 == 0, "FrameConstants isn't padded to std140");
+static_assert(sizeof(ObjectConstants) % 16 == 0, "ObjectConstants isn't padded to std140");
+
+// What instanced draws read per object instead of ObjectConstants, as vertex
+// attributes with a divisor of 1
+struct InstanceData {
+  mat4 model;
+  mat3 normalMatrix;
+  vec4 atlasRect;
+  float atlasLayer; // negative without an atlas image
+};
+
+// An object's draw in the queue of separate draws, which is sorted by key
+struct DrawItem {
+  uint64_t key;
+  int object;
+};
 
 class Project : public Assignment {
 public:
@@ -14,6 +71,56 @@ public:
 
   std::vector<SceneObject> sceneObjects;
 
+  // The loaded color textures, for objects to pick from (SceneObject::atlasTexture)
+  TextureAtlas atlas;
+
+  // Handles to the uniforms of shader and cubemapShader, found once they're linked
+  struct Uniforms {
+    UniformHandle useTexture, srgbTexture, atlasTexture;
+    UniformHandle normalTexture, validNormalTexture, useNormalTexture;
+    UniformHandle heightmapTexture, useParallaxTexture, parallaxLayers;
+    UniformHandle displacementMap, useDisplacementMap, displacementScale;
+    UniformHandle useInstancing;
+
+    UniformHandle cubemap, cubemapView, cubemapProjection;
+  } uniforms;
+
+  // Bound to the FrameConstants and ObjectConstants blocks
+  UniformBuffer frameConstants;
+  UniformBuffer objectConstants;
+
+  // The objects' world and normal matrices, recomputed when they move
+  TransformCache transforms;
+
+  // Every mesh's vertices and indices; mesh i is range i
+  MeshArena arena;
+
+  // Per-object data of the instanced draws, grouped by mesh, and the command
+  // drawing each group
+  std::vector<InstanceData> instances;
+  GLuint instanceBuffer = 0;
+  std::vector<DrawElementsIndirectCommand> commands;
+  GLuint indirectBuffer = 0;
+
+  size_t drawCalls = 0;
+
+  // The objects' world-space bounding spheres, and the indices of the objects
+  // inside the camera's frustum this frame
+  SphereCuller culler;
+  std::vector<int> visibleObjects;
+
+  struct CullingStats {
+    size_t visible = 0;
+    size_t culled = 0;
+    double milliseconds = 0.0;
+  } cullingStats;
+
+  // The separate draws of this frame (with tessellation, or instancing off)
+  std::vector<DrawItem> drawQueue;
+
+  // The binds of the last frame, through GLState
+  GLState::Stats stateStats;
+
   Project() : Assignment("Project", true) {}
   virtual ~Project() {}
 
@@ -21,6 +128,29 @@ public:
   virtual void render(s_ptr<Framebuffer> framebuffer);
   virtual void renderUI();
 
+  // Rebuilds the atlas from the textures the renderer has loaded
+  void buildAtlas();
+
+  void findUniforms();
+
+  // Fills visibleObjects with the objects whose bounds are inside the frustum
+  // of viewProjection, or with every object when culling is off
+  void cullObjects(const mat4 &viewProjection);
+
+  // Draws every visible object instanced: with one glMultiDrawElementsIndirect where
+  // the GL has it, or one instanced draw per mesh
+  void drawInstanced();
+
+  // Points the instance attributes of the arena's VAO at instances from
+  // firstInstance on
+  void pointInstanceAttributes(size_t firstInstance);
+
+  // Keeps the mesh's vertices for the CPU and appends them to the arena
+  void addMesh(OBJMesh mesh);
+
+  // The object's image in the atlas, when the atlas is used and has it
+  const TextureAtlas::Entry *atlasEntry(const SceneObject &object) const;
+
   void addSceneObject() {
     SceneObject newObject;
     newObject.name = fmt::format("Object {0}", sceneObjects.size() + 1);
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "globals.h"
+#include "Camera.h"
+#include "Lighting.h"
+#include "Primitives.h"
+#include "SoftwareShading.h"
+
+struct OBJMesh;
+class TextureMemory;
+
+// Vertex: the labs' pipeline, lit per vertex like Lab 05 and drawn with renderTriangleBoundingBox.
+// Deferred: rasterization only fills a G-buffer, then every visible pixel is lit once with
+// fragment.frag's Blinn-Phong model.
+// Forward: the same per-pixel lighting, run for every fragment that passes the depth test, the way
+// Project draws on the GPU.
+MAKE_ENUM(SoftwareShading, int, Vertex, Deferred, Forward);
+
+// Everything the CPU labs know how to draw, gathered into one scene that doesn't need OpenGL, a
+// window or Application. Scenes are described in json files (see scenes/) so they can be rendered
+// by the headless renderer on machines without a GPU.
+class SoftwareScene
+{
+	public:
+		struct MeshEntry
+		{
+			std::string filename;
+			s_ptr<OBJMesh> mesh;
+			std::vector<SceneObject> instances;
+
+			// Only the per-pixel shading paths use the textures
+			SoftwareMaterial material;
+		};
+
+		std::string name = "scene";
+
+		ivec2 resolution = ivec2(256, 128);
+		vec4 clearColor = vec4(0.f, 0.f, 0.f, 1.f);
+
+		// Only the position, lookat, up, FOVY, near-far and ortho values are used
+		Camera camera;
+
+		// Point lights. Like Lab 05, only the first one lights the scene
+		std::vector<vec3> lights;
+
+		SoftwareShading shading = SoftwareShading::Vertex;
+
+		// Directional light for per-pixel shading, same terms as the Project assignment's light
+		Lighting lighting;
+
+		// Per-pixel shading only: shadows from the directional light, looked up with PCF
+		bool shadows = false;
+		SoftwareShadowMap shadowMap;
+
+		// Lab 03: triangles already in screen space
+		std::vector<Triangle> triangles;
+
+		// Lab 04: icospheres transformed directly into screen space
+		std::vector<TransformIcosphere> icospheres;
+		bool icosphereColors = true;
+
+		// Lab 05: spheres seen through the camera
+		std::vector<SceneObject> bodies;
+
+		// OBJ meshes seen through the camera, each drawn once per instance
+		std::vector<MeshEntry> meshes;
+
+		// Output of the last setup() call, ready for rasterize()
+		std::vector<Triangle> screenTriangles;
+		std::vector<RasterSetup> rasterSetups;
+		// Indices into screenTriangles that cover rows in each band, in drawing order
+		std::vector<std::vector<uint32_t>> bandTriangles;
+
+		// How many of screenTriangles take each raster path, indexed by RasterPath
+		std::array<size_t, RasterPath::_size()> pathCounts = {};
+
+		// Per-pixel shading: world-space triangles binned into square tiles of a shadingResolution
+		// image, and the G-buffer deferred shading rasterizes them into
+		std::vector<ShadingTriangle> shadingTriangles;
+		std::vector<std::vector<uint32_t>> tileTriangles;
+		ivec2 shadingResolution = ivec2(0);
+		SoftwareGBuffer gbuffer;
+		int tileSize = 32;
+
+		// Shadow casters in the shadow map's space, binned into tiles of the map
+		std::vector<ShadowTriangle> shadowTriangles;
+		std::vector<std::vector<uint32_t>> shadowTileTriangles;
+		int shadowTileSize = 64;
+
+		// Timings of the last render() call, in seconds. Only deferred shading has a separate
+		// lighting pass, forward shading lights while it rasterizes.
+		double setupTime = 0.;
+		double shadowTime = 0.;
+		double rasterTime = 0.;
+		double shadeTime = 0.;
+
+		// Rows per band handed to each rasterizer thread
+		int bandHeight = 16;
+
+		bool load(const std::string & filename);
+
+		// Adds count icospheres scattered over the screen like Lab 04's "Load 10 icospheres", but from
+		// a fixed seed so the same scene is generated on every machine and every run.
+		void generateIcospheres(int count, unsigned int seed, vec2 scaleRange);
+
+		// Vertex stage: projects every object in the scene into screenTriangles, picks the raster path
+		// for each of them and sorts them into bands
+		void setup(int width, int height);
+
+		// Raster stage: draws screenTriangles into float pixels with depth in the last channel (the
+		// same layout the labs use). The image is split into horizontal bands that numThreads threads
+		// draw independently, so no two threads ever touch the same pixel. Micro triangles are batched,
+		// everything else goes through renderTriangleBoundingBox.
+		void rasterize(float * pixels, int stride, int width, int height, int numThreads = 1);
+
+		void clear(float * pixels, int stride, int width, int height);
+
+		// Per-pixel vertex stage: fills shadingTriangles and sorts them into tiles. With shadows on,
+		// also gathers every shadow caster.
+		void setupShading(int width, int height);
+
+		// Fits the shadow map around the casters, then moves them into its space and sorts them into
+		// its tiles
+		void setupShadows();
+
+		// Depth-only pass from the light into shadowMap, one job per tile of the map
+		void renderShadowMap(int numThreads = 1);
+
+		// Fills the G-buffer, then runs the lighting pass into pixels. Each tile is one job.
+		void rasterizeDeferred(int numThreads = 1);
+		void shadeDeferred(float * pixels, int stride, int numThreads = 1);
+
+		// Clears, rasterizes and lights each tile straight into pixels, one job per tile
+		void renderForward(float * pixels, int stride, int numThreads = 1);
+
+		// Number of triangles the last setup produced, whichever shading is used
+		size_t triangleCount() const;
+
+		// Clears, sets up and rasterizes a whole frame. Returns the frame time in seconds.
+		double render(TextureMemory & target, int numThreads = 1);
+
+	private:
+		// nullptr unless there is a shadow map to look up
+		const SoftwareShadowMap * getShadowMap() const;
+
+		mat4 getView() const;
+		mat4 getProjection(int width, int height) const;
+		const vec3 * getLightSource(const SceneObject & object) const;
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "globals.h"
+#include "Lighting.h"
+#include "MipChain.h"
+
+// Per-pixel shading for the CPU renderer. The vertex stage and the lighting follow
+// src/shaders/vertex.vert and src/shaders/fragment.frag so the results can be compared with the GPU.
+
+// An image for the CPU shading paths, sampled like the GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR textures
+// Project binds
+struct SoftwareTexture {
+	struct Level {
+		int width = 0;
+		int height = 0;
+
+		// RGBA in [0, 1], bottom row first like stbi_set_flip_vertically_on_load gives the GPU
+		std::vector<vec4> texels;
+	};
+
+	// The image and its mip chain, largest first
+	std::vector<Level> levels;
+
+	// Loads the image's MipChain (from the mip cache when it's there)
+	bool load(const std::string& filename, MipSettings settings = MipSettings());
+
+	// Bilinear lookup in the image itself
+	vec4 sample(vec2 uv) const;
+
+	// Trilinear lookup: lod 0 is the image, every step up halves it
+	vec4 sample(vec2 uv, float lod) const;
+
+	// The level of detail for a surface where one pixel covers uvArea of the texture's [0, 1] square
+	float getLod(float uvArea) const;
+};
+
+// The textures fragment.frag reads (inputTexture and normalTexture). Either can be missing.
+struct SoftwareMaterial {
+	s_ptr<SoftwareTexture> texture;
+	s_ptr<SoftwareTexture> normalTexture;
+};
+
+// What vertex.vert hands to the fragment shader, plus the window position
+struct ShadingVertex {
+	// x and y in pixels, z is depth in [0, 1]
+	vec3 screen = vec3(0.f);
+	// 1 / clip w, used for perspective-correct interpolation
+	float invW = 1.f;
+
+	// World space (fPos and fNormal)
+	vec3 position = vec3(0.f);
+	vec3 normal = vec3(0.f);
+
+	vec3 color = vec3(1.f);
+
+	// uv and the first two columns of TBN
+	vec2 uv = vec2(0.f);
+	vec3 tangent = vec3(0.f);
+	vec3 bitangent = vec3(0.f);
+};
+
+struct ShadingTriangle {
+	ShadingVertex vertices[3];
+
+	// Light sources and the screen-space lab primitives aren't lit, they keep their color
+	bool lit = true;
+
+	// Written to the PrimitiveData channel along with the triangle's index
+	int object = 0;
+
+	// Owned by the scene, nullptr when the triangle isn't textured
+	const SoftwareMaterial* material = nullptr;
+
+	// uv area one pixel of the triangle covers, which picks the textures' mip level. The GPU works
+	// it out per 2x2 quad; one value for the whole triangle ignores the perspective, which is close
+	// enough for the mostly small triangles of our meshes.
+	float uvPerPixel = 0.f;
+};
+
+// Moves a model-space vertex (position, normal, uv, tangent and bitangent) into world and window
+// space the way vertex.vert does. Returns false when the vertex is behind the camera.
+bool shadeVertex(ShadingVertex& result, const ShadingVertex& vertex, const mat4& model, const mat4& normalMatrix,
+	const mat4& viewProjection, int width, int height);
+
+// A vertex that is already in window space, like the Lab 03 and Lab 04 triangles
+ShadingVertex screenVertex(vec3 screen, vec3 color);
+
+// The surface fragment.frag lights, for the point of tri with perspective-correct weights w: the
+// color (object color times inputTexture) and the normal (from normalTexture through TBN when the
+// material has one)
+void shadeSurface(const ShadingTriangle& tri, vec3 w, vec3& position, vec3& albedo, vec3& normal);
+
+// fragment.frag's Blinn-Phong terms (ambient + diffuse + specular) for one surface point. Only the
+// fraction visibility of the diffuse and specular light reaches it, the ambient term always does.
+vec3 blinnPhong(const Lighting& light, vec3 normal, vec3 viewDirection, float visibility = 1.f);
+
+// CPU counterpart of a GBufferMode::Shadow attachment: depth seen from the directional light
+// through an orthographic view that covers the whole scene
+struct SoftwareShadowMap {
+	int resolution = 1024;
+
+	// Subtracted from a point's depth before it is compared, so surfaces don't shadow themselves
+	float bias = 0.003f;
+
+	// Lookups average (2 * pcfRadius + 1)^2 neighbouring depth tests
+	int pcfRadius = 1;
+
+	// World space to map space: x and y in [0, 1] across the map, z is depth in [0, 1]
+	mat4 lightViewProjection = mat4(1.f);
+
+	std::vector<float> depth;
+
+	// Aims the light's view at the box (boundsMin, boundsMax) and allocates the map
+	void fit(vec3 lightDirection, vec3 boundsMin, vec3 boundsMax);
+
+	// World-space position in map space, x and y in texels
+	vec3 project(vec3 position) const;
+
+	// Clears the texels in rect (x0, y0, x1, y1), ends exclusive
+	void clear(ivec4 rect);
+
+	// Fraction of the PCF samples around position that the light reaches, 1 when fully lit
+	float visibility(vec3 position) const;
+};
+
+// A shadow caster, already moved into map space
+struct ShadowTriangle {
+	vec3 vertices[3];
+};
+
+// Depth-only pass for the shadow map: no attributes, no perspective and no shading, just the
+// nearest depth of the listed triangles in each texel of rect
+void rasterizeShadowDepth(const std::vector<ShadowTriangle>& triangles, const std::vector<uint32_t>& indices,
+	SoftwareShadowMap& shadowMap, ivec4 rect);
+
+// CPU counterpart of a Framebuffer with the Color, Position, Normal, PrimitiveData and Depth
+// channels of GBufferMode. Rows are stored bottom first like the rest of the CPU labs.
+struct SoftwareGBuffer {
+	int width = 0;
+	int height = 0;
+
+	// Albedo in rgb, alpha is 1 for lit pixels and 0 for ones that keep their color
+	std::vector<vec4> color;
+	std::vector<vec3> position;
+	// Normalized, and already normal mapped
+	std::vector<vec3> normal;
+	// Object and triangle that covered each pixel, -1 where nothing was drawn
+	std::vector<ivec4> primitiveData;
+	std::vector<float> depth;
+
+	void resize(int w, int h);
+
+	// Clears the pixels in rect (x0, y0, x1, y1), ends exclusive
+	void clear(ivec4 rect);
+};
+
+// Depth tests and writes the triangles listed in indices into the G-buffer, only touching the
+// pixels inside rect. Samples are taken at whole pixel coordinates like renderTriangleBoundingBox,
+// a 2x2 quad at a time.
+void rasterizeGBuffer(const std::vector<ShadingTriangle>& triangles, const std::vector<uint32_t>& indices,
+	SoftwareGBuffer& gbuffer, ivec4 rect);
+
+// Lighting pass: shades every pixel in rect once, whatever the depth complexity was, and writes
+// the color with the depth in the last channel. Pixels nothing covered get clearColor. shadowMap
+// can be nullptr to light everything.
+void shadeGBuffer(const SoftwareGBuffer& gbuffer, const Lighting& light, const SoftwareShadowMap* shadowMap,
+	vec3 cameraPosition, vec4 clearColor, float* pixels, int stride, ivec4 rect);
+
+// Forward shading: clears rect, then rasterizes the listed triangles in 2x2 quads and lights every
+// fragment that passes the depth test right away, like the GPU runs fragment.frag
+void rasterizeForward(const std::vector<ShadingTriangle>& triangles, const std::vector<uint32_t>& indices,
+	const Lighting& light, const SoftwareShadowMap* shadowMap, vec3 cameraPosition, vec4 clearColor,
+	float* pixels, int stride, int width, ivec4 rect);
@@ -2,10 +2,26 @@
 
 #include "globals.h"
 
+#include "BlockCompression.h"
+#include "MemoryPool.h"
+#include "MipChain.h"
+
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <future>
+#include <type_traits>
+
 class Framebuffer;
+class TextureFile;
+
+// How images of a role are stored on the GPU:
+//   Compressed: block compressed (see MipSettings::compress), or Compact where the driver can't
+//     sample the block formats
+//   Compact: the smallest format that holds the role: sRGB RGBA8 for albedo, RG8 for normal maps
+//     (the shader rebuilds z), R8 or R16 (for 16-bit files) for height and displacement maps
+//   Full: 8 bits per channel as the file has them, and 32-bit floats for single-channel images
+MAKE_ENUM(TextureStorage, int, Compressed, Compact, Full);
 
 struct TextureDescription
 {
@@ -21,7 +37,22 @@ struct TextureDescription
 		: internalFormat(_if), pixelDataFormat(pdf), pixelDataType(pdt), stride(s) { }
 };
 
-// Internal storage for texture-backed framebuffers
+// count texels of stride components each, one after the other, pointing into a TextureMemory
+template<typename T>
+struct TexelSpan
+{
+	const T* data = nullptr;
+	size_t count = 0;
+	GLuint stride = 0;
+
+	bool empty() const { return count == 0; }
+
+	// The components of texel i
+	const T* operator[](size_t i) const { return data + i * stride; }
+};
+
+// Internal storage for texture-backed framebuffers. The buffer comes from the MemoryPool, so
+// framebuffers that are resized or recreated reuse the memory of the last one.
 class TextureMemory
 {
 	public:
@@ -34,6 +65,9 @@ class TextureMemory
 		size_t size = 0;
 		size_t typeSize = 0;
 
+		// Bytes the pool actually handed out, at least size
+		size_t capacity = 0;
+
 		TextureMemory() { }
 		TextureMemory(GLenum t, GLuint w, GLuint h, GLuint s = 1) : type(t), width(w), height(h), stride(s)
 		{
@@ -53,7 +87,7 @@ class TextureMemory
 
 			if (size > 0)
 			{
-				value = malloc(size);
+				value = MemoryPool::get().acquire(size, capacity);
 			}
 		}
 
@@ -61,11 +95,14 @@ class TextureMemory
 		{
 			if (value)
 			{
-				free(value);
+				MemoryPool::get().release(value, capacity);
 				value = nullptr;
 			}
 		}
 
+		TextureMemory(const TextureMemory&) = delete;
+		TextureMemory& operator=(const TextureMemory&) = delete;
+
 		bool read(GLvoid* result, int x, int y, size_t length)
 		{
 			if (x < 0 || y < 0 || x >= width || y >= height) return false;
@@ -83,20 +120,86 @@ class TextureMemory
 
 			return true;
 		}
+
+		// Whether the components are Ts: GLfloat for GL_FLOAT (colors, positions, normals and
+		// depth) and GLint for GL_INT (primitive data)
+		template<typename T>
+		bool holds() const
+		{
+			return value && ((type == GL_FLOAT && std::is_same<T, GLfloat>::value) ||
+				(type == GL_INT && std::is_same<T, GLint>::value));
+		}
+
+		// Up to count texels of row y from x on, without copying them. Empty when the memory
+		// doesn't hold Ts or (x, y) is outside it.
+		template<typename T>
+		TexelSpan<T> row(int x, int y, int count) const
+		{
+			TexelSpan<T> span;
+			if (!holds<T>() || x < 0 || y < 0 || x >= (int)width || y >= (int)height || count <= 0) return span;
+
+			span.data = (const T*)value + ((size_t)y * width + x) * stride;
+			span.count = (size_t)glm::min(count, (int)width - x);
+			span.stride = stride;
+			return span;
+		}
+
+		// Copies rect (x, y, width, height) into result, rows from the bottom like the memory.
+		// Returns false when the memory doesn't hold Ts or the rect isn't all inside it.
+		template<typename T>
+		bool readRect(ivec4 rect, std::vector<T>& result) const
+		{
+			if (!holds<T>() || !contains(rect)) return false;
+
+			size_t rowLength = (size_t)rect.z * stride;
+			result.resize(rowLength * rect.w);
+
+			for (int y = 0; y < rect.w; y++) {
+				memcpy(result.data() + y * rowLength, row<T>(rect.x, rect.y + y, rect.z).data, rowLength * sizeof(T));
+			}
+
+			return true;
+		}
+
+		// Copies the texels at points into result, stride components each, and returns how many
+		// were inside. Points outside read as zeros.
+		template<typename T>
+		size_t readPoints(const std::vector<ivec2>& points, std::vector<T>& result) const
+		{
+			result.assign(points.size() * stride, T(0));
+			if (!holds<T>()) return 0;
+
+			size_t inside = 0;
+			for (size_t i = 0; i < points.size(); i++) {
+				ivec2 p = points[i];
+				if (p.x < 0 || p.y < 0 || p.x >= (int)width || p.y >= (int)height) continue;
+
+				memcpy(result.data() + i * stride, (const T*)value + ((size_t)p.y * width + p.x) * stride, stride * sizeof(T));
+				inside++;
+			}
+
+			return inside;
+		}
+
+		// The same as vec4s whatever the type: integers convert to floats, and channels the memory
+		// doesn't have read as 0 (alpha as 1)
+		bool readColors(ivec4 rect, std::vector<vec4>& result) const;
+		size_t readColors(const std::vector<ivec2>& points, std::vector<vec4>& result) const;
+
+		bool contains(ivec4 rect) const
+		{
+			return rect.x >= 0 && rect.y >= 0 && rect.z > 0 && rect.w > 0 && rect.x + rect.z <= (int)width &&
+				rect.y + rect.w <= (int)height;
+		}
 };
 
 MAKE_ENUM(TextureWrapMode, GLenum, Repeat = GL_REPEAT, ClampToEdge = GL_CLAMP_TO_EDGE, ClampToBorder = GL_CLAMP_TO_BORDER);
 MAKE_ENUM(TextureFilterMode, GLenum,  Nearest = GL_NEAREST, Linear = GL_LINEAR, NearestMipMap = GL_LINEAR_MIPMAP_NEAREST,
     LinearMipMap = GL_LINEAR_MIPMAP_LINEAR);
 
-class Texture {
+// Every Texture adds itself to the TextureRegistry, which tracks their memory
+class Texture : public std::enable_shared_from_this<Texture> {
     public:
-		// A registry of all textures allocated through this class. Useful for tracking things like memory usage.
-		/*
-		static std::map<GLuint, s_ptr<Texture>>& registry() {
-			return _registry;
-		}
-		*/
 
         // The OpenGL texture name
         GLuint id = 0;
@@ -110,6 +213,36 @@ class Texture {
         GLenum format = GL_RGBA;
         GLenum pixelDataType = GL_UNSIGNED_BYTE;
 
+        // Mip levels that come from the CPU (see MipChain). 1 leaves them to glGenerateMipmap.
+        int mipLevels = 1;
+
+        // Block compressed images are uploaded as they are and stay compressed on the GPU
+        BlockFormat compression = BlockFormat::None;
+
+        // 2 for 16-bit images
+        int bytesPerChannel = 1;
+
+        // What storagePolicy picked for the image
+        TextureStorage storage = TextureStorage::Full;
+
+        // The internal format is sRGB, so sampling returns linear colors
+        bool srgb = false;
+
+        // How the image file's mip chain is built, kept to reload it
+        MipSettings settings;
+
+        // Largest levels of the image left off the GPU to stay within the TextureRegistry's budget.
+        // resolution and mipLevels are those of what is on the GPU.
+        int droppedLevels = 0;
+
+        // TextureRegistry::frame when the texture was last bound, 0 if it never was. Textures are
+        // only stamped where they are bound through touch(), so ones that never were aren't
+        // known to be idle and keep their levels.
+        unsigned long lastUsed = 0;
+
+        // glGenerateMipmap made the levels below the first
+        bool generatedMips = false;
+
         // Number of channels in each pixel. 3 would be RGB, 4 would be RGBA. 
         unsigned int numChannels = 3;
 
@@ -135,19 +268,82 @@ class Texture {
 		// Memory allocation for this texture (if needed for copying to CPU memory, etc.)
 		s_ptr<TextureMemory> memory;
 
+		// Resolves once the image is on the GPU (true) or failed to load (false). Textures that are
+		// loaded right away or belong to a framebuffer are ready from the start.
+		std::shared_future<bool> ready;
+
 		//static s_ptr<Texture> createTexture(const std::string& filename);
 
-        Texture(const std::string & fname);
+		// Loads the image right away, or with loadNow false only creates the texture with a 1x1
+		// white placeholder image and leaves the rest to TextureLoader
+        Texture(const std::string & fname, bool loadNow = true);
 		Texture(Framebuffer* fb, GBufferMode _usage, GLenum _attachment);
         ~Texture();
 
+		// For framebuffer textures: (re)allocates the image and its TextureMemory at the
+		// framebuffer's resolution, keeping the texture name and its attachment
+		void resizeStorage();
+
         void renderUI();
 
+		// Copies the texture to memory, waiting for the GPU to finish everything before it
 		void copyToMemory();
 
+		// Copies rect (x, y, width, height; all of it if the size is 0) to the same place in memory
+		// without waiting, see TextureReadback. The future resolves once the pixels are there.
+		std::shared_future<bool> copyToMemoryAsync(ivec4 rect = ivec4(0));
+
+		// Reads memory, so it's as recent as the last copy. See TextureMemory::readColors.
 		vec4 getColor(ivec2 pos);
 
+		// Reads a rect (x, y, width, height) or a list of points of memory at once, without the
+		// checks and copies getColor makes for every texel. For the components as they are, use
+		// memory's row, readRect and readPoints.
+		bool getColors(ivec4 rect, std::vector<vec4>& result);
+		size_t getColors(const std::vector<ivec2>& points, std::vector<vec4>& result);
+
+		bool isReady() const;
+
+		// Marks the texture as bound this frame, so it keeps (or gets back) its largest levels
+		void touch();
+
+		// Bytes of GPU memory the texture takes, all mip levels included. Formats are counted at
+		// the size drivers store them: 3-component 8-bit formats are padded to 4 bytes and 24-bit
+		// depth takes 32.
+		size_t memorySize() const;
+
+		// What memorySize() would be with Full storage, to show what the storage policy saves
+		size_t fullSize() const;
+
+		static size_t bytesPerTexel(GLenum internalFormat);
+
+		// Whether the GL driver takes all of BlockCompression's formats. Textures are only
+		// compressed when it does.
+		static bool compressionSupported();
+
+		// Replaces the image in steps, so a large one can be spread over several frames: beginUpload
+		// allocates storage for levels mip levels, uploadRows fills rows [firstRow, firstRow +
+		// numRows) of a level from an 8-bit image of that level's size, and finishUpload makes all
+		// levels visible. With a single level, glGenerateMipmap makes the others.
+		//
+		// With compression the images hold blocks of that format, and firstRow and numRows have to
+		// be multiples of 4 except where they end at the bottom of the level.
+		//
+		// Until finishUpload only the smallest level is sampled. Uploading the levels smallest first
+		// and calling setBaseLevel after each one sharpens the texture as the levels arrive.
+		void beginUpload(uvec2 size, unsigned int channels, int levels = 1, BlockFormat compressed = BlockFormat::None,
+			int bytesPerChannel = 1);
+		void uploadRows(const unsigned char* pixels, GLuint firstRow, GLuint numRows, int level = 0);
+		void setBaseLevel(int level);
+		void finishUpload();
+
+		// Replaces the image with a texture file's levels in one go, straight from its mapping
+		void upload(const TextureFile& file);
+
 	//private:
+		// Picks the GL formats for an image (see storagePolicy) and sets the sampling parameters
+		void setFormat(uvec2 size, unsigned int channels, int levels, BlockFormat compressed, int bytesPerChannel);
+
 		// Standard texture formats and allocations to use for different attachments
 		static TextureDescription rgbaTextureDescription;
 		static TextureDescription vec3TextureDescription;
@@ -157,5 +353,11 @@ class Texture {
 		
 		static std::map<GBufferMode, TextureDescription> textureDescriptions;
 
-		//static std::map<GLuint, s_ptr<Texture>> _registry;
+		// Storage by role for images loaded from files. Changes apply to textures loaded (or
+		// reloaded) afterwards.
+		static std::map<TextureRole, TextureStorage> storagePolicy;
+
+		// The settings to load an image file with: its role guessed from the name and compression
+		// as storagePolicy has it for that role
+		static MipSettings getSettings(const std::string& filename);
 };
\ No newline at end of file
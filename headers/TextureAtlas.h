@@ -0,0 +1,61 @@
+#pragma once
+
+#include "globals.h"
+
+#include <GL/glew.h>
+
+// Color textures gathered into the layers of one GL_TEXTURE_2D_ARRAY, so objects with different
+// textures are drawn with the same texture bound and only a uniform (the entry's rect and layer)
+// changing between them.
+//
+// When every image has the same size each one gets a layer of its own, with all of its mip levels.
+// Otherwise the images are packed into layers of layerSize x layerSize with stb_rect_pack, each
+// surrounded by padding texels of its own image wrapped around, so filtering and the smaller mip
+// levels don't reach into the neighbours. Images start on multiples of padding texels, which keeps
+// them aligned in the first log2(padding) + 1 mip levels; packed layers have only those levels.
+//
+// Images repeat within their rect: the shader takes fract() of the UVs before mapping them into
+// the rect, and samples with the original UV derivatives so the wrap doesn't pick a tiny mip level.
+class TextureAtlas
+{
+public:
+	struct Entry {
+		std::string filename;
+		ivec2 size = ivec2(0);
+		int layer = 0;
+		// Where the image is in its layer, in UVs: origin in xy and size in zw
+		vec4 rect = vec4(0, 0, 1, 1);
+	};
+
+	// Texels around every packed image
+	static const int padding = 8;
+
+	// Width and height of the layers images are packed into
+	int layerSize = 2048;
+
+	// The GL_TEXTURE_2D_ARRAY, 0 until built
+	GLuint id = 0;
+	ivec2 resolution = ivec2(0);
+	int layers = 0;
+	int mipLevels = 0;
+
+	std::vector<Entry> entries;
+
+	TextureAtlas() = default;
+	~TextureAtlas();
+
+	TextureAtlas(const TextureAtlas&) = delete;
+	TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+	// Loads the images (through the mip cache, on the JobSystem's threads) and replaces the atlas
+	// with them. Logs and returns false, leaving the atlas empty, when an image can't be read or is
+	// too large for a layer.
+	bool build(const std::vector<std::string>& filenames);
+	void clear();
+
+	// Index of the entry for a file, or -1
+	int find(const std::string& filename) const;
+
+	// Bytes of GPU memory, all layers and mip levels included
+	size_t memorySize() const;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "globals.h"
+
+#include "BlockCompression.h"
+
+struct MipChain;
+
+// A texture stored ready for upload: a small header, a table of levels and then every mip level
+// (block compressed or not) exactly as glTexImage2D / glCompressedTexImage2D take it, each starting
+// on a 16-byte boundary. Files are memory mapped rather than read, so opening one costs little more
+// than the page faults of the levels that are used.
+//
+// Layout, little endian:
+//   "TEXF", uint32 version
+//   int32 width, height, channels, format (BlockFormat), number of levels, bytes per channel
+//   uint32 length of the source string, the source string
+//   per level: uint64 offset from the start of the file, uint64 size in bytes
+//   the levels, largest first
+//
+// The source string says what the file was made from; the mip cache keeps the image's path, size
+// and modification time in it to tell stale files apart.
+class TextureFile
+{
+public:
+	struct Level {
+		int width = 0;
+		int height = 0;
+		const unsigned char* data = nullptr;
+		size_t size = 0;
+	};
+
+	// The extension of texture files. Texture, TextureLoader and MipChain::load take these files
+	// wherever they take images.
+	static const char* extension;
+
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	// 1, or 2 for 16-bit height maps
+	int bytesPerChannel = 1;
+	BlockFormat format = BlockFormat::None;
+	std::string source;
+
+	// Point into the mapped file, so they're valid until close()
+	std::vector<Level> levels;
+
+	TextureFile() = default;
+	~TextureFile();
+
+	TextureFile(const TextureFile&) = delete;
+	TextureFile& operator=(const TextureFile&) = delete;
+
+	// Maps the file and checks its header and level table. Logs (or, given error, fills it in) and
+	// returns false for files that aren't texture files or are cut short.
+	bool open(const std::string& filename, std::string* error = nullptr);
+	void close();
+
+	// Whether a file name has the texture file extension
+	static bool isTextureFile(const std::string& filename);
+
+	// Writes a mip chain. The file is written under a temporary name and renamed once complete, so
+	// readers never map half a file.
+	static bool write(const std::string& filename, const MipChain& chain, const std::string& source = "",
+		std::string* error = nullptr);
+
+private:
+	const unsigned char* mapping = nullptr;
+	size_t mappingSize = 0;
+
+#if defined(_WIN32)
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+
+	bool map(const std::string& filename);
+	bool parse(const std::string& filename, std::string* error);
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "globals.h"
+
+#include "JobSystem.h"
+#include "MipChain.h"
+#include "TextureFile.h"
+
+#include <deque>
+#include <future>
+#include <mutex>
+
+class Texture;
+
+// Loads image files into Textures without stalling the frame. Images are decoded and their mip
+// chains built (or read from the mip cache) on the JobSystem's threads, several at a time, and
+// update() uploads the finished ones on the GL thread a strip of rows at a time, stopping once the
+// frame's budget is used up. Chains from texture files are uploaded straight from the mapped file.
+class TextureLoader
+{
+public:
+	static TextureLoader& get();
+
+	// Time update() may spend uploading each frame
+	double uploadBudget = 0.004;
+
+	// Rows are uploaded in strips of about this many bytes, so the budget is checked often enough
+	size_t stripSize = 256 * 1024;
+
+	// Returns the texture right away. It has its GL name and a 1x1 placeholder image, so it can be
+	// bound straight away; its ready future resolves once the image has replaced the placeholder.
+	s_ptr<Texture> load(const std::string& filename);
+	s_ptr<Texture> load(const std::string& filename, MipSettings settings);
+
+	// Loads a texture's image file again (with its settings) into the same texture, leaving out the
+	// largest droppedLevels levels. The texture keeps showing its current image until the new one
+	// starts arriving.
+	void reload(s_ptr<Texture> texture, int droppedLevels);
+
+	// Uploads decoded images for up to uploadBudget seconds (at least one strip). Call once a frame
+	// on the thread that owns the GL context.
+	void update();
+
+	// Textures that are still decoding or uploading
+	size_t pending() const;
+
+private:
+	struct Request {
+		s_ptr<Texture> texture;
+		MipSettings settings;
+		MipChain chain;
+		bool decoded = false;
+
+		// Chains read from texture files (the mip cache's included) stay in the mapping, and are
+		// uploaded from there instead of from chain, which is then empty
+		TextureFile file;
+
+		int numLevels() const;
+		TextureFile::Level getLevel(int l) const;
+
+		// Why decoding failed, or what else went wrong, for update() to log: the console can't be
+		// written from the JobSystem's threads
+		std::string error;
+
+		// Levels of the chain left out
+		int firstLevel = 0;
+
+		// Levels already on the GPU (the smallest ones) and the rows of the next one
+		int level = 0;
+		int uploadedRows = 0;
+
+		std::promise<bool> promise;
+	};
+
+	TextureLoader() = default;
+
+	void start(s_ptr<Request> request);
+
+	// Decoded (or failed) requests, in the order they finished
+	std::deque<s_ptr<Request>> decoded;
+	mutable std::mutex mutex;
+
+	size_t numPending = 0;
+
+	JobSystem::TaskGroup decodes;
+};
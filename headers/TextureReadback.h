@@ -0,0 +1,78 @@
+#pragma once
+
+#include "globals.h"
+
+#include <GL/glew.h>
+
+#include <deque>
+#include <future>
+
+class Texture;
+class TextureMemory;
+
+// Reads textures back into their TextureMemory without stalling the pipeline. Each read goes into
+// one of a ring of pixel pack buffers, followed by a fence; update() copies the pixels out once the
+// GPU has passed the fence, usually a frame or two later, and resolves the read's future. Reads that
+// find every buffer of the ring busy wait in a queue for the next free one, so even a read every
+// frame (picking, capture) never waits on the GPU.
+//
+// Without fences (GL 3.2 or ARB_sync) reads fall back to Texture::copyToMemory and resolve at once.
+class TextureReadback
+{
+public:
+	static TextureReadback& get();
+
+	// Buffers in the ring: reads the GPU can have in flight at once
+	int ringSize = 4;
+
+	// Frames between issuing a read and its pixels arriving, averaged over recent reads
+	double averageLatency = 0.0;
+
+	// Starts reading rect (x, y, width, height; all of it if the size is 0) of the texture's first
+	// level into the same place of its memory, or of destination, which needs the memory's size,
+	// type and stride. The future resolves to false when the texture has no memory, the rect is
+	// outside it, or the texture is gone before its turn comes.
+	std::shared_future<bool> read(s_ptr<Texture> texture, ivec4 rect = ivec4(0), s_ptr<TextureMemory> destination = nullptr);
+
+	// Finishes the reads the GPU is done with and issues queued ones. Call once a frame on the
+	// thread that owns the GL context.
+	void update();
+
+	// Reads issued or queued and not finished yet
+	size_t pending() const;
+
+	static bool supported();
+
+private:
+	struct Request {
+		w_ptr<Texture> texture;
+		ivec4 rect = ivec4(0);
+		unsigned long frame = 0;
+		std::promise<bool> promise;
+
+		// Set when issued, unless the read has a destination of its own. The memory is held on to,
+		// so a texture resized in the meantime can't pull it away.
+		s_ptr<TextureMemory> memory;
+
+		// Textures that aren't framebuffer attachments are read whole (glGetTexImage) and the rect
+		// copied out of that
+		bool wholeImage = false;
+	};
+
+	struct Slot {
+		GLuint buffer = 0;
+		size_t capacity = 0;
+		GLsync fence = nullptr;
+		s_ptr<Request> request;
+	};
+
+	TextureReadback() = default;
+
+	bool issue(Slot& slot, s_ptr<Request> request);
+	void finish(Slot& slot);
+
+	std::vector<Slot> slots;
+	std::deque<s_ptr<Request>> queued;
+
+	unsigned long frame = 0;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "globals.h"
+
+class Texture;
+
+// Every Texture there is, framebuffer attachments included, and the GPU memory they take.
+//
+// Textures loaded from files are held to a budget. When they go over it, the ones that haven't been
+// bound for a while (see Texture::touch) give up their largest mip level, least recently bound first, which frees about
+// three quarters of their memory at a time. A texture that is bound again gets its levels back.
+// Levels are reloaded through TextureLoader from the mip cache, so neither step stalls a frame.
+class TextureRegistry
+{
+public:
+	static TextureRegistry& get();
+
+	// Bytes the textures loaded from files may take. 0 turns the budget off.
+	size_t budget = 512 * 1024 * 1024;
+
+	// Frames a texture has to go unbound before it can lose levels
+	unsigned long idleFrames = 300;
+
+	// Levels a texture may lose at most
+	int maxDroppedLevels = 4;
+
+	// Incremented by update(). Texture::touch() stamps textures with it. Starts at 1, as 0 is
+	// Texture::lastUsed for textures that were never bound.
+	unsigned long frame = 1;
+
+	void add(Texture* texture);
+	void remove(Texture* texture);
+
+	// Drops and restores levels. Call once a frame on the thread that owns the GL context.
+	void update();
+
+	// GPU memory of the textures loaded from files and of the framebuffer attachments
+	size_t imageBytes() const;
+	size_t framebufferBytes() const;
+
+	// Totals and the budget, for the Stats panel
+	void renderUI();
+
+private:
+	TextureRegistry() = default;
+
+	std::vector<Texture*> textures;
+};
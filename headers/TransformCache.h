@@ -0,0 +1,33 @@
+#pragma once
+
+#include "globals.h"
+
+struct SceneObject;
+
+// The world and normal matrices of a list of SceneObjects, kept between frames and recomputed only
+// for objects whose Transform2D is dirty (edited in its UI). The dirty transforms are packed into
+// arrays of translations, rotations (as quaternions) and scales, and turned into matrices 4 at a
+// time with SSE2, on the JobSystem's threads when there are many.
+//
+// The matrices are Transform2D::getMatrixGLM's translate * rotate * scale. The upper 3x3 of such a
+// matrix is R * S, so the normal matrix, its inverse transpose, is R * S^-1: the rotation's columns
+// divided by the scales, with no general inverse needed.
+class TransformCache
+{
+public:
+	std::vector<mat4> world;
+	std::vector<mat3> normal;
+
+	// Matrices recomputed by the last update
+	size_t updated = 0;
+
+	// Recomputes the matrices of the objects with dirty transforms, and clears their flags. Objects
+	// past the end of the cache (added since the last update) are always computed.
+	void update(std::vector<SceneObject>& objects);
+
+	// Recomputes everything on the next update, for when objects are removed or reordered
+	void invalidate() { world.clear(); normal.clear(); }
+
+private:
+	std::vector<int> dirty;
+};
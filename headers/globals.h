@@ -634,6 +634,19 @@ void log(const char* arg0, const Args & ... args)
 	logString(s);
 }
 
+// Like log(), but when error isn't null the message goes there instead, for the caller to log. Code
+// that can run on the JobSystem's threads reports this way, since the console isn't thread safe.
+template<typename ... Args>
+void report(std::string* error, const char* arg0, const Args & ... args)
+{
+	if (error) {
+		*error = fmt::format(arg0, args...);
+	}
+	else {
+		log(arg0, args...);
+	}
+}
+
 #define MAKE_ENUM(EnumName, UnderlyingType, ...)								\
 	BETTER_ENUM(EnumName, UnderlyingType, __VA_ARGS__);							\
 	inline void to_json(json& j, const EnumName & val) {						\
@@ -1,8 +1,13 @@
 #include "Application.h"
 
+#include "FrameRecorder.h"
 #include "Input.h"
+#include "MemoryPool.h"
 #include "Prompts.h"
 #include "Renderer.h"
+#include "TextureLoader.h"
+#include "TextureReadback.h"
+#include "TextureRegistry.h"
 
 #include "Tool.h"
 #include "UIHelpers.h"
@@ -104,6 +109,13 @@ void Application::update()
 		commands.clear();
 	}
 
+	// Finish uploading textures that were decoded in the background, keep texture memory within
+	// its budget, collect the readbacks the GPU has finished and capture the last frame if recording
+	TextureLoader::get().update();
+	TextureRegistry::get().update();
+	TextureReadback::get().update();
+	FrameRecorder::get().update();
+
 	// Handle tool updates and possibly consume input events
 
 	auto events = input.getEvents();
@@ -173,6 +185,17 @@ void Application::renderUI()
 
 		ImGui::InputDouble("Target FPS", &targetFPS);
 		ImGui::InputDouble("Sleep time (ms)", &sleepTime);
+
+		TextureRegistry::get().renderUI();
+
+		MemoryPool::Stats pool = MemoryPool::get().getStats();
+		ImGui::Text("Memory pool: %zu hits, %zu misses, %.2f MB in use, %.2f MB pooled", pool.hits, pool.misses,
+			pool.usedBytes / (1024.0 * 1024.0), pool.pooledBytes / (1024.0 * 1024.0));
+
+		ImGui::Text("Texture readbacks in flight: %zu, %.1f frames on average", TextureReadback::get().pending(),
+			TextureReadback::get().averageLatency);
+
+		FrameRecorder::get().renderUI();
 	}
 
 	Input::get().renderUI();
@@ -50,23 +50,7 @@ void Lab04::render(s_ptr<Texture> screen) {
 
 		mat4 M = icoTf.transform.getMatrix();
 
-		vec2 zRange = vec2(0.0f);
-
-		for (auto& pos : ico.positions) {
-			vec4 p(pos.x, pos.y, pos.z, 1);
-			p = M * p;
-			pos = vec3(p);
-
-			zRange.x = glm::min(zRange.x, pos.z);
-			zRange.y = glm::max(zRange.y, pos.z);
-		}
-
-		// Renormalize the z-values so that they are all between 0 (closest, minimum depth) and 1 (farthest, maximum depth)
-		float zDist = zRange.y - zRange.x - 1e-4f;
-
-		for (auto& pos : ico.positions) {
-			pos.z = 1e-4f + (pos.z - zRange.x) / zDist;
-		}
+		transformIcosphere(ico, M);
 
 		static bool useColors = true;
 		static double lastChanged = 0;
@@ -53,45 +53,6 @@ float cameraFOVY = 60.0f;
 vec2 nearFar(1, 1000);
 
 
-vec3 WorldToScreen(vec3 world, mat4 modelview, mat4 projection, int viewportWidth, int viewportHeight)
-{
-	vec3 projected = glm::project(world, modelview, projection, vec4(0, 0, viewportWidth, viewportHeight));
-	return projected;
-}
-
-
-void renderSphere(mat4 model, mat4 view, mat4 projection, vec3 color, float* pixels, int stride, int width, int height, vec3 * lightSource = nullptr) {
-	mat4 mvp = projection * view * model;
-
-	for (auto& triangleIndices : Sphere::instance.indices) {
-		Triangle tri;
-
-		for (int i = 0; i < 3; i++) {
-			vec3 p = Sphere::instance.positions[triangleIndices[i]];
-			tri.vertices[i].position = p;
-			if (lightSource == nullptr) {
-				tri.vertices[i].color = color;
-				tri.vertices[i].position = WorldToScreen(p, view * model, projection, width, height);
-			}
-		}
-
-		if (lightSource) {
-			vec3 N = glm::normalize(tri.normal());
-
-			N = model * vec4(N, 0);
-
-			for (int i = 0; i < 3; i++) {
-				vec3 p = model * vec4(tri.vertices[i].position, 1);
-				vec3 L = glm::normalize(p - *lightSource);
-				tri.vertices[i].color = color * glm::dot(N, L);
-				tri.vertices[i].position = WorldToScreen(tri.vertices[i].position, view * model, projection, width, height);
-			}
-		}
-		
-		renderTriangleBoundingBox(tri, pixels, stride, width, height);
-	}
-}
-
 vec3* getLightSource(const CelestialBody & body) {
 	if (body.lightSource) {
 		return nullptr;
@@ -3,8 +3,12 @@
 #include "Application.h"
 #include "Camera.h"
 #include "Framebuffer.h"
+#include "Frustum.h"
+#include "GLState.h"
 #include "GPU.h"
+#include "ImageIO.h"
 #include "Input.h"
+#include "JobSystem.h"
 #include "Primitives.h"
 #include "Renderer.h"
 #include "StringUtil.h"
@@ -15,7 +19,6 @@
 #include "ImGuiFileDialog.h"
 #include "OBJMesh.h"
 #include "imgui.h"
-#include <stb/stb_image.h>
 
 /**
  * ----------------------------------------------------------------------------
@@ -50,6 +53,23 @@ std::vector<OBJMesh> meshes;
 int activeMeshIndex = 0;
 int parallaxLayers = 10;
 
+// 64-bit sort key of a draw: the shader in the top 8 bits, then 16 of material
+// (the atlas entry), 16 of mesh and 24 of depth (0 at the camera, 1 at the far
+// plane)
+static uint64_t drawKey(GLuint program, int material, int mesh, float depth) {
+  uint64_t depthBits = (uint64_t)(glm::clamp(depth, 0.0f, 1.0f) * 0xFFFFFF);
+  return (uint64_t)(program & 0xFF) << 56 |
+         (uint64_t)(material & 0xFFFF) << 40 |
+         (uint64_t)(mesh & 0xFFFF) << 24 | depthBits;
+}
+
+// The mesh an object draws: its own, or the active one
+static int meshOf(const SceneObject &object) {
+  return object.mesh >= 0 && object.mesh < (int)meshes.size()
+             ? object.mesh
+             : activeMeshIndex;
+}
+
 int windowWidth = 0;
 int windowHeight = 0;
 
@@ -61,6 +81,9 @@ bool validNormalTexture = false;
 bool useParallaxTexture = false;
 bool useDisplacementMap = false;
 bool useWireframe = false;
+bool useAtlas = false;
+bool useInstancing = true;
+bool useCulling = true;
 
 /**
  * ----------------------------------------------------------------------------
@@ -132,9 +155,9 @@ void Project::init() {
     }
   }
 
-  // Default sphere mesh
-  OBJMesh sphereMesh = OBJMesh::getSphere(shader.program);
-  meshes.push_back(sphereMesh);
+  // Every mesh goes into the arena, the default sphere first
+  arena.init(shader);
+  addMesh(OBJMesh::makeSphere());
 
   if (useCubemapping) {
     if (!cubemapShader.init(cubemapVertexShaderSrc, cubemapFragmentShaderSrc)) {
@@ -179,20 +202,27 @@ void Project::init() {
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
+    // The six faces decode in parallel, only the uploads have to happen here.
+    // Cube map faces are stored top row first.
+    // Failures are logged here, since the console can't be written from the
+    // job threads.
+    ImageIO::DecodedImage faces[6];
+    std::string errors[6];
+    JobSystem::get().parallelFor(0, 6, 1, [&](int begin, int end) {
+      for (int i = begin; i < end; i++) {
+        ImageIO::decodeImage(facesCubemap[i], faces[i], 3, false, false,
+                             &errors[i]);
+      }
+    });
+
     for (unsigned int i = 0; i < 6; i++) {
-      int width, height, nrChannels;
-      unsigned char *data =
-          stbi_load(facesCubemap[i].c_str(), &width, &height, &nrChannels, 0);
-
-      if (data) {
-        stbi_set_flip_vertically_on_load(false);
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width,
-                     height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        stbi_image_free(data);
+      if (!faces[i].pixels.empty()) {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB,
+                     faces[i].width, faces[i].height, 0, GL_RGB,
+                     GL_UNSIGNED_BYTE, faces[i].pixels.data());
       } else {
-        log("Failed to load cubemap texture: {0}\n", facesCubemap[i]);
-        stbi_image_free(data);
-        log("Reason: {0}\n", stbi_failure_reason());
+        log("{0}Failed to load cubemap texture: {1}\n", errors[i],
+            facesCubemap[i]);
       }
     }
   }
@@ -203,10 +233,44 @@ void Project::init() {
     camera.useCubemapCamera = false;
   }
 
+  findUniforms();
+
   addSceneObject();
   initialized = true;
 }
 
+void Project::findUniforms() {
+  uniforms.useTexture = shader.uniform("useTexture");
+  uniforms.srgbTexture = shader.uniform("srgbTexture");
+  uniforms.atlasTexture = shader.uniform("atlasTexture");
+
+  uniforms.normalTexture = shader.uniform("normalTexture");
+  uniforms.validNormalTexture = shader.uniform("validNormalTexture");
+  uniforms.useNormalTexture = shader.uniform("useNormalTexture");
+
+  uniforms.heightmapTexture = shader.uniform("heightmapTexture");
+  uniforms.useParallaxTexture = shader.uniform("useParallaxTexture");
+  uniforms.parallaxLayers = shader.uniform("parallaxLayers");
+
+  uniforms.displacementMap = shader.uniform("displacementMap");
+  uniforms.useDisplacementMap = shader.uniform("useDisplacementMap");
+  uniforms.displacementScale = shader.uniform("displacementScale");
+  uniforms.useInstancing = shader.uniform("useInstancing");
+
+  uniforms.cubemap = cubemapShader.uniform("cubemap");
+  uniforms.cubemapView = cubemapShader.uniform("view");
+  uniforms.cubemapProjection = cubemapShader.uniform("projection");
+
+  frameConstants.init(0, sizeof(FrameConstants));
+  objectConstants.init(1, sizeof(ObjectConstants));
+  shader.bindBlock("FrameConstants", frameConstants.binding);
+  shader.bindBlock("ObjectConstants", objectConstants.binding);
+
+  // A bound range shorter than the block leaves the rest of it undefined
+  assert(shader.blockSize("FrameConstants") <= (GLint)frameConstants.stride);
+  assert(shader.blockSize("ObjectConstants") <= (GLint)objectConstants.stride);
+}
+
 // Renders to the "screen" texture that has been passed in as a parameter
 void Project::render(s_ptr<Framebuffer> framebuffer) {
   if (!initialized) {
@@ -233,16 +297,23 @@ void Project::render(s_ptr<Framebuffer> framebuffer) {
   double deltaTime = Application::get().deltaTime;
   double timeSinceStart = Application::get().timeSinceStart;
 
-  // Same as shader.activate()
-  glUseProgram(shader.program);
+  shader.uniformsSet = shader.uniformsSkipped = 0;
+
+  // Whatever ran since the last frame may have changed the bindings
+  GLState &state = GLState::get();
+  state.invalidate();
+  state.resetStats();
 
   if (useCubemapping) {
-    glUseProgram(cubemapShader.program);
-    glUniform1i(glGetUniformLocation(cubemapShader.program, "cubemap"), 0);
+    state.useProgram(cubemapShader.program);
+    cubemapShader.set(uniforms.cubemap, 0);
   }
 
-  OBJMesh *activeMesh = &meshes[activeMeshIndex];
-  glBindVertexArray(activeMesh->VAO);
+  state.useProgram(shader.program);
+
+  activeMeshIndex = glm::clamp(activeMeshIndex, 0, (int)meshes.size() - 1);
+  state.bindVertexArray(arena.VAO);
+  drawCalls = 0;
 
   camera.update(float(framebuffer->width), float(framebuffer->height));
 
@@ -257,197 +328,218 @@ void Project::render(s_ptr<Framebuffer> framebuffer) {
     light.lightDirection = orbit * vec4(forward, 0);
   }
 
-  mat4 vp = camera.projection * camera.view;
-  for (auto &sceneObject : sceneObjects) {
-    mat4 model = sceneObject.transform.getMatrixGLM();
-    mat4 mvp = vp * model;
-
-    GLuint mvpLocation = glGetUniformLocation(shader.program, "mvp");
-    glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(mvp));
-
-    GLuint modelLocation = glGetUniformLocation(shader.program, "model");
-    glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(model));
-
-    mat4 normalMatrix = glm::transpose(glm::inverse(model));
-    GLuint normalMatrixLocation =
-        glGetUniformLocation(shader.program, "normalMatrix");
-    glUniformMatrix4fv(normalMatrixLocation, 1, GL_FALSE,
-                       glm::value_ptr(normalMatrix));
-
-    // Ambient.
-    glUniform1f(glGetUniformLocation(shader.program, "Ia"), light.Ia);
-    glUniform3fv(glGetUniformLocation(shader.program, "Ka"), 1,
-                 glm::value_ptr(light.Ka));
-
-    // Diffuse.
-    glUniform1f(glGetUniformLocation(shader.program, "Id"), light.Id);
-    glUniform3fv(glGetUniformLocation(shader.program, "Kd"), 1,
-                 glm::value_ptr(light.Kd));
-
-    // Specular.
-    glUniform1f(glGetUniformLocation(shader.program, "shininess"),
-                light.shininess);
-    glUniform3fv(glGetUniformLocation(shader.program, "Ks"), 1,
-                 glm::value_ptr(light.Ks));
-
-    glUniform3fv(glGetUniformLocation(shader.program, "lightDirection"), 1,
-                 glm::value_ptr(light.lightDirection));
-
-    glUniform3fv(glGetUniformLocation(shader.program, "cameraPosition"), 1,
-                 glm::value_ptr(camera.cameraPosition));
-
-    glUniform4fv(glGetUniformLocation(shader.program, "color"), 1,
-                 glm::value_ptr(sceneObject.color));
-
-    /**
-     * ------------------------------------------------------------------------
-     * Textures
-     * ------------------------------------------------------------------------
-     */
-    if (useTexture) {
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, textureID);
-
-      if (OpenGLRenderer::instance->textures.find(textureID) !=
-          OpenGLRenderer::instance->textures.end()) {
-        auto texture = OpenGLRenderer::instance->textures[textureID];
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
-                        texture->wrapS._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
-                        texture->wrapT._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                        texture->minFilter._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
-                        texture->magFilter._to_integral());
-      }
+  // Only objects that moved since the last frame get new matrices
+  transforms.update(sceneObjects);
+
+  /**
+   * ------------------------------------------------------------------------
+   * Textures
+   * ------------------------------------------------------------------------
+   */
+  // Every object draws with the same textures, so they're bound once a frame.
+  // Objects with their own texture take it from the atlas through uniforms.
+  // Filtering and wrapping come from sampler objects made from each texture's
+  // parameters, rather than glTexParameteri calls on the texture every frame.
+  auto bindTexture = [&](GLuint unit, GLuint id) -> s_ptr<Texture> {
+    state.bindTexture(unit, GL_TEXTURE_2D, id);
+
+    auto found = OpenGLRenderer::instance->textures.find(id);
+    if (found == OpenGLRenderer::instance->textures.end()) {
+      state.bindSampler(unit, 0);
+      return nullptr;
     }
 
-    if (useNormalTexture) {
-      glActiveTexture(GL_TEXTURE1);
-      glBindTexture(GL_TEXTURE_2D, normalTextureID);
-
-      if (OpenGLRenderer::instance->textures.find(normalTextureID) !=
-          OpenGLRenderer::instance->textures.end()) {
-        auto normalTexture =
-            OpenGLRenderer::instance->textures[normalTextureID];
-        log("Valid normal texture ID: {0}\n", normalTextureID);
-        validNormalTexture = true;
-
-        // Set texture parameters.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
-                        normalTexture->wrapS._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
-                        normalTexture->wrapT._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                        normalTexture->minFilter._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
-                        normalTexture->magFilter._to_integral());
-
-        // Set the texture unit index (e.g., 1) to the normal map uniform.
-        glUniform1i(glGetUniformLocation(shader.program, "normalTexture"), 1);
-      } else {
-        log("Invalid normal texture ID: {0}\n", normalTextureID);
-        validNormalTexture = false;
-      }
+    s_ptr<Texture> texture = found->second;
+    texture->touch();
+    state.bindSampler(unit, state.sampler(texture->wrapS._to_integral(),
+                                          texture->wrapT._to_integral(),
+                                          texture->minFilter._to_integral(),
+                                          texture->magFilter._to_integral()));
+    return texture;
+  };
+
+  // sRGB textures sample as linear colors, which the shader turns back to
+  // the gamma-space colors the lighting was tuned with
+  bool srgbTexture = false;
+
+  if (useTexture) {
+    s_ptr<Texture> texture = bindTexture(0, textureID);
+    srgbTexture = texture && texture->srgb;
+  }
+
+  if (useNormalTexture) {
+    bool valid = bindTexture(1, normalTextureID) != nullptr;
+
+    // Logged when it changes rather than every frame
+    if (valid != validNormalTexture) {
+      log("{0} normal texture ID: {1}\n", valid ? "Valid" : "Invalid",
+          normalTextureID);
     }
+    validNormalTexture = valid;
 
-    if (useParallaxTexture) {
-      glActiveTexture(GL_TEXTURE2);
-      glBindTexture(GL_TEXTURE_2D, parallaxTextureID);
-
-      if (OpenGLRenderer::instance->textures.find(parallaxTextureID) !=
-          OpenGLRenderer::instance->textures.end()) {
-        auto parallaxTexture =
-            OpenGLRenderer::instance->textures[parallaxTextureID];
-
-        log("Parallax texture id: {0}\n", parallaxTextureID);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
-                        parallaxTexture->wrapS._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
-                        parallaxTexture->wrapT._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                        parallaxTexture->minFilter._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
-                        parallaxTexture->magFilter._to_integral());
-
-        // Set the texture unit index (e.g., 1) to the normal map uniform.
-        glUniform1i(glGetUniformLocation(shader.program, "heightmapTexture"),
-                    2);
-      }
+    shader.set(uniforms.normalTexture, 1);
+  }
+
+  if (useParallaxTexture) {
+    if (bindTexture(2, parallaxTextureID)) {
+      shader.set(uniforms.heightmapTexture, 2);
     }
+  }
 
-    if (useDisplacementMap && useParallaxTexture == false) {
-      glActiveTexture(GL_TEXTURE2);
-      glBindTexture(GL_TEXTURE_2D, displacementMapID);
-
-      if (OpenGLRenderer::instance->textures.find(displacementMapID) !=
-          OpenGLRenderer::instance->textures.end()) {
-        auto displacementMap =
-            OpenGLRenderer::instance->textures[displacementMapID];
-
-        log("Displacement map id: {0}\n", displacementMapID);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
-                        displacementMap->wrapS._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
-                        displacementMap->wrapT._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                        displacementMap->minFilter._to_integral());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
-                        displacementMap->magFilter._to_integral());
-
-        // Set the texture unit index (e.g., 1) to the normal map uniform.
-        glUniform1i(glGetUniformLocation(shader.program, "displacementMap"), 2);
-      }
+  if (useDisplacementMap && useParallaxTexture == false) {
+    if (bindTexture(2, displacementMapID)) {
+      shader.set(uniforms.displacementMap, 2);
     }
+  }
 
-    glUniform1i(glGetUniformLocation(shader.program, "useTexture"),
-                (GLint)useTexture);
+  // Always on its own unit: samplers of different types can't share one. The
+  // atlas keeps its own parameters.
+  state.bindTexture(3, GL_TEXTURE_2D_ARRAY, atlas.id);
+  state.bindSampler(3, 0);
+  shader.set(uniforms.atlasTexture, 3);
+
+  /**
+   * ------------------------------------------------------------------------
+   * Constants
+   * ------------------------------------------------------------------------
+   */
+  // The same for every object: the lighting and camera in a block written
+  // once a frame, and the switches through handles found at init
+  mat4 vp = camera.projection * camera.view;
 
-    // Checker for valid normal texture id.
-    glUniform1i(glGetUniformLocation(shader.program, "validNormalTexture"),
-                (GLint)validNormalTexture);
+  // Only objects whose bounds reach into the view are drawn
+  cullObjects(vp);
+
+  FrameConstants frame = {};
+  frame.viewProjection = vp;
+  frame.cameraPosition = camera.cameraPosition;
+  frame.Ia = light.Ia;
+  frame.Ka = light.Ka;
+  frame.Id = light.Id;
+  frame.Kd = light.Kd;
+  frame.shininess = light.shininess;
+  frame.Ks = light.Ks;
+  frame.lightDirection = light.lightDirection;
+  frame.outerTesselation = tesselationOuter;
+  frame.innerTesselation = tesselationInner;
+
+  frameConstants.resize(1);
+  frameConstants.write(0, frame);
+  frameConstants.upload();
+  frameConstants.bind();
+
+  shader.set(uniforms.useTexture, useTexture);
+  shader.set(uniforms.srgbTexture, srgbTexture);
+
+  // Checker for valid normal texture id.
+  shader.set(uniforms.validNormalTexture, validNormalTexture);
+  shader.set(uniforms.useNormalTexture, useNormalTexture);
+
+  shader.set(uniforms.useParallaxTexture, useParallaxTexture);
+  shader.set(uniforms.parallaxLayers, parallaxLayers);
+
+  shader.set(uniforms.useDisplacementMap, useDisplacementMap);
+  shader.set(uniforms.displacementScale, displacementScale);
+
+  // Without tessellation (whose evaluation shader reads ObjectConstants) the
+  // objects are drawn instanced, one command per mesh
+  bool instanced = useInstancing && !useTesselation;
+  shader.set(uniforms.useInstancing, instanced);
+
+  if (instanced) {
+    // ObjectConstants is still declared, so it needs a buffer behind it
+    objectConstants.resize(1);
+    objectConstants.write(0, ObjectConstants{});
+    objectConstants.upload();
+    objectConstants.bind();
+
+    drawInstanced();
+  }
+
+  // Otherwise the objects are drawn one at a time in the order of their keys,
+  // so draws that share state are next to each other and near objects are
+  // drawn before the far ones they hide
+  drawQueue.clear();
+  if (!instanced) {
+    float farPlane = camera.nearFar.y;
+
+    for (int object : visibleObjects) {
+      const SceneObject &sceneObject = sceneObjects[object];
+      vec3 position = vec3(transforms.world[object][3]);
+      float depth =
+          glm::distance(position, camera.cameraPosition) / farPlane;
+
+      const TextureAtlas::Entry *entry = atlasEntry(sceneObject);
+      int material = entry ? sceneObject.atlasTexture + 1 : 0;
+
+      drawQueue.push_back(
+          {drawKey(shader.program, material, meshOf(sceneObject), depth),
+           object});
+    }
 
-    glUniform1i(glGetUniformLocation(shader.program, "useNormalTexture"),
-                (GLint)useNormalTexture);
+    std::sort(drawQueue.begin(), drawQueue.end(),
+              [](const DrawItem &a, const DrawItem &b) { return a.key < b.key; });
+  }
 
-    glUniform1i(glGetUniformLocation(shader.program, "useParallaxTexture"),
-                (GLint)useParallaxTexture);
+  // Every object's constants go into one buffer, uploaded at once; drawing an
+  // object binds its range of it
+  size_t separateDraws = drawQueue.size();
+  objectConstants.resize(separateDraws);
+
+  for (size_t i = 0; i < separateDraws; i++) {
+    int object = drawQueue[i].object;
+    const SceneObject &sceneObject = sceneObjects[object];
+
+    ObjectConstants constants = {};
+    constants.model = transforms.world[object];
+    constants.mvp = vp * constants.model;
+    constants.normalMatrix = mat4(transforms.normal[object]);
+
+    const TextureAtlas::Entry *entry = atlasEntry(sceneObject);
+    if (entry) {
+      constants.useAtlas = 1;
+      constants.atlasRect = entry->rect;
+      constants.atlasLayer = (float)entry->layer;
+    }
 
-    glUniform1i(glGetUniformLocation(shader.program, "parallaxLayers"),
-                parallaxLayers);
+    objectConstants.write(i, constants);
+  }
 
-    glUniform1i(glGetUniformLocation(shader.program, "useDisplacementMap"),
-                (GLint)useDisplacementMap);
+  objectConstants.upload();
 
-    glUniform1f(glGetUniformLocation(shader.program, "displacementScale"),
-                displacementScale);
+  if (useTesselation && separateDraws > 0) {
+    // Set tessellation levels
+    float outerTessLevels[] = {2.0, 2.0, 2.0};
+    float innerTessLevels[] = {2.0};
+    glPatchParameteri(GL_PATCH_VERTICES, 3);
+    glPatchParameterfv(GL_PATCH_DEFAULT_OUTER_LEVEL, outerTessLevels);
+    glPatchParameterfv(GL_PATCH_DEFAULT_INNER_LEVEL, innerTessLevels);
+  }
 
-    glUniform3fv(glGetUniformLocation(shader.program, "outerTesselation"), 1,
-                 glm::value_ptr(tesselationOuter));
+  for (size_t i = 0; i < separateDraws; i++) {
+    // Each draw asks for all of its state, and only what changed is bound
+    state.useProgram(shader.program);
+    state.bindVertexArray(arena.VAO);
+    objectConstants.bind(i);
 
-    glUniform3fv(glGetUniformLocation(shader.program, "innerTesselation"), 1,
-                 glm::value_ptr(tesselationInner));
+    const MeshArena::Range &range =
+        arena.ranges[meshOf(sceneObjects[drawQueue[i].object])];
+    void *firstIndex = (void *)(range.firstIndex * sizeof(GLuint));
+    drawCalls++;
 
     if (useTesselation) {
-      // Set tessellation levels
-      float outerTessLevels[] = {2.0, 2.0, 2.0};
-      float innerTessLevels[] = {2.0};
-      glPatchParameteri(GL_PATCH_VERTICES, 3);
-      glPatchParameterfv(GL_PATCH_DEFAULT_OUTER_LEVEL, outerTessLevels);
-      glPatchParameterfv(GL_PATCH_DEFAULT_INNER_LEVEL, innerTessLevels);
-      glDrawElements(GL_PATCHES, activeMesh->indices.size(), GL_UNSIGNED_INT,
-                     0);
+      glDrawElementsBaseVertex(GL_PATCHES, range.indexCount, GL_UNSIGNED_INT,
+                               firstIndex, range.baseVertex);
     } else {
-      glDrawElements(GL_TRIANGLES, activeMesh->indices.size(), GL_UNSIGNED_INT,
-                     0);
+      glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount,
+                               GL_UNSIGNED_INT, firstIndex, range.baseVertex);
     }
   }
 
   if (useCubemapping) {
     glDepthFunc(GL_LEQUAL);
 
-    glUseProgram(cubemapShader.program);
+    state.useProgram(cubemapShader.program);
     glm::mat4 view = glm::mat4(1.0f);
     glm::mat4 projection = glm::mat4(1.0f);
     glm::vec3 cameraOrientation = glm::vec3(0.0f, 0.0f, -1.0f);
@@ -460,17 +552,223 @@ void Project::render(s_ptr<Framebuffer> framebuffer) {
     projection = glm::perspective(
         glm::radians(45.0f), (float)windowWidth / windowHeight, 0.1f, 100.0f);
 
-    GLuint viewLocation = glGetUniformLocation(cubemapShader.program, "view");
-    glUniformMatrix4fv(viewLocation, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(
-        glGetUniformLocation(cubemapShader.program, "projection"), 1, GL_FALSE,
-        glm::value_ptr(projection));
+    cubemapShader.set(uniforms.cubemapView, view);
+    cubemapShader.set(uniforms.cubemapProjection, projection);
 
-    glBindVertexArray(cubemapVAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    state.bindVertexArray(cubemapVAO);
+    state.bindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    state.bindSampler(0, 0);
     glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    drawCalls++;
+  }
+
+  // Samplers override the parameters of any texture on their unit, so they
+  // don't stay bound for the UI and the other assignments
+  for (GLuint unit = 0; unit < 3; unit++) {
+    state.bindSampler(unit, 0);
+  }
+  state.bindVertexArray(0);
+
+  stateStats = state.getStats();
+}
+
+const TextureAtlas::Entry *Project::atlasEntry(const SceneObject &object) const {
+  int entry = object.atlasTexture;
+  if (!useAtlas || entry < 0 || entry >= (int)atlas.entries.size()) {
+    return nullptr;
+  }
+  return &atlas.entries[entry];
+}
+
+void Project::addMesh(OBJMesh mesh) {
+  arena.add(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(),
+            mesh.indices.size());
+  meshes.push_back(std::move(mesh));
+}
+
+void Project::pointInstanceAttributes(size_t firstInstance) {
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+  // Attributes the shader doesn't use have no location
+  auto instanceAttribute = [&](const char *name, int columns, int size,
+                               size_t offset) {
+    GLint location = shader.attribute(name);
+    if (location < 0) {
+      return;
+    }
+    for (int c = 0; c < columns; c++) {
+      glEnableVertexAttribArray(location + c);
+      glVertexAttribPointer(location + c, size, GL_FLOAT, GL_FALSE,
+                            sizeof(InstanceData),
+                            (const void *)(firstInstance * sizeof(InstanceData) +
+                                           offset + c * size * sizeof(float)));
+      glVertexAttribDivisor(location + c, 1);
+    }
+  };
+
+  instanceAttribute("instanceModel", 4, 4, offsetof(InstanceData, model));
+  instanceAttribute("instanceNormalMatrix", 3, 3,
+                    offsetof(InstanceData, normalMatrix));
+  instanceAttribute("instanceAtlasRect", 1, 4,
+                    offsetof(InstanceData, atlasRect));
+  instanceAttribute("instanceAtlasLayer", 1, 1,
+                    offsetof(InstanceData, atlasLayer));
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Project::cullObjects(const mat4 &viewProjection) {
+  _time start = _clock::now();
+  int count = (int)sceneObjects.size();
+
+  if (useCulling) {
+    // Displacement pushes vertices out along their normals, by at most the
+    // scale
+    float padding = useDisplacementMap ? glm::abs(displacementScale) : 0.0f;
+
+    culler.resize(count);
+    JobSystem::get().parallelFor(0, count, 1024, [&](int begin, int end) {
+      for (int i = begin; i < end; i++) {
+        const SceneObject &sceneObject = sceneObjects[i];
+        const OBJMesh &mesh = meshes[meshOf(sceneObject)];
+
+        // The sphere grows with the largest of the axes' scales
+        const mat4 &model = transforms.world[i];
+        float scale = glm::max(glm::length(vec3(model[0])),
+                               glm::max(glm::length(vec3(model[1])),
+                                        glm::length(vec3(model[2]))));
+
+        culler.set(i, vec3(model * vec4(mesh.boundsCenter, 1.0f)),
+                   (mesh.boundsRadius + padding) * scale);
+      }
+    });
+
+    culler.cull(Frustum::fromMatrix(viewProjection), visibleObjects);
+  } else {
+    visibleObjects.resize(count);
+    for (int i = 0; i < count; i++) {
+      visibleObjects[i] = i;
+    }
+  }
+
+  cullingStats.visible = visibleObjects.size();
+  cullingStats.culled = count - visibleObjects.size();
+  cullingStats.milliseconds = _elapsed(_clock::now() - start).count() * 1000.0;
+}
+
+void Project::drawInstanced() {
+  if (visibleObjects.empty()) {
+    return;
+  }
+
+  // Instances are grouped by mesh, so each mesh's are one run of the
+  // instance buffer and one command
+  size_t meshCount = arena.ranges.size();
+  std::vector<GLuint> firstInstance(meshCount + 1, 0);
+  for (int object : visibleObjects) {
+    firstInstance[meshOf(sceneObjects[object]) + 1]++;
+  }
+  for (size_t m = 0; m < meshCount; m++) {
+    firstInstance[m + 1] += firstInstance[m];
+  }
+
+  std::vector<int> instanceObjects(visibleObjects.size());
+  std::vector<GLuint> next(firstInstance.begin(), firstInstance.end() - 1);
+  for (int object : visibleObjects) {
+    instanceObjects[next[meshOf(sceneObjects[object])]++] = object;
+  }
+
+  // Gathering 100k objects' matrices and atlas entries takes a while,
+  // so it's spread over the job threads
+  instances.resize(instanceObjects.size());
+  JobSystem::get().parallelFor(
+      0, (int)instanceObjects.size(), 1024, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+          int object = instanceObjects[i];
+          const SceneObject &sceneObject = sceneObjects[object];
+          InstanceData &instance = instances[i];
+
+          instance.model = transforms.world[object];
+          instance.normalMatrix = transforms.normal[object];
+
+          const TextureAtlas::Entry *entry = atlasEntry(sceneObject);
+          instance.atlasRect = entry ? entry->rect : vec4(0.0f);
+          instance.atlasLayer = entry ? (float)entry->layer : -1.0f;
+        }
+      });
+
+  if (!instanceBuffer) {
+    glGenBuffers(1, &instanceBuffer);
+  }
+
+  // A new store each frame, so the GPU can still read last frame's
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData),
+               instances.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // Every object shares the shader and textures (one material), so one
+  // command per mesh in one multi-draw covers them all
+  commands.clear();
+  for (size_t m = 0; m < meshCount; m++) {
+    GLuint count = firstInstance[m + 1] - firstInstance[m];
+    if (count > 0) {
+      commands.push_back(arena.command((int)m, count, firstInstance[m]));
+    }
+  }
+
+  GLState::get().bindVertexArray(arena.VAO);
+
+  if (MeshArena::multiDrawSupported()) {
+    pointInstanceAttributes(0);
+
+    if (!indirectBuffer) {
+      glGenBuffers(1, &indirectBuffer);
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                 commands.size() * sizeof(DrawElementsIndirectCommand),
+                 commands.data(), GL_STREAM_DRAW);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                                (GLsizei)commands.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    drawCalls++;
+  } else {
+    // Without base instances (GL 4.1) the instance attributes are pointed at
+    // each command's run instead
+    for (const DrawElementsIndirectCommand &command : commands) {
+      pointInstanceAttributes(command.baseInstance);
+      glDrawElementsInstancedBaseVertex(
+          GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+          (void *)(command.firstIndex * sizeof(GLuint)),
+          command.instanceCount, command.baseVertex);
+      drawCalls++;
+    }
+  }
+}
+
+void Project::buildAtlas() {
+  // The color textures loaded from files, in order of their GL names
+  std::vector<std::string> filenames;
+  for (auto &t : OpenGLRenderer::instance->textures) {
+    auto &texture = t.second;
+    if (!texture->framebuffer && !texture->filename.empty() &&
+        texture->settings.role == +TextureRole::Albedo) {
+      filenames.push_back(texture->filename);
+    }
+  }
+
+  if (!atlas.build(filenames)) {
+    return;
+  }
+
+  // Objects without a texture of their own take the atlas's in turn
+  for (size_t i = 0; i < sceneObjects.size(); i++) {
+    int &entry = sceneObjects[i].atlasTexture;
+    if (entry < 0 || entry >= (int)atlas.entries.size()) {
+      entry = atlas.entries.empty() ? -1 : (int)(i % atlas.entries.size());
+    }
   }
 }
 
@@ -536,11 +834,40 @@ void Project::renderUI() {
       }
     }
 
+    ImGui::Checkbox("Use texture atlas", &useAtlas);
+    if (useAtlas) {
+      if (ImGui::Button("Build atlas from loaded textures")) {
+        buildAtlas();
+      }
+      ImGui::Text("%zu textures in %d layer(s) of %d x %d, %.2f MB",
+                  atlas.entries.size(), atlas.layers, atlas.resolution.x,
+                  atlas.resolution.y, atlas.memorySize() / (1024.0 * 1024.0));
+    }
+
+    ImGui::Checkbox("Draw objects instanced", &useInstancing);
+    ImGui::Checkbox("Cull objects outside the view", &useCulling);
+
     ImGui::Checkbox("Wireframe", &useWireframe);
   }
 
   int numMeshes = meshes.size();
-  ImGui::Text("Number of meshes: %d", numMeshes);
+  ImGui::Text("Number of meshes: %d, %.2f of %.2f MB of the mesh arena used",
+              numMeshes, arena.usedBytes() / (1024.0 * 1024.0),
+              arena.capacityBytes() / (1024.0 * 1024.0));
+  ImGui::Text("Draw calls last frame: %zu%s", drawCalls,
+              MeshArena::multiDrawSupported() ? " (multi-draw indirect)" : "");
+  ImGui::Text("Transforms recomputed last frame: %zu", transforms.updated);
+  ImGui::Text("Objects visible: %zu, culled: %zu, in %.3f ms",
+              cullingStats.visible, cullingStats.culled,
+              cullingStats.milliseconds);
+
+  ImGui::Text("Uniforms set last frame: %zu, unchanged and skipped: %zu",
+              shader.uniformsSet, shader.uniformsSkipped);
+  ImGui::Text("GL calls last frame: %zu issued, %zu elided",
+              stateStats.issued + shader.uniformsSet + drawCalls,
+              stateStats.elided + shader.uniformsSkipped);
+  ImGui::Text("Binds last frame: %zu issued, %zu already bound",
+              stateStats.issued, stateStats.elided);
 
   int meshMax = meshes.size() - 1;
   if (meshMax > 0) {
@@ -558,9 +885,9 @@ void Project::renderUI() {
   if (ImGuiFileDialog::Instance()->Display("ChooseOBJKey")) {
     if (ImGuiFileDialog::Instance()->IsOk()) {
       std::string objFile = ImGuiFileDialog::Instance()->GetFilePathName();
-      OBJMesh loadedMesh = OBJMesh::import(objFile.c_str(), shader.program);
-      if (loadedMesh.isValid()) {
-        meshes.push_back(loadedMesh);
+      OBJMesh loadedMesh = OBJMesh::parse(objFile.c_str());
+      if (!loadedMesh.vertices.empty()) {
+        addMesh(std::move(loadedMesh));
       }
 
       ImGuiFileDialog::Instance()->Close();
@@ -580,6 +907,7 @@ void Project::renderUI() {
     ImGui::SameLine();
     std::string addRandomLabel = fmt::format("Add {0}", numberToAdd);
     static vec2 scaleRange = vec2(0.1, 8.f);
+    static bool mixMeshes = false;
     if (ImGui::Button(addRandomLabel.c_str())) {
       for (int i = 0; i < glm::max(numberToAdd, 0); i++) {
         SceneObject newObject;
@@ -593,16 +921,25 @@ void Project::renderUI() {
         newObject.transform.scale =
             vec3(glm::linearRand(scaleRange.x, scaleRange.y));
         newObject.color = glm::linearRand(vec3(0.1f), vec3(1.f));
+        if (mixMeshes) {
+          newObject.mesh = glm::linearRand(0, (int)meshes.size() - 1);
+        }
+        if (!atlas.entries.empty()) {
+          newObject.atlasTexture =
+              glm::linearRand(0, (int)atlas.entries.size() - 1);
+        }
 
         sceneObjects.push_back(newObject);
       }
     }
 
     ImGui::InputFloat2("Scale min/max", glm::value_ptr(scaleRange));
+    ImGui::Checkbox("Added objects pick a random mesh", &mixMeshes);
 
     if (sceneObjects.size() > 0) {
       if (ImGui::Button("Clear all")) {
         sceneObjects.clear();
+        transforms.invalidate();
       }
 
       int counter = 1;
@@ -623,6 +960,7 @@ void Project::renderUI() {
 
       if (soToDelete != sceneObjects.end()) {
         sceneObjects.erase(soToDelete);
+        transforms.invalidate();
       }
     }
 
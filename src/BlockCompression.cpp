@@ -0,0 +1,624 @@
+#include "BlockCompression.h"
+
+#include "JobSystem.h"
+
+#include <cstring>
+
+// The texels of one block as floats in [0, 255], RGBA, row by row
+typedef float BlockTexels[16][4];
+
+// Fits a line through the block's texels in the first numChannels channels: the mean and the
+// direction of most variance (power iteration on the covariance matrix). Returns the ends of the
+// segment the texels project onto.
+static void fitLine(const BlockTexels& texels, int numChannels, float start[4], float end[4])
+{
+	float mean[4] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < numChannels; c++) {
+			mean[c] += texels[i][c] / 16.f;
+		}
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int a = 0; a < numChannels; a++) {
+			for (int b = 0; b < numChannels; b++) {
+				covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+			}
+		}
+	}
+
+	float axis[4] = { 1.f, 1.f, 1.f, 1.f };
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {};
+		float length = 0.f;
+		for (int a = 0; a < numChannels; a++) {
+			for (int b = 0; b < numChannels; b++) {
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length = glm::max(length, std::abs(next[a]));
+		}
+
+		// Flat blocks have no direction; any axis gives a zero-length segment
+		if (length < 1e-6f) break;
+
+		for (int c = 0; c < numChannels; c++) {
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float minT = FLT_MAX, maxT = -FLT_MAX;
+	for (int i = 0; i < 16; i++) {
+		float t = 0.f;
+		for (int c = 0; c < numChannels; c++) {
+			t += (texels[i][c] - mean[c]) * axis[c];
+		}
+		minT = glm::min(minT, t);
+		maxT = glm::max(maxT, t);
+	}
+
+	float axisLength2 = 0.f;
+	for (int c = 0; c < numChannels; c++) {
+		axisLength2 += axis[c] * axis[c];
+	}
+	axisLength2 = glm::max(axisLength2, 1e-12f);
+
+	for (int c = 0; c < numChannels; c++) {
+		start[c] = glm::clamp(mean[c] + axis[c] * minT / axisLength2, 0.f, 255.f);
+		end[c] = glm::clamp(mean[c] + axis[c] * maxT / axisLength2, 0.f, 255.f);
+	}
+}
+
+// Least squares endpoints for texels that already have their indices: weights[i] is how much of
+// end texel i takes. Returns false when all the weights are the same and the fit is undefined.
+static bool refineLine(const BlockTexels& texels, const float weights[16], int numChannels, float start[4], float end[4])
+{
+	float aa = 0.f, ab = 0.f, bb = 0.f;
+	float ax[4] = {}, bx[4] = {};
+
+	for (int i = 0; i < 16; i++) {
+		float b = weights[i];
+		float a = 1.f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < numChannels; c++) {
+			ax[c] += a * texels[i][c];
+			bx[c] += b * texels[i][c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (std::abs(determinant) < 1e-6f) return false;
+
+	for (int c = 0; c < numChannels; c++) {
+		start[c] = glm::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.f, 255.f);
+		end[c] = glm::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.f, 255.f);
+	}
+
+	return true;
+}
+
+// Picks the nearest of numColors palette entries for every texel. Returns the total squared error.
+static float pickIndices(const BlockTexels& texels, const int palette[][4], int numColors, int numChannels, int indices[16])
+{
+	float total = 0.f;
+
+	for (int i = 0; i < 16; i++) {
+		float best = FLT_MAX;
+		for (int p = 0; p < numColors; p++) {
+			float error = 0.f;
+			for (int c = 0; c < numChannels; c++) {
+				float d = texels[i][c] - palette[p][c];
+				error += d * d;
+			}
+			if (error < best) {
+				best = error;
+				indices[i] = p;
+			}
+		}
+		total += best;
+	}
+
+	return total;
+}
+
+// BC1
+
+static uint16_t packColor565(const float color[4])
+{
+	int r = (int)std::lround(color[0] * 31.f / 255.f);
+	int g = (int)std::lround(color[1] * 63.f / 255.f);
+	int b = (int)std::lround(color[2] * 31.f / 255.f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void unpackColor565(uint16_t packed, int color[4])
+{
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+	color[3] = 255;
+}
+
+// The four colors a BC1 block's endpoints stand for. color0 > color1 interpolates two colors in
+// between, otherwise there's one halfway color and black (which is transparent with alpha).
+static void getPaletteBC1(uint16_t color0, uint16_t color1, int palette[4][4])
+{
+	unpackColor565(color0, palette[0]);
+	unpackColor565(color1, palette[1]);
+
+	for (int c = 0; c < 4; c++) {
+		if (color0 > color1) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+// Quantizes the endpoints and picks indices in four-color mode. Returns the error.
+static float tryBC1(const BlockTexels& texels, const float start[4], const float end[4], uint16_t& color0, uint16_t& color1, int indices[16])
+{
+	color0 = packColor565(end);
+	color1 = packColor565(start);
+
+	if (color0 < color1) {
+		std::swap(color0, color1);
+	}
+
+	// With equal endpoints the block is in three-color mode, but index 0 is the only color it needs
+	int palette[4][4];
+	getPaletteBC1(color0, color1, palette);
+	return pickIndices(texels, palette, color0 == color1 ? 1 : 4, 3, indices);
+}
+
+static void encodeBlockBC1(const BlockTexels& texels, unsigned char* out)
+{
+	float start[4], end[4];
+	fitLine(texels, 3, start, end);
+
+	uint16_t color0, color1;
+	int indices[16];
+	float error = tryBC1(texels, start, end, color0, color1, indices);
+
+	// Once the indices are known the endpoints can be solved for exactly, which pulls them in from
+	// the extremes when most texels sit in the middle of the block's range
+	if (color0 != color1) {
+		static const float weights[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+		float texelWeights[16];
+		for (int i = 0; i < 16; i++) {
+			texelWeights[i] = weights[indices[i]];
+		}
+
+		// The weights are of color1, so the fitted line runs from color0 to color1
+		float refined0Color[4], refined1Color[4];
+		if (refineLine(texels, texelWeights, 3, refined0Color, refined1Color)) {
+			uint16_t refined0, refined1;
+			int refinedIndices[16];
+			float refinedError = tryBC1(texels, refined1Color, refined0Color, refined0, refined1, refinedIndices);
+
+			if (refinedError < error) {
+				error = refinedError;
+				color0 = refined0;
+				color1 = refined1;
+				memcpy(indices, refinedIndices, sizeof(indices));
+			}
+		}
+	}
+
+	uint32_t packedIndices = 0;
+	for (int i = 0; i < 16; i++) {
+		packedIndices |= (uint32_t)indices[i] << (2 * i);
+	}
+
+	out[0] = color0 & 0xff;
+	out[1] = color0 >> 8;
+	out[2] = color1 & 0xff;
+	out[3] = color1 >> 8;
+	memcpy(out + 4, &packedIndices, 4);
+}
+
+static void decodeBlockBC1(const unsigned char* block, unsigned char texels[16][4])
+{
+	uint16_t color0 = block[0] | (block[1] << 8);
+	uint16_t color1 = block[2] | (block[3] << 8);
+	uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+
+	int palette[4][4];
+	getPaletteBC1(color0, color1, palette);
+
+	for (int i = 0; i < 16; i++) {
+		int* color = palette[(indices >> (2 * i)) & 3];
+		for (int c = 0; c < 4; c++) {
+			texels[i][c] = (unsigned char)color[c];
+		}
+	}
+}
+
+// BC4
+
+// The eight values of a BC4 block. value0 > value1 interpolates six in between, otherwise four
+// and then 0 and 255 exactly.
+static void getPaletteBC4(int value0, int value1, int palette[8][4])
+{
+	palette[0][0] = value0;
+	palette[1][0] = value1;
+
+	if (value0 > value1) {
+		for (int i = 1; i < 7; i++) {
+			palette[i + 1][0] = ((7 - i) * value0 + i * value1) / 7;
+		}
+	}
+	else {
+		for (int i = 1; i < 5; i++) {
+			palette[i + 1][0] = ((5 - i) * value0 + i * value1) / 5;
+		}
+		palette[6][0] = 0;
+		palette[7][0] = 255;
+	}
+}
+
+// Encodes channel of the texels
+static void encodeBlockBC4(const BlockTexels& texels, int channel, unsigned char* out)
+{
+	BlockTexels values;
+	float lowest = 255.f, highest = 0.f;
+	for (int i = 0; i < 16; i++) {
+		values[i][0] = texels[i][channel];
+		lowest = glm::min(lowest, values[i][0]);
+		highest = glm::max(highest, values[i][0]);
+	}
+
+	int value0 = (int)std::lround(highest);
+	int value1 = (int)std::lround(lowest);
+
+	int palette[8][4];
+	getPaletteBC4(value0, value1, palette);
+
+	int indices[16];
+	pickIndices(values, palette, value0 > value1 ? 8 : 1, 1, indices);
+
+	uint64_t packedIndices = 0;
+	for (int i = 0; i < 16; i++) {
+		packedIndices |= (uint64_t)indices[i] << (3 * i);
+	}
+
+	out[0] = (unsigned char)value0;
+	out[1] = (unsigned char)value1;
+	for (int b = 0; b < 6; b++) {
+		out[2 + b] = (unsigned char)(packedIndices >> (8 * b));
+	}
+}
+
+static void decodeBlockBC4(const unsigned char* block, unsigned char texels[16][4], int channel)
+{
+	int palette[8][4];
+	getPaletteBC4(block[0], block[1], palette);
+
+	uint64_t indices = 0;
+	for (int b = 0; b < 6; b++) {
+		indices |= (uint64_t)block[2 + b] << (8 * b);
+	}
+
+	for (int i = 0; i < 16; i++) {
+		texels[i][channel] = (unsigned char)palette[(indices >> (3 * i)) & 7][0];
+	}
+}
+
+// BC7, mode 6 only
+
+static const int bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Endpoints of a mode 6 block: 7 bits per channel and a shared lowest bit per endpoint
+struct EndpointsBC7 {
+	int color[2][4];
+	int pBit[2];
+};
+
+static void getPaletteBC7(const EndpointsBC7& endpoints, int palette[16][4])
+{
+	for (int c = 0; c < 4; c++) {
+		int e0 = (endpoints.color[0][c] << 1) | endpoints.pBit[0];
+		int e1 = (endpoints.color[1][c] << 1) | endpoints.pBit[1];
+		for (int i = 0; i < 16; i++) {
+			palette[i][c] = ((64 - bc7Weights4[i]) * e0 + bc7Weights4[i] * e1 + 32) >> 6;
+		}
+	}
+}
+
+// Rounds an endpoint to 7 bits per channel, trying both values of the shared bit
+static void quantizeBC7(const float color[4], int quantized[4], int& pBit)
+{
+	float bestError = FLT_MAX;
+
+	for (int p = 0; p < 2; p++) {
+		int candidate[4];
+		float error = 0.f;
+		for (int c = 0; c < 4; c++) {
+			candidate[c] = glm::clamp((int)std::lround((color[c] - p) / 2.f), 0, 127);
+			float d = color[c] - ((candidate[c] << 1) | p);
+			error += d * d;
+		}
+		if (error < bestError) {
+			bestError = error;
+			pBit = p;
+			memcpy(quantized, candidate, sizeof(candidate));
+		}
+	}
+}
+
+static float tryBC7(const BlockTexels& texels, const float start[4], const float end[4], EndpointsBC7& endpoints, int indices[16])
+{
+	quantizeBC7(start, endpoints.color[0], endpoints.pBit[0]);
+	quantizeBC7(end, endpoints.color[1], endpoints.pBit[1]);
+
+	int palette[16][4];
+	getPaletteBC7(endpoints, palette);
+	return pickIndices(texels, palette, 16, 4, indices);
+}
+
+// Writes bits into a 128-bit block, lowest bit first
+struct BitWriter {
+	unsigned char* out;
+	int position = 0;
+
+	void write(uint32_t value, int numBits)
+	{
+		for (int i = 0; i < numBits; i++, position++) {
+			if (value & (1u << i)) {
+				out[position >> 3] |= 1 << (position & 7);
+			}
+		}
+	}
+};
+
+struct BitReader {
+	const unsigned char* in;
+	int position = 0;
+
+	uint32_t read(int numBits)
+	{
+		uint32_t value = 0;
+		for (int i = 0; i < numBits; i++, position++) {
+			value |= (uint32_t)((in[position >> 3] >> (position & 7)) & 1) << i;
+		}
+		return value;
+	}
+};
+
+static void encodeBlockBC7(const BlockTexels& texels, unsigned char* out)
+{
+	float start[4], end[4];
+	fitLine(texels, 4, start, end);
+
+	EndpointsBC7 endpoints;
+	int indices[16];
+	float error = tryBC7(texels, start, end, endpoints, indices);
+
+	float texelWeights[16];
+	for (int i = 0; i < 16; i++) {
+		texelWeights[i] = bc7Weights4[indices[i]] / 64.f;
+	}
+
+	if (refineLine(texels, texelWeights, 4, start, end)) {
+		EndpointsBC7 refined;
+		int refinedIndices[16];
+		float refinedError = tryBC7(texels, start, end, refined, refinedIndices);
+
+		if (refinedError < error) {
+			endpoints = refined;
+			memcpy(indices, refinedIndices, sizeof(indices));
+		}
+	}
+
+	// The first texel's index is stored without its top bit, which the encoder has to keep 0 by
+	// swapping the endpoints if needed
+	if (indices[0] >= 8) {
+		std::swap(endpoints.color[0], endpoints.color[1]);
+		std::swap(endpoints.pBit[0], endpoints.pBit[1]);
+		for (int i = 0; i < 16; i++) {
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	memset(out, 0, 16);
+	BitWriter writer{ out };
+
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writer.write(endpoints.color[0][c], 7);
+		writer.write(endpoints.color[1][c], 7);
+	}
+	writer.write(endpoints.pBit[0], 1);
+	writer.write(endpoints.pBit[1], 1);
+
+	writer.write(indices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		writer.write(indices[i], 4);
+	}
+}
+
+static void decodeBlockBC7(const unsigned char* block, unsigned char texels[16][4])
+{
+	BitReader reader{ block };
+
+	if (reader.read(7) != (1 << 6)) {
+		memset(texels, 0, 16 * 4);
+		return;
+	}
+
+	EndpointsBC7 endpoints;
+	for (int c = 0; c < 4; c++) {
+		endpoints.color[0][c] = reader.read(7);
+		endpoints.color[1][c] = reader.read(7);
+	}
+	endpoints.pBit[0] = reader.read(1);
+	endpoints.pBit[1] = reader.read(1);
+
+	int palette[16][4];
+	getPaletteBC7(endpoints, palette);
+
+	for (int i = 0; i < 16; i++) {
+		int index = reader.read(i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++) {
+			texels[i][c] = (unsigned char)palette[index][c];
+		}
+	}
+}
+
+namespace BlockCompression
+{
+	int blockBytes(BlockFormat format)
+	{
+		switch (format) {
+		case BlockFormat::BC1:
+		case BlockFormat::BC4:
+			return 8;
+		case BlockFormat::BC5:
+		case BlockFormat::BC7:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	int channelCount(BlockFormat format)
+	{
+		switch (format) {
+		case BlockFormat::BC4: return 1;
+		case BlockFormat::BC5: return 2;
+		case BlockFormat::BC1: return 3;
+		case BlockFormat::BC7: return 4;
+		default: return 0;
+		}
+	}
+
+	size_t compressedSize(BlockFormat format, int width, int height)
+	{
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+	}
+
+	std::vector<unsigned char> encode(const ImageIO::DecodedImage& image, BlockFormat format)
+	{
+		int blocksWide = (image.width + 3) / 4;
+		int blocksHigh = (image.height + 3) / 4;
+		int bytes = blockBytes(format);
+		int channels = image.channels;
+
+		std::vector<unsigned char> blocks(compressedSize(format, image.width, image.height));
+
+		// A few thousand blocks per job
+		int grain = glm::max(1, 4096 / glm::max(1, blocksWide));
+
+		JobSystem::get().parallelFor(0, blocksHigh, grain, [&](int begin, int end) {
+			BlockTexels texels;
+
+			for (int by = begin; by < end; by++) {
+				for (int bx = 0; bx < blocksWide; bx++) {
+					for (int i = 0; i < 16; i++) {
+						int x = glm::min(bx * 4 + i % 4, image.width - 1);
+						int y = glm::min(by * 4 + i / 4, image.height - 1);
+						size_t pixel = ((size_t)y * image.width + x) * channels;
+
+						// 16-bit images are brought down to the blocks' 8 bits
+						auto channel = [&](int c) {
+							if (image.bytesPerChannel == 2) {
+								return ((const uint16_t*)image.pixels.data())[pixel + c] / 257.f;
+							}
+							return (float)image.pixels[pixel + c];
+						};
+
+						bool gray = channels < 3;
+						for (int c = 0; c < 3; c++) {
+							texels[i][c] = channel(gray ? 0 : c);
+						}
+						texels[i][3] = channels == 2 || channels == 4 ? channel(channels - 1) : 255.f;
+					}
+
+					unsigned char* out = blocks.data() + ((size_t)by * blocksWide + bx) * bytes;
+
+					switch (format) {
+					case BlockFormat::BC1:
+						encodeBlockBC1(texels, out);
+						break;
+					case BlockFormat::BC4:
+						encodeBlockBC4(texels, 0, out);
+						break;
+					case BlockFormat::BC5:
+						encodeBlockBC4(texels, 0, out);
+						encodeBlockBC4(texels, 1, out + 8);
+						break;
+					case BlockFormat::BC7:
+						encodeBlockBC7(texels, out);
+						break;
+					default:
+						break;
+					}
+				}
+			}
+		});
+
+		return blocks;
+	}
+
+	ImageIO::DecodedImage decode(const unsigned char* blocks, int width, int height, BlockFormat format)
+	{
+		ImageIO::DecodedImage image;
+		image.width = width;
+		image.height = height;
+		image.channels = channelCount(format);
+		image.pixels.resize((size_t)width * height * image.channels);
+
+		int blocksWide = (width + 3) / 4;
+		int blocksHigh = (height + 3) / 4;
+		int bytes = blockBytes(format);
+
+		int grain = glm::max(1, 4096 / glm::max(1, blocksWide));
+
+		JobSystem::get().parallelFor(0, blocksHigh, grain, [&](int begin, int end) {
+			unsigned char texels[16][4] = {};
+
+			for (int by = begin; by < end; by++) {
+				for (int bx = 0; bx < blocksWide; bx++) {
+					const unsigned char* block = blocks + ((size_t)by * blocksWide + bx) * bytes;
+
+					switch (format) {
+					case BlockFormat::BC1:
+						decodeBlockBC1(block, texels);
+						break;
+					case BlockFormat::BC4:
+						decodeBlockBC4(block, texels, 0);
+						break;
+					case BlockFormat::BC5:
+						decodeBlockBC4(block, texels, 0);
+						decodeBlockBC4(block + 8, texels, 1);
+						break;
+					case BlockFormat::BC7:
+						decodeBlockBC7(block, texels);
+						break;
+					default:
+						break;
+					}
+
+					for (int i = 0; i < 16; i++) {
+						int x = bx * 4 + i % 4;
+						int y = by * 4 + i / 4;
+						if (x >= width || y >= height) continue;
+
+						unsigned char* pixel = image.pixels.data() + ((size_t)y * width + x) * image.channels;
+						for (int c = 0; c < image.channels; c++) {
+							pixel[c] = texels[i][c];
+						}
+					}
+				}
+			}
+		});
+
+		return image;
+	}
+}
@@ -0,0 +1,220 @@
+#include "FrameRecorder.h"
+
+#include "ImageIO.h"
+#include "Texture.h"
+#include "TextureReadback.h"
+#include "UIHelpers.h"
+
+#include "imgui.h"
+
+#include <filesystem>
+#include <fstream>
+
+FrameRecorder& FrameRecorder::get()
+{
+	// Never destroyed, like TextureRegistry: frames still being written on the way out hold on to it
+	static FrameRecorder* recorder = new FrameRecorder();
+	return *recorder;
+}
+
+static const char* extension(CaptureFormat format)
+{
+	switch (+format) {
+	case CaptureFormat::PNG:
+		return "png";
+	case CaptureFormat::PFM:
+		return "pfm";
+	default:
+		return "raw";
+	}
+}
+
+bool FrameRecorder::start(s_ptr<Texture> texture)
+{
+	stop();
+
+	if (!texture || !texture->memory) {
+		log("Only textures with memory (framebuffer attachments) can be recorded\n");
+		return false;
+	}
+
+	const TextureMemory& memory = *texture->memory;
+
+	recordingFormat = format;
+	if (+recordingFormat != +CaptureFormat::Raw && (memory.type != GL_FLOAT || memory.stride < 3)) {
+		log("Texture {0} isn't a float color attachment, recording it raw\n", texture->id);
+		recordingFormat = CaptureFormat::Raw;
+	}
+
+	folder = fmt::format("{0}/{1}", directory, (int64_t)current_time_t());
+
+	std::error_code error;
+	std::filesystem::create_directories(folder, error);
+	if (error) {
+		log("Unable to create {0}: {1}\n", folder, error.message());
+		return false;
+	}
+
+	// What raw frames hold, so they can be read back without this program
+	std::ofstream info(folder + "/capture.json");
+	info << fmt::format("{{ \"width\": {0}, \"height\": {1}, \"channels\": {2}, \"type\": \"{3}\", \"format\": \"{4}\", \"bottomFirst\": true }}\n",
+		memory.width, memory.height, memory.stride, memory.type == GL_FLOAT ? "float" : "int", recordingFormat._to_string());
+
+	this->texture = texture;
+	recording = true;
+	frameCounter = 0;
+	frameNumber = 0;
+
+	captured = 0;
+	dropped = 0;
+	written = 0;
+	failed = 0;
+
+	log("Recording texture {0} to {1}\n", texture->id, folder);
+	return true;
+}
+
+void FrameRecorder::stop()
+{
+	if (!recording) return;
+
+	recording = false;
+	texture.reset();
+
+	log("Stopped recording to {0}: {1} frames captured, {2} dropped\n", folder, captured, dropped);
+}
+
+bool FrameRecorder::isRecording() const
+{
+	return recording;
+}
+
+size_t FrameRecorder::queueDepth() const
+{
+	return reading.size() + (size_t)writing;
+}
+
+FrameRecorder::Stats FrameRecorder::getStats() const
+{
+	Stats stats;
+	stats.captured = captured;
+	stats.dropped = dropped;
+	stats.written = written;
+	stats.failed = failed;
+	return stats;
+}
+
+void FrameRecorder::update()
+{
+	{
+		std::lock_guard<std::mutex> lock(writeErrorsMutex);
+		for (const std::string& error : writeErrors) {
+			log("{0}", error);
+		}
+		writeErrors.clear();
+	}
+
+	// Reads finish in the order they were issued, so the first one not done yet ends the batch
+	while (!reading.empty() && reading.front().read.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		Frame frame = reading.front();
+		reading.pop_front();
+
+		if (frame.read.get()) {
+			write(frame);
+		}
+		else {
+			failed++;
+		}
+	}
+
+	if (recording && frameCounter++ % (unsigned long)glm::max(every, 1) == 0) {
+		capture();
+	}
+
+	// Without threads of its own the pool only runs jobs while someone waits, which nothing here
+	// does
+	if (writing > 0 && JobSystem::get().threadCount() == 1) {
+		JobSystem::get().runOne();
+	}
+}
+
+void FrameRecorder::capture()
+{
+	s_ptr<Texture> source = texture.lock();
+	if (!source || !source->memory) {
+		log("The recorded texture is gone\n");
+		stop();
+		return;
+	}
+
+	if (queueDepth() >= (size_t)glm::max(maxQueued, 1)) {
+		dropped++;
+		frameNumber++;
+		return;
+	}
+
+	const TextureMemory& memory = *source->memory;
+
+	Frame frame;
+	frame.number = frameNumber++;
+	frame.memory = std::make_shared<TextureMemory>(memory.type, memory.width, memory.height, memory.stride);
+	frame.read = TextureReadback::get().read(source, ivec4(0), frame.memory);
+
+	reading.push_back(frame);
+	captured++;
+}
+
+void FrameRecorder::write(Frame frame)
+{
+	// Dropped frames keep their numbers, so gaps in the sequence show where they were
+	std::string filename = fmt::format("{0}/frame_{1:06}.{2}", folder, frame.number, extension(recordingFormat));
+	CaptureFormat frameFormat = recordingFormat;
+
+	writing++;
+	writers.run([this, frame, filename, frameFormat]() {
+		const TextureMemory& memory = *frame.memory;
+		bool ok = false;
+		std::string error;
+
+		if (+frameFormat == +CaptureFormat::Raw) {
+			std::ofstream file(filename, std::ios::binary);
+			ok = (bool)file.write((const char*)memory.value, memory.size);
+			if (!ok) {
+				error = fmt::format("Unable to write {0}\n", filename);
+			}
+		}
+		else {
+			ok = ImageIO::writeImage(filename, (const float*)memory.value, memory.width, memory.height, memory.stride, &error);
+		}
+
+		if (ok) {
+			written++;
+		}
+		else {
+			failed++;
+			std::lock_guard<std::mutex> lock(writeErrorsMutex);
+			writeErrors.push_back(error);
+		}
+		writing--;
+	});
+}
+
+void FrameRecorder::renderUI()
+{
+	if (recording) {
+		ImGui::Text("Recording to %s", folder.c_str());
+	}
+	else {
+		renderEnumDropDown<CaptureFormat>("Capture format", format);
+		ImGui::InputInt("Capture every Nth frame", &every);
+		ImGui::InputInt("Frames queued at most", &maxQueued);
+	}
+
+	Stats stats = getStats();
+	ImGui::Text("Frames captured: %zu, dropped: %zu, written: %zu, failed: %zu, queued: %zu", stats.captured,
+		stats.dropped, stats.written, stats.failed, queueDepth());
+
+	if (recording && ImGui::Button("Stop recording")) {
+		stop();
+	}
+}
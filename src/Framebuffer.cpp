@@ -1,4 +1,5 @@
 #include "Framebuffer.h"
+#include "FrameRecorder.h"
 #include "GraphicsUtils.h"
 #include "Texture.h"
 
@@ -8,6 +9,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 
+#include <limits>
 #include <thread>
 #include <vector>
 
@@ -90,25 +92,32 @@ void Framebuffer::destroyTextures() {
 void Framebuffer::initTextures() {
 	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 
-	destroyTextures();
-
-	for(int i = 0; i < numTextures; i++)
-	{
-		initTexture(i, bufferModes[i]);
+	// On a resize the textures stay attached and only get new images (and CPU copies from the
+	// MemoryPool) at the new resolution
+	if (!textures.empty()) {
+		for (auto& tex : textures) {
+			tex->resizeStorage();
+		}
 	}
+	else {
+		for(int i = 0; i < numTextures; i++)
+		{
+			initTexture(i, bufferModes[i]);
+		}
 
-	if (depthIndex != -1) {
-		if (numTextures == 0) {
-			initTexture(depthIndex, GBufferMode::Shadow);
+		if (depthIndex != -1) {
+			if (numTextures == 0) {
+				initTexture(depthIndex, GBufferMode::Shadow);
+			}
+			else {
+				//initTexture(depthIndex, GBufferMode::Shadow);
+				initTexture(depthIndex, GBufferMode::Depth);
+			}
 		}
-		else {
-			//initTexture(depthIndex, GBufferMode::Shadow);
-			initTexture(depthIndex, GBufferMode::Depth);
+		if (stencilIndex != -1) {
+			initTexture(stencilIndex, GBufferMode::Stencil);
 		}
 	}
-	if (stencilIndex != -1) {
-		initTexture(stencilIndex, GBufferMode::Stencil);
-	}
 
 	if (numTextures == 0 && depthIndex != -1) {
 		glDrawBuffer(GL_NONE);
@@ -366,11 +375,38 @@ void Framebuffer::clearTexture(GBufferMode mode, const vec4 & clearColor)
 void Framebuffer::resize(ivec2 newRes) {
 	if (newRes.x > 0 && newRes.y > 0 && newRes != resolution) {
 		resolution = newRes;
+		resizeResolution = newRes;
 
 		initTextures();
 	}
 }
 
+// Range and average of every channel of the texture's memory
+static std::string inspect(const s_ptr<Texture>& texture)
+{
+	if (!texture->memory) return "No memory to inspect";
+
+	double start = getTime();
+
+	std::vector<vec4> colors;
+	if (!texture->getColors(ivec4(0, 0, texture->memory->width, texture->memory->height), colors)) {
+		return "Unable to read the texture's memory";
+	}
+
+	vec4 low(std::numeric_limits<float>::max()), high(std::numeric_limits<float>::lowest());
+	dvec4 sum(0.0);
+	for (const vec4& color : colors) {
+		low = glm::min(low, color);
+		high = glm::max(high, color);
+		sum += dvec4(color);
+	}
+	dvec4 mean = sum / (double)colors.size();
+
+	return fmt::format("Min {0:.4f} {1:.4f} {2:.4f} {3:.4f}\nMax {4:.4f} {5:.4f} {6:.4f} {7:.4f}\n"
+		"Mean {8:.4f} {9:.4f} {10:.4f} {11:.4f}\n{12} texels in {13:.2f} ms", low.x, low.y, low.z, low.w,
+		high.x, high.y, high.z, high.w, mean.x, mean.y, mean.z, mean.w, colors.size(), (getTime() - start) * 1000.0);
+}
+
 void Framebuffer::renderUI(const std::string& menuTitle)
 {
 	ImGui::PushID((void*)this);
@@ -421,8 +457,41 @@ void Framebuffer::renderUI(const std::string& menuTitle)
 				{
 					GraphicsUtils::saveGBuffer(this, oc.first->attachment, texName);
 				}
+				ImGui::SameLine();
+				if (ImGui::Button("Inspect"))
+				{
+					oc.first->copyToMemory();
+					uiInspections[oc.first] = inspect(oc.first);
+				}
+				ImGui::SameLine();
+				if (!FrameRecorder::get().isRecording() && ImGui::Button("Record"))
+				{
+					FrameRecorder::get().start(oc.first);
+				}
+				else if (FrameRecorder::get().isRecording() && ImGui::Button("Stop recording"))
+				{
+					FrameRecorder::get().stop();
+				}
+
+				if (uiInspections.count(oc.first)) {
+					ImGui::TextUnformatted(uiInspections[oc.first].c_str());
+				}
 
 				ImGui::Image(my_tex_id, ImVec2(winSize.x - 100, winSize.y - 100), { 0, 1 }, { 1, 0 }, ImColor(255, 255, 255, 255), ImColor(255, 255, 255, 128));
+
+				// The texel under the mouse, as of the last inspection. The image is shown upside
+				// down, since memory rows start at the bottom.
+				if (uiInspections.count(oc.first) && ImGui::IsItemHovered())
+				{
+					ImVec2 min = ImGui::GetItemRectMin();
+					ImVec2 size = ImGui::GetItemRectSize();
+					ivec2 texel = ivec2((io.MousePos.x - min.x) / size.x * width, (1.0f - (io.MousePos.y - min.y) / size.y) * height);
+
+					std::vector<vec4> colors;
+					if (oc.first->getColors(ivec4(texel, 1, 1), colors)) {
+						ImGui::SetTooltip("(%d, %d): %.4f %.4f %.4f %.4f", texel.x, texel.y, colors[0].x, colors[0].y, colors[0].z, colors[0].w);
+					}
+				}
 				//if (ImGui::IsItemHovered())
 				//{
 				//	auto pos = ImGui::GetCursorPos();
@@ -0,0 +1,96 @@
+#include "Frustum.h"
+
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRUSTUM_SSE2
+#endif
+
+Frustum Frustum::fromMatrix(const mat4& viewProjection)
+{
+	// Rows of the matrix; glm's are columns
+	mat4 m = glm::transpose(viewProjection);
+
+	Frustum frustum;
+	frustum.planes[0] = m[3] + m[0];
+	frustum.planes[1] = m[3] - m[0];
+	frustum.planes[2] = m[3] + m[1];
+	frustum.planes[3] = m[3] - m[1];
+	frustum.planes[4] = m[3] + m[2];
+	frustum.planes[5] = m[3] - m[2];
+
+	for (vec4& plane : frustum.planes) {
+		plane /= glm::length(vec3(plane));
+	}
+
+	return frustum;
+}
+
+bool Frustum::intersectsSphere(vec3 center, float radius) const
+{
+	for (const vec4& plane : planes) {
+		if (glm::dot(vec3(plane), center) + plane.w < -radius) return false;
+	}
+	return true;
+}
+
+void SphereCuller::resize(size_t newCount)
+{
+	count = newCount;
+	size_t padded = (count + 3) / 4 * 4;
+
+	x.resize(padded);
+	y.resize(padded);
+	z.resize(padded);
+	r.resize(padded);
+
+	// An infinitely negative radius fails every plane's test
+	for (size_t i = count; i < padded; i++) {
+		x[i] = y[i] = z[i] = 0.0f;
+		r[i] = -std::numeric_limits<float>::infinity();
+	}
+}
+
+void SphereCuller::cull(const Frustum& frustum, std::vector<int>& visible) const
+{
+	visible.clear();
+
+#ifdef FRUSTUM_SSE2
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++) {
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+
+	const __m128 signBit = _mm_set1_ps(-0.f);
+
+	for (size_t i = 0; i < x.size(); i += 4) {
+		__m128 cx = _mm_loadu_ps(x.data() + i);
+		__m128 cy = _mm_loadu_ps(y.data() + i);
+		__m128 cz = _mm_loadu_ps(z.data() + i);
+		__m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(r.data() + i), signBit);
+
+		// Lanes stay set while the sphere is on the inner side of (or crosses) every plane
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, planeX[p]), _mm_mul_ps(cy, planeY[p])),
+				_mm_add_ps(_mm_mul_ps(cz, planeZ[p]), planeW[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; mask; lane++, mask >>= 1) {
+			if (mask & 1) visible.push_back((int)i + lane);
+		}
+	}
+#else
+	for (size_t i = 0; i < count; i++) {
+		if (frustum.intersectsSphere(vec3(x[i], y[i], z[i]), r[i])) {
+			visible.push_back((int)i);
+		}
+	}
+#endif
+}
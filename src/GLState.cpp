@@ -0,0 +1,99 @@
+#include "GLState.h"
+
+GLState& GLState::get()
+{
+	// Never destroyed: the sampler objects belong to the context, which is gone by then
+	static GLState* state = new GLState();
+	return *state;
+}
+
+void GLState::invalidate()
+{
+	program = unknown;
+	vertexArray = unknown;
+	activeUnit = unknown;
+
+	textures.clear();
+	samplers.clear();
+	bufferRanges.clear();
+}
+
+void GLState::useProgram(GLuint newProgram)
+{
+	if (change(program, newProgram)) {
+		glUseProgram(newProgram);
+	}
+}
+
+void GLState::bindVertexArray(GLuint newVertexArray)
+{
+	if (change(vertexArray, newVertexArray)) {
+		glBindVertexArray(newVertexArray);
+	}
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	auto bound = textures.find({ unit, target });
+	if (bound != textures.end() && bound->second == texture) {
+		stats.elided++;
+		return;
+	}
+
+	if (change(activeUnit, unit)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+
+	textures[{ unit, target }] = texture;
+	stats.issued++;
+	glBindTexture(target, texture);
+}
+
+void GLState::bindSampler(GLuint unit, GLuint sampler)
+{
+	auto bound = samplers.find(unit);
+	if (bound != samplers.end() && bound->second == sampler) {
+		stats.elided++;
+		return;
+	}
+
+	samplers[unit] = sampler;
+	stats.issued++;
+	glBindSampler(unit, sampler);
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	auto range = std::make_tuple(buffer, offset, size);
+
+	auto bound = bufferRanges.find({ target, index });
+	if (bound != bufferRanges.end() && bound->second == range) {
+		stats.elided++;
+		return;
+	}
+
+	bufferRanges[{ target, index }] = range;
+	stats.issued++;
+	glBindBufferRange(target, index, buffer, offset, size);
+}
+
+GLuint GLState::sampler(GLenum wrapS, GLenum wrapT, GLenum minFilter, GLenum magFilter)
+{
+	auto key = std::make_tuple(wrapS, wrapT, minFilter, magFilter);
+
+	auto found = samplerObjects.find(key);
+	if (found != samplerObjects.end()) return found->second;
+
+	GLuint sampler = 0;
+	glGenSamplers(1, &sampler);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, wrapS);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, wrapT);
+	glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, minFilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, magFilter);
+
+	vec4 borderColor(1.f);
+	glSamplerParameterfv(sampler, GL_TEXTURE_BORDER_COLOR, glm::value_ptr(borderColor));
+
+	samplerObjects[key] = sampler;
+	return sampler;
+}
@@ -10,7 +10,6 @@
 
 //#include <png.h>
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb/stb_image_write.h>
 
 //using namespace System;
@@ -0,0 +1,162 @@
+#include "ImageIO.h"
+
+#include "globals.h"
+#include "StringUtil.h"
+
+#include <cstdio>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
+
+namespace ImageIO
+{
+	static inline int toByte(float v)
+	{
+		return (int)(glm::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	bool writePNG(const std::string & filename, const float * pixels, int width, int height, int stride,
+		std::string * error)
+	{
+		if (!pixels || width <= 0 || height <= 0) return false;
+
+		std::vector<unsigned char> bytes((size_t)width * height * 3);
+
+		// PNG rows go top to bottom, so flip while converting
+		for (int y = 0; y < height; y++) {
+			const float * row = pixels + (size_t)(height - 1 - y) * width * stride;
+			unsigned char * out = bytes.data() + (size_t)y * width * 3;
+
+			for (int x = 0; x < width; x++) {
+				for (int c = 0; c < 3; c++) {
+					out[x * 3 + c] = (unsigned char)toByte(row[x * stride + c]);
+				}
+			}
+		}
+
+		if (!stbi_write_png(filename.c_str(), width, height, 3, bytes.data(), width * 3)) {
+			report(error, "Unable to write PNG {0}\n", filename);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool writePFM(const std::string & filename, const float * pixels, int width, int height, int stride,
+		std::string * error)
+	{
+		if (!pixels || width <= 0 || height <= 0) return false;
+
+		FILE * f = fopen(filename.c_str(), "wb");
+
+		if (!f) {
+			report(error, "Unable to open {0} for writing\n", filename);
+			return false;
+		}
+
+		// A negative scale marks the data as little-endian. PFM rows are already stored bottom to top.
+		std::string header = fmt::format("PF\n{0} {1}\n-1.0\n", width, height);
+		fwrite(header.data(), 1, header.size(), f);
+
+		std::vector<float> row((size_t)width * 3);
+
+		for (int y = 0; y < height; y++) {
+			const float * in = pixels + (size_t)y * width * stride;
+
+			for (int x = 0; x < width; x++) {
+				row[x * 3 + 0] = in[x * stride + 0];
+				row[x * 3 + 1] = in[x * stride + 1];
+				row[x * 3 + 2] = in[x * stride + 2];
+			}
+
+			fwrite(row.data(), sizeof(float), row.size(), f);
+		}
+
+		fclose(f);
+
+		return true;
+	}
+
+	bool writeImage(const std::string & filename, const float * pixels, int width, int height, int stride,
+		std::string * error)
+	{
+		std::string lowered = StringUtil::lower(filename);
+
+		if (lowered.size() > 4 && lowered.substr(lowered.size() - 4) == ".pfm") {
+			return writePFM(filename, pixels, width, height, stride, error);
+		}
+
+		return writePNG(filename, pixels, width, height, stride, error);
+	}
+
+	bool readImage(const std::string & filename, std::vector<float> & pixels, int & width, int & height)
+	{
+		DecodedImage image;
+		if (!decodeImage(filename, image, 4)) {
+			return false;
+		}
+
+		width = image.width;
+		height = image.height;
+
+		pixels.resize(image.pixels.size());
+		for (size_t i = 0; i < pixels.size(); i++) {
+			pixels[i] = image.pixels[i] / 255.0f;
+		}
+
+		return true;
+	}
+
+	bool decodeImage(const std::string & filename, DecodedImage & image, int channels, bool bottomFirst, bool keep16Bit,
+		std::string * error)
+	{
+		// The flag is per thread, so decodes running on other threads don't see it change under
+		// them. Once set it overrides stbi_set_flip_vertically_on_load for the thread, which is why
+		// every image goes through here.
+		stbi_set_flip_vertically_on_load_thread(bottomFirst);
+
+		image.bytesPerChannel = keep16Bit && stbi_is_16_bit(filename.c_str()) ? 2 : 1;
+
+		void * data = image.bytesPerChannel == 2 ?
+			(void *)stbi_load_16(filename.c_str(), &image.width, &image.height, &image.channels, channels) :
+			(void *)stbi_load(filename.c_str(), &image.width, &image.height, &image.channels, channels);
+
+		if (!data) {
+			report(error, "Unable to read image {0}: {1}\n", filename, stbi_failure_reason());
+			return false;
+		}
+
+		if (channels != 0) {
+			image.channels = channels;
+		}
+
+		const unsigned char * bytes = (const unsigned char *)data;
+		image.pixels.assign(bytes, bytes + (size_t)image.width * image.height * image.channels * image.bytesPerChannel);
+		stbi_image_free(data);
+
+		return true;
+	}
+
+	double psnr(const float * a, int strideA, const float * b, int strideB, int width, int height)
+	{
+		double sumSquared = 0.0;
+		size_t numPixels = (size_t)width * height;
+
+		for (size_t i = 0; i < numPixels; i++) {
+			for (int c = 0; c < 3; c++) {
+				int diff = toByte(a[i * strideA + c]) - toByte(b[i * strideB + c]);
+				sumSquared += diff * diff;
+			}
+		}
+
+		if (sumSquared == 0.0) {
+			return INFINITY;
+		}
+
+		double mse = sumSquared / (numPixels * 3);
+		return 10.0 * std::log10(255.0 * 255.0 / mse);
+	}
+}
@@ -0,0 +1,362 @@
+#include "JobSystem.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Index of the worker the current thread is. Threads the pool didn't start (the main thread among
+// them) count as worker 0 and share its deque.
+static thread_local int workerIndex = 0;
+
+// Jobs (and parallelFor calls) the current thread is inside of. A thread waiting on a group runs
+// other jobs inside its own, and that time is already counted by the outermost one.
+static thread_local int busyDepth = 0;
+
+template <typename F>
+static void runBusy(std::atomic<int64_t>& busyNanoseconds, F fn)
+{
+	if (busyDepth++ > 0) {
+		fn();
+		busyDepth--;
+		return;
+	}
+
+	_time start = _clock::now();
+	fn();
+	_elapsed busy = _clock::now() - start;
+	busyDepth--;
+
+	busyNanoseconds += (int64_t)(busy.count() * 1e9);
+}
+
+static void pinCurrentThread(int core)
+{
+	int numCores = glm::max(1, (int)std::thread::hardware_concurrency());
+
+#if defined(_WIN32)
+	SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (core % numCores % 64));
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core % numCores, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+JobSystem& JobSystem::get()
+{
+	static JobSystem jobSystem;
+	return jobSystem;
+}
+
+JobSystem::JobSystem()
+{
+	workers.push_back(std::make_unique<Worker>());
+}
+
+JobSystem::~JobSystem()
+{
+	stop();
+}
+
+void JobSystem::start(int numThreads, bool pinThreads)
+{
+	stop();
+
+	if (numThreads <= 0) {
+		numThreads = glm::max(1, (int)std::thread::hardware_concurrency());
+	}
+
+	// stop() left worker 0 with whatever was queued
+	for (int i = 1; i < numThreads; i++) {
+		workers.push_back(std::make_unique<Worker>());
+	}
+
+	if (pinThreads) {
+		pinCurrentThread(0);
+	}
+
+	running = true;
+	for (int i = 1; i < numThreads; i++) {
+		workers[i]->thread = std::thread(&JobSystem::workerLoop, this, i, pinThreads);
+	}
+}
+
+void JobSystem::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		running = false;
+	}
+	wake.notify_all();
+
+	for (auto& worker : workers) {
+		if (worker->thread.joinable()) {
+			worker->thread.join();
+		}
+	}
+
+	// Whatever is still queued moves to worker 0, where waiting on it runs it
+	for (size_t i = 1; i < workers.size(); i++) {
+		for (auto& job : workers[i]->jobs) {
+			workers[0]->jobs.push_back(std::move(job));
+		}
+	}
+	workers.resize(1);
+}
+
+int JobSystem::threadCount() const
+{
+	return (int)workers.size();
+}
+
+void JobSystem::push(Job job, TaskGroup* group)
+{
+	Worker& worker = *workers[workerIndex];
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.jobs.push_back({ std::move(job), group });
+	}
+
+	// The increment has to happen before the lock, or a worker could check queued and go to sleep
+	// between the two
+	queued++;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wake.notify_one();
+}
+
+bool JobSystem::runOne()
+{
+	int self = workerIndex;
+	int numWorkers = (int)workers.size();
+
+	Entry entry;
+	bool stolen = false;
+
+	{
+		Worker& own = *workers[self];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.jobs.empty()) {
+			entry = std::move(own.jobs.back());
+			own.jobs.pop_back();
+		}
+	}
+
+	for (int i = 1; !entry.job && i < numWorkers; i++) {
+		Worker& victim = *workers[(self + i) % numWorkers];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty()) {
+			entry = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			stolen = true;
+		}
+	}
+
+	if (!entry.job) {
+		return false;
+	}
+
+	run(entry, stolen);
+	return true;
+}
+
+bool JobSystem::runOne(TaskGroup* group)
+{
+	int self = workerIndex;
+	int numWorkers = (int)workers.size();
+
+	// The group's jobs can be anywhere in the deques, behind other work. Own deque from the back,
+	// others from the front, like runOne().
+	for (int i = 0; i < numWorkers; i++) {
+		Worker& worker = *workers[(self + i) % numWorkers];
+		Entry entry;
+
+		{
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			auto matches = [&](const Entry& e) { return e.group == group; };
+
+			if (i == 0) {
+				auto found = std::find_if(worker.jobs.rbegin(), worker.jobs.rend(), matches);
+				if (found != worker.jobs.rend()) {
+					entry = std::move(*found);
+					worker.jobs.erase(std::next(found).base());
+				}
+			}
+			else {
+				auto found = std::find_if(worker.jobs.begin(), worker.jobs.end(), matches);
+				if (found != worker.jobs.end()) {
+					entry = std::move(*found);
+					worker.jobs.erase(found);
+				}
+			}
+		}
+
+		if (entry.job) {
+			run(entry, i > 0);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::run(Entry& entry, bool stolen)
+{
+	queued--;
+
+	Worker& worker = *workers[workerIndex];
+	runBusy(worker.busyNanoseconds, entry.job);
+	worker.jobCount++;
+	if (stolen) {
+		worker.stealCount++;
+	}
+}
+
+void JobSystem::workerLoop(int index, bool pin)
+{
+	workerIndex = index;
+
+	if (pin) {
+		pinCurrentThread(index);
+	}
+
+	while (running) {
+		if (runOne()) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [&]() { return queued > 0 || !running; });
+	}
+}
+
+void JobSystem::parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body, int maxThreads)
+{
+	if (end <= begin) {
+		return;
+	}
+
+	grain = glm::max(grain, 1);
+	int numChunks = (end - begin + grain - 1) / grain;
+	int numThreads = glm::min(threadCount(), numChunks);
+	if (maxThreads > 0) {
+		numThreads = glm::min(numThreads, maxThreads);
+	}
+
+	std::atomic<int> next(begin);
+
+	auto work = [&]() {
+		for (int chunk = next.fetch_add(grain); chunk < end; chunk = next.fetch_add(grain)) {
+			body(chunk, glm::min(chunk + grain, end));
+		}
+	};
+
+	if (numThreads <= 1) {
+		runBusy(workers[workerIndex]->busyNanoseconds, work);
+		return;
+	}
+
+	TaskGroup group;
+	for (int i = 1; i < numThreads; i++) {
+		group.run(work);
+	}
+
+	runBusy(workers[workerIndex]->busyNanoseconds, work);
+	group.wait();
+}
+
+std::vector<JobSystem::WorkerStats> JobSystem::getStats() const
+{
+	std::vector<WorkerStats> stats;
+
+	for (auto& worker : workers) {
+		WorkerStats s;
+		s.busySeconds = worker->busyNanoseconds * 1e-9;
+		s.jobs = worker->jobCount;
+		s.steals = worker->stealCount;
+		stats.push_back(s);
+	}
+
+	return stats;
+}
+
+void JobSystem::resetStats()
+{
+	for (auto& worker : workers) {
+		worker->busyNanoseconds = 0;
+		worker->jobCount = 0;
+		worker->stealCount = 0;
+	}
+}
+
+JobSystem::TaskGroup::TaskGroup()
+{
+}
+
+JobSystem::TaskGroup::~TaskGroup()
+{
+	// The jobs still refer to the group, so they have to be done even when one of them threw
+	try {
+		wait();
+	}
+	catch (...) {
+	}
+}
+
+void JobSystem::TaskGroup::run(Job job)
+{
+	pending++;
+
+	// A job that throws still counts as finished, or wait() would never return. The exception goes
+	// to whoever waits, since nothing can catch it on a worker thread.
+	JobSystem::get().push([this, job = std::move(job)]() {
+		try {
+			job();
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!exception) exception = std::current_exception();
+		}
+		finish();
+	}, this);
+}
+
+void JobSystem::TaskGroup::finish()
+{
+	// Notified under the lock: once it's released the waiter can return and destroy the group
+	std::lock_guard<std::mutex> lock(mutex);
+	pending--;
+	done.notify_all();
+}
+
+void JobSystem::TaskGroup::wait()
+{
+	JobSystem& jobs = JobSystem::get();
+
+	while (pending > 0) {
+		if (jobs.runOne(this)) {
+			continue;
+		}
+
+		// The rest are running on other threads. They can still add jobs to the group, so it's
+		// checked again now and then rather than only when one finishes.
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait_for(lock, std::chrono::milliseconds(1), [&]() { return pending == 0; });
+	}
+
+	std::exception_ptr thrown;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::swap(thrown, exception);
+	}
+
+	if (thrown) {
+		std::rethrow_exception(thrown);
+	}
+}
@@ -0,0 +1,128 @@
+#include "MemoryPool.h"
+
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+static void* alignedAlloc(size_t size)
+{
+#if defined(_WIN32)
+	return _aligned_malloc(size, MemoryPool::alignment);
+#else
+	void* buffer = nullptr;
+	return posix_memalign(&buffer, MemoryPool::alignment, size) == 0 ? buffer : nullptr;
+#endif
+}
+
+static void alignedFree(void* buffer)
+{
+#if defined(_WIN32)
+	_aligned_free(buffer);
+#else
+	free(buffer);
+#endif
+}
+
+MemoryPool& MemoryPool::get()
+{
+	// Never destroyed, like TextureRegistry: TextureMemory owned by other statics releases its
+	// buffers on the way out
+	static MemoryPool* pool = new MemoryPool();
+	return *pool;
+}
+
+size_t MemoryPool::sizeClass(size_t size)
+{
+	if (size <= alignment) return alignment;
+
+	// The largest power of two below size, split in four steps
+	size_t power = alignment;
+	while (power * 2 < size) power *= 2;
+
+	size_t step = power / 4;
+	return (size + step - 1) / step * step;
+}
+
+void* MemoryPool::acquire(size_t size, size_t& capacity)
+{
+	capacity = 0;
+	if (size == 0) return nullptr;
+
+	size_t classSize = sizeClass(size);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto bucket = buckets.find(classSize);
+		if (bucket != buckets.end() && !bucket->second.empty()) {
+			void* buffer = bucket->second.back();
+			bucket->second.pop_back();
+
+			stats.hits++;
+			stats.pooledBytes -= classSize;
+			stats.usedBytes += classSize;
+			capacity = classSize;
+			return buffer;
+		}
+
+		stats.misses++;
+	}
+
+	void* buffer = alignedAlloc(classSize);
+	if (!buffer) {
+		log("Unable to allocate {0} bytes\n", classSize);
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.usedBytes += classSize;
+	capacity = classSize;
+	return buffer;
+}
+
+void MemoryPool::release(void* buffer, size_t capacity)
+{
+	if (!buffer) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.usedBytes -= capacity;
+
+		if (stats.pooledBytes + capacity <= maxPooledBytes) {
+			buckets[capacity].push_back(buffer);
+			stats.pooledBytes += capacity;
+			return;
+		}
+	}
+
+	alignedFree(buffer);
+}
+
+void MemoryPool::trim()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& bucket : buckets) {
+		for (void* buffer : bucket.second) {
+			alignedFree(buffer);
+		}
+	}
+
+	buckets.clear();
+	stats.pooledBytes = 0;
+}
+
+MemoryPool::Stats MemoryPool::getStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void MemoryPool::resetStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.hits = 0;
+	stats.misses = 0;
+}
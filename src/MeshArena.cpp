@@ -0,0 +1,142 @@
+#include "MeshArena.h"
+
+#include "GPU.h"
+#include "OBJMesh.h"
+
+MeshArena::~MeshArena()
+{
+	if (VAO) glDeleteVertexArrays(1, &VAO);
+	if (VBO) glDeleteBuffers(1, &VBO);
+	if (IBO) glDeleteBuffers(1, &IBO);
+}
+
+bool MeshArena::multiDrawSupported()
+{
+	return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+}
+
+void MeshArena::init(const Shader& shader)
+{
+	attributeLocations = { shader.attribute("vPosition"), shader.attribute("vNormal"), shader.attribute("texCoord"),
+		shader.attribute("vTangent"), shader.attribute("vBitangent") };
+
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &IBO);
+
+	pointAttributes();
+}
+
+void MeshArena::pointAttributes()
+{
+	struct Attribute {
+		int size;
+		size_t offset;
+	};
+
+	const Attribute attributes[] = {
+		{ 3, offsetof(OBJMeshVertex, position) },
+		{ 3, offsetof(OBJMeshVertex, normal) },
+		{ 2, offsetof(OBJMeshVertex, texCoord) },
+		{ 3, offsetof(OBJMeshVertex, tangent) },
+		{ 3, offsetof(OBJMeshVertex, bitangent) },
+	};
+
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+	for (size_t i = 0; i < attributeLocations.size(); i++) {
+		GLint location = attributeLocations[i];
+		if (location < 0) continue;
+
+		glVertexAttribPointer(location, attributes[i].size, GL_FLOAT, GL_FALSE, sizeof(OBJMeshVertex),
+			(const void*)attributes[i].offset);
+		glEnableVertexAttribArray(location);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshArena::reserve(GLuint& buffer, size_t& capacity, size_t used, size_t needed)
+{
+	if (needed <= capacity) return;
+
+	size_t newCapacity = glm::max<size_t>(capacity * 2, 64 * 1024);
+	while (newCapacity < needed) newCapacity *= 2;
+
+	GLuint newBuffer = 0;
+	glGenBuffers(1, &newBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, nullptr, GL_STATIC_DRAW);
+
+	if (used > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glDeleteBuffers(1, &buffer);
+	buffer = newBuffer;
+	capacity = newCapacity;
+}
+
+int MeshArena::add(const OBJMeshVertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount)
+{
+	size_t newVertexBytes = vertexCount * sizeof(OBJMeshVertex);
+	size_t newIndexBytes = indexCount * sizeof(GLuint);
+
+	GLuint oldVBO = VBO, oldIBO = IBO;
+	reserve(VBO, vertexCapacity, vertexBytes, vertexBytes + newVertexBytes);
+	reserve(IBO, indexCapacity, indexBytes, indexBytes + newIndexBytes);
+
+	// The VAO still points at the buffers that were replaced
+	if (VBO != oldVBO || IBO != oldIBO) {
+		pointAttributes();
+	}
+
+	Range range;
+	range.firstIndex = (GLuint)(indexBytes / sizeof(GLuint));
+	range.indexCount = (GLuint)indexCount;
+	range.baseVertex = (GLint)(vertexBytes / sizeof(OBJMeshVertex));
+	range.vertexCount = (GLuint)vertexCount;
+
+	// Indices stay relative to the mesh's own vertices; baseVertex moves them
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, vertexBytes, newVertexBytes, vertices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, IBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, indexBytes, newIndexBytes, indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	vertexBytes += newVertexBytes;
+	indexBytes += newIndexBytes;
+
+	ranges.push_back(range);
+	return (int)ranges.size() - 1;
+}
+
+DrawElementsIndirectCommand MeshArena::command(int mesh, GLuint instanceCount, GLuint baseInstance) const
+{
+	DrawElementsIndirectCommand command;
+	const Range& range = ranges[mesh];
+	command.count = range.indexCount;
+	command.instanceCount = instanceCount;
+	command.firstIndex = range.firstIndex;
+	command.baseVertex = range.baseVertex;
+	command.baseInstance = baseInstance;
+	return command;
+}
+
+size_t MeshArena::usedBytes() const
+{
+	return vertexBytes + indexBytes;
+}
+
+size_t MeshArena::capacityBytes() const
+{
+	return vertexCapacity + indexCapacity;
+}
@@ -0,0 +1,494 @@
+#include "MipChain.h"
+
+#include "JobSystem.h"
+#include "StringUtil.h"
+#include "TextureFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIP_SSE2
+#endif
+
+std::string MipChain::cacheDirectory = "cache/mips";
+
+// Bumped whenever the filters or the encoders change, so chains built by older code aren't used
+static const uint32_t cacheVersion = 4;
+
+// The Kaiser filter's taps: a sinc cut off at half the source's sampling rate, windowed over 3
+// source texels on either side of the destination texel's center
+static const int kaiserTaps = 6;
+static const float kaiserAlpha = 4.f;
+
+MipSettings MipSettings::forRole(TextureRole role)
+{
+	MipSettings settings;
+	settings.role = role;
+	settings.srgb = role == +TextureRole::Albedo;
+	settings.normalMap = role == +TextureRole::Normal;
+	settings.heightMap = role == +TextureRole::Height || role == +TextureRole::Displacement;
+	return settings;
+}
+
+MipSettings MipSettings::forFile(const std::string& filename)
+{
+	std::string name = std::filesystem::path(filename).filename().string();
+	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+	auto nameHas = [&](std::initializer_list<const char*> words) {
+		for (const char* word : words) {
+			if (StringUtil::contains(name, word)) return true;
+		}
+		return false;
+	};
+
+	TextureRole role = TextureRole::Albedo;
+	if (nameHas({ "normal", "nrm" })) role = TextureRole::Normal;
+	else if (nameHas({ "disp" })) role = TextureRole::Displacement;
+	else if (nameHas({ "height", "bump" })) role = TextureRole::Height;
+	else if (nameHas({ "rough", "metal", "gloss", "occlusion" })) role = TextureRole::Data;
+
+	return forRole(role);
+}
+
+// How one channel is stored in the 8-bit levels
+enum class ChannelEncoding { Linear, Srgb, Normal };
+
+struct ChannelTables {
+	// Byte to the value filters work on
+	float decode[256];
+
+	// For sRGB: the linear value halfway between each pair of neighbouring bytes, so encoding can
+	// find the nearest byte with a binary search instead of a pow per channel
+	float midpoints[255];
+};
+
+static float srgbToLinear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static std::vector<ChannelTables> makeTables()
+{
+	std::vector<ChannelTables> tables(3);
+
+	for (int i = 0; i < 256; i++) {
+		tables[(int)ChannelEncoding::Linear].decode[i] = i / 255.f;
+		tables[(int)ChannelEncoding::Srgb].decode[i] = srgbToLinear(i / 255.f);
+		tables[(int)ChannelEncoding::Normal].decode[i] = i / 255.f * 2.f - 1.f;
+	}
+
+	for (int i = 0; i < 255; i++) {
+		tables[(int)ChannelEncoding::Srgb].midpoints[i] = srgbToLinear((i + 0.5f) / 255.f);
+	}
+
+	return tables;
+}
+
+static const ChannelTables& getTables(ChannelEncoding encoding)
+{
+	static const std::vector<ChannelTables> tables = makeTables();
+	return tables[(int)encoding];
+}
+
+static unsigned char encodeChannel(float value, ChannelEncoding encoding)
+{
+	if (encoding == ChannelEncoding::Srgb) {
+		const float* midpoints = getTables(encoding).midpoints;
+		return (unsigned char)(std::upper_bound(midpoints, midpoints + 255, value) - midpoints);
+	}
+
+	if (encoding == ChannelEncoding::Normal) {
+		value = value * 0.5f + 0.5f;
+	}
+
+	return (unsigned char)(glm::clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+static int wrap(int i, int size)
+{
+	i %= size;
+	return i < 0 ? i + size : i;
+}
+
+// Rows per job, so small levels don't get split into jobs that cost more to hand out than to run
+static int rowGrain(int width)
+{
+	return glm::max(1, 16384 / glm::max(width, 1));
+}
+
+// An RGBA float image the filters read and write, 4 floats per texel
+struct LinearImage {
+	int width = 0;
+	int height = 0;
+	std::vector<float> texels;
+
+	void resize(int w, int h)
+	{
+		width = w;
+		height = h;
+		texels.assign((size_t)w * h * 4, 0.f);
+	}
+
+	float* at(int x, int y) { return texels.data() + ((size_t)y * width + x) * 4; }
+	const float* at(int x, int y) const { return texels.data() + ((size_t)y * width + x) * 4; }
+};
+
+// dst = sum of weights[i] * src[i] over n texels
+static inline void weightedSum(float* dst, const float* const* src, const float* weights, int n)
+{
+#ifdef MIP_SSE2
+	__m128 sum = _mm_setzero_ps();
+	for (int i = 0; i < n; i++) {
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src[i]), _mm_set1_ps(weights[i])));
+	}
+	_mm_storeu_ps(dst, sum);
+#else
+	for (int c = 0; c < 4; c++) {
+		float sum = 0.f;
+		for (int i = 0; i < n; i++) {
+			sum += src[i][c] * weights[i];
+		}
+		dst[c] = sum;
+	}
+#endif
+}
+
+static void boxDownsample(const LinearImage& src, LinearImage& dst)
+{
+	static const float weights[4] = { 0.25f, 0.25f, 0.25f, 0.25f };
+
+	JobSystem::get().parallelFor(0, dst.height, rowGrain(dst.width), [&](int begin, int end) {
+		for (int y = begin; y < end; y++) {
+			int y0 = glm::min(2 * y, src.height - 1), y1 = glm::min(2 * y + 1, src.height - 1);
+
+			for (int x = 0; x < dst.width; x++) {
+				int x0 = glm::min(2 * x, src.width - 1), x1 = glm::min(2 * x + 1, src.width - 1);
+
+				const float* texels[4] = { src.at(x0, y0), src.at(x1, y0), src.at(x0, y1), src.at(x1, y1) };
+				weightedSum(dst.at(x, y), texels, weights, 4);
+			}
+		}
+	});
+}
+
+static float besselI0(float x)
+{
+	// Power series, plenty of terms for the arguments the window uses
+	float sum = 1.f, term = 1.f;
+	for (int k = 1; k < 16; k++) {
+		term *= (x / (2.f * k)) * (x / (2.f * k));
+		sum += term;
+	}
+	return sum;
+}
+
+static std::vector<float> makeKaiserWeights()
+{
+	std::vector<float> weights(kaiserTaps);
+	float radius = kaiserTaps / 2.f, total = 0.f;
+
+	for (int t = 0; t < kaiserTaps; t++) {
+		// Distance from the destination texel's center, in source texels
+		float d = t - radius + 0.5f;
+		float x = d * 0.5f;
+		float sinc = std::sin(glm::pi<float>() * x) / (glm::pi<float>() * x);
+		float r = d / radius;
+		float window = besselI0(kaiserAlpha * std::sqrt(glm::max(0.f, 1.f - r * r))) / besselI0(kaiserAlpha);
+
+		weights[t] = sinc * window;
+		total += weights[t];
+	}
+
+	for (float& weight : weights) {
+		weight /= total;
+	}
+
+	return weights;
+}
+
+static const float* getKaiserWeights()
+{
+	static const std::vector<float> weights = makeKaiserWeights();
+	return weights.data();
+}
+
+// Separable: filters the rows into a half-width image, then its columns. Taps past the edges wrap
+// around like GL_REPEAT.
+static void kaiserDownsample(const LinearImage& src, LinearImage& dst)
+{
+	const float* weights = getKaiserWeights();
+	const int firstTap = 1 - kaiserTaps / 2;
+
+	LinearImage rows;
+	rows.resize(dst.width, src.height);
+
+	JobSystem::get().parallelFor(0, src.height, rowGrain(dst.width), [&](int begin, int end) {
+		const float* texels[kaiserTaps];
+
+		for (int y = begin; y < end; y++) {
+			for (int x = 0; x < dst.width; x++) {
+				for (int t = 0; t < kaiserTaps; t++) {
+					texels[t] = src.at(wrap(2 * x + firstTap + t, src.width), y);
+				}
+				weightedSum(rows.at(x, y), texels, weights, kaiserTaps);
+			}
+		}
+	});
+
+	JobSystem::get().parallelFor(0, dst.height, rowGrain(dst.width), [&](int begin, int end) {
+		const float* texels[kaiserTaps];
+
+		for (int y = begin; y < end; y++) {
+			for (int x = 0; x < dst.width; x++) {
+				for (int t = 0; t < kaiserTaps; t++) {
+					texels[t] = rows.at(x, wrap(2 * y + firstTap + t, src.height));
+				}
+				weightedSum(dst.at(x, y), texels, weights, kaiserTaps);
+			}
+		}
+	});
+}
+
+static BlockFormat chooseFormat(MipSettings settings, int channels)
+{
+	if (settings.normalMap && channels >= 3) return BlockFormat::BC5;
+	if (settings.heightMap || channels == 1) return BlockFormat::BC4;
+	if (channels == 2 || channels == 4) return BlockFormat::BC7;
+	return BlockFormat::BC1;
+}
+
+void MipChain::build(ImageIO::DecodedImage image, MipSettings settings)
+{
+	levels.clear();
+	format = BlockFormat::None;
+
+	int channels = image.channels;
+
+	// 16-bit images (height maps) are linear
+	int bytesPerChannel = image.bytesPerChannel;
+	bool wide = bytesPerChannel == 2;
+
+	ChannelEncoding encodings[4];
+	for (int c = 0; c < 4; c++) {
+		encodings[c] = ChannelEncoding::Linear;
+		if (c < 3 && channels >= 3 && settings.normalMap) encodings[c] = ChannelEncoding::Normal;
+		else if (c < 3 && channels >= 3 && settings.srgb) encodings[c] = ChannelEncoding::Srgb;
+	}
+
+	LinearImage current, next;
+	current.resize(image.width, image.height);
+
+	JobSystem::get().parallelFor(0, image.height, rowGrain(image.width), [&](int begin, int end) {
+		for (size_t i = (size_t)begin * image.width; i < (size_t)end * image.width; i++) {
+			for (int c = 0; c < channels; c++) {
+				if (wide) {
+					current.texels[i * 4 + c] = ((const uint16_t*)image.pixels.data())[i * channels + c] / 65535.f;
+				}
+				else {
+					current.texels[i * 4 + c] = getTables(encodings[c]).decode[image.pixels[i * channels + c]];
+				}
+			}
+		}
+	});
+
+	levels.push_back(std::move(image));
+
+	while (current.width > 1 || current.height > 1) {
+		next.resize(glm::max(1, current.width / 2), glm::max(1, current.height / 2));
+
+		if (settings.filter == +MipFilter::Kaiser) {
+			kaiserDownsample(current, next);
+		}
+		else {
+			boxDownsample(current, next);
+		}
+
+		ImageIO::DecodedImage level;
+		level.width = next.width;
+		level.height = next.height;
+		level.channels = channels;
+		level.bytesPerChannel = bytesPerChannel;
+		level.pixels.resize((size_t)level.width * level.height * channels * bytesPerChannel);
+
+		JobSystem::get().parallelFor(0, level.height, rowGrain(level.width), [&](int begin, int end) {
+			for (size_t i = (size_t)begin * level.width; i < (size_t)end * level.width; i++) {
+				float* texel = next.texels.data() + i * 4;
+
+				if (encodings[0] == ChannelEncoding::Normal) {
+					vec3 normal = vec3(texel[0], texel[1], texel[2]);
+					float length = glm::length(normal);
+					normal = length > 0.f ? normal / length : vec3(0.f, 0.f, 1.f);
+					texel[0] = normal.x;
+					texel[1] = normal.y;
+					texel[2] = normal.z;
+				}
+
+				for (int c = 0; c < channels; c++) {
+					if (wide) {
+						((uint16_t*)level.pixels.data())[i * channels + c] = (uint16_t)std::lround(glm::clamp(texel[c], 0.f, 1.f) * 65535.f);
+					}
+					else {
+						level.pixels[i * channels + c] = encodeChannel(texel[c], encodings[c]);
+					}
+				}
+			}
+		});
+
+		levels.push_back(std::move(level));
+		std::swap(current, next);
+	}
+
+	if (settings.compress) {
+		format = chooseFormat(settings, channels);
+		for (auto& level : levels) {
+			level.pixels = BlockCompression::encode(level, format);
+			level.bytesPerChannel = 1;
+		}
+	}
+}
+
+void MipChain::decompress()
+{
+	if (format == +BlockFormat::None) return;
+
+	for (auto& level : levels) {
+		ImageIO::DecodedImage decoded = BlockCompression::decode(level.pixels.data(), level.width, level.height, format);
+
+		// BC5 only holds the x and y of normal maps. Rebuilding z gives back the RGB image
+		// everything else expects.
+		if (format == +BlockFormat::BC5) {
+			ImageIO::DecodedImage normals;
+			normals.width = decoded.width;
+			normals.height = decoded.height;
+			normals.channels = 3;
+			normals.pixels.resize((size_t)normals.width * normals.height * 3);
+
+			for (size_t i = 0; i < (size_t)normals.width * normals.height; i++) {
+				float x = decoded.pixels[i * 2] / 127.5f - 1.f;
+				float y = decoded.pixels[i * 2 + 1] / 127.5f - 1.f;
+				float z = std::sqrt(glm::max(0.f, 1.f - x * x - y * y));
+
+				normals.pixels[i * 3] = decoded.pixels[i * 2];
+				normals.pixels[i * 3 + 1] = decoded.pixels[i * 2 + 1];
+				normals.pixels[i * 3 + 2] = encodeChannel(z, ChannelEncoding::Normal);
+			}
+
+			decoded = std::move(normals);
+		}
+
+		level = std::move(decoded);
+	}
+
+	format = BlockFormat::None;
+}
+
+// Copies the levels out of a texture file
+static void readTextureFile(const TextureFile& file, MipChain& chain)
+{
+	chain.format = file.format;
+	chain.levels.resize(file.levels.size());
+
+	for (size_t l = 0; l < file.levels.size(); l++) {
+		ImageIO::DecodedImage& level = chain.levels[l];
+		level.width = file.levels[l].width;
+		level.height = file.levels[l].height;
+		level.channels = file.channels;
+		level.bytesPerChannel = file.bytesPerChannel;
+		level.pixels.assign(file.levels[l].data, file.levels[l].data + file.levels[l].size);
+	}
+}
+
+// What a cache file was built from, kept as the texture file's source. A cached chain is only used
+// if all of it still matches.
+static bool getCacheKey(const std::string& filename, MipSettings settings, std::string& key)
+{
+	std::error_code error;
+	auto path = std::filesystem::absolute(filename, error);
+	auto size = std::filesystem::file_size(filename, error);
+	auto modified = std::filesystem::last_write_time(filename, error);
+
+	if (error) return false;
+
+	int flags = settings.filter._to_integral() | (settings.srgb ? 4 : 0) | (settings.normalMap ? 8 : 0) |
+		(settings.heightMap ? 16 : 0) | (settings.compress ? 32 : 0);
+
+	key = fmt::format("{0}\n{1}\n{2}\n{3}\n{4}", cacheVersion, path.string(), size,
+		(int64_t)modified.time_since_epoch().count(), flags);
+
+	return true;
+}
+
+static std::string getCacheFile(const std::string& key)
+{
+	// FNV-1a over the key. The file keeps the whole key, so collisions only cost a rebuild.
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : key) {
+		hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+	}
+
+	return (std::filesystem::path(MipChain::cacheDirectory) / fmt::format("{0:016x}{1}", hash, TextureFile::extension)).string();
+}
+
+bool MipChain::load(const std::string& filename, MipSettings settings, std::string* error, TextureFile* mapped)
+{
+	levels.clear();
+
+	if (TextureFile::isTextureFile(filename)) {
+		TextureFile local;
+		TextureFile& file = mapped ? *mapped : local;
+		if (!file.open(filename, error)) {
+			return false;
+		}
+
+		if (mapped && (settings.compress || file.format == +BlockFormat::None)) {
+			format = file.format;
+			return true;
+		}
+
+		readTextureFile(file, *this);
+		file.close();
+		if (!settings.compress) {
+			decompress();
+		}
+		return true;
+	}
+
+	std::string key;
+	bool cacheable = !cacheDirectory.empty() && getCacheKey(filename, settings, key);
+
+	std::string cacheFile = cacheable ? getCacheFile(key) : "";
+	if (cacheable && std::filesystem::exists(cacheFile)) {
+		// A cache file that can't be used is rebuilt, which is no reason to complain
+		std::string ignored;
+		TextureFile local;
+		TextureFile& file = mapped ? *mapped : local;
+		if (file.open(cacheFile, &ignored) && file.source == key) {
+			format = file.format;
+			if (!mapped) {
+				readTextureFile(file, *this);
+			}
+			return true;
+		}
+		file.close();
+	}
+
+	// Height maps only need their first channel, and keep 16 bits of it where the file has them
+	ImageIO::DecodedImage image;
+	if (!ImageIO::decodeImage(filename, image, settings.heightMap ? 1 : 0, true, settings.heightMap, error)) {
+		return false;
+	}
+
+	build(std::move(image), settings);
+
+	if (cacheable) {
+		std::error_code directoryError;
+		std::filesystem::create_directories(cacheDirectory, directoryError);
+		TextureFile::write(cacheFile, *this, key, error);
+	}
+
+	return true;
+}
@@ -6,9 +6,11 @@
 #include "Input.h"
 #include "InputOutput.h"
 #include "Texture.h"
+#include "TextureLoader.h"
 #include "Prompts.h"
 #include "Properties.h"
 #include "Tool.h"
+#include "UIHelpers.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -80,8 +82,9 @@ void OpenGLRenderer::init()
 			sr->resolution = ivec2(newWidth, newHeight);
 			sr->viewport = ivec4(0, 0, newWidth, newHeight);
 			if (sr->lockResolutionToWindow) {
-				//ogl->gbuffer = std::make_shared<Framebuffer> (newWidth, newHeight);
-				sr->gbuffer = std::make_shared<Framebuffer>(newWidth, newHeight, 2, std::vector<GBufferMode>{ GBufferMode::Rendered, GBufferMode::Rendered });
+				// Resizing keeps the framebuffer and its textures, which saves recreating them for
+				// every size the window passes through
+				sr->gbuffer->resize(ivec2(newWidth, newHeight));
 			}
 			sr->refresh = true;
 		}
@@ -186,12 +189,28 @@ void OpenGLRenderer::renderUI()
 			if (ImGui::Button("Load new texture")) {
 				auto texFile = Util::LoadFile({ "Common image files (.jpg .png .bmp .gif)", "*.jpg *.png *.bmp *.gif", "All files (*)", "*" }, ".");
 				if (texFile != "") {
-					if (s_ptr<Texture> t = std::make_shared<Texture>(texFile)) {
+					if (s_ptr<Texture> t = TextureLoader::get().load(texFile)) {
 						textures[t->id] = t;
 					}
 				}
 			}
 
+			// The storage policy applies to textures loaded from here on; reloading brings the
+			// loaded ones in line
+			if (ImGui::TreeNode("Storage by role")) {
+				for (auto& policy : Texture::storagePolicy) {
+					renderEnumDropDown<TextureStorage>(policy.first._to_string(), policy.second);
+				}
+				if (ImGui::Button("Reload textures")) {
+					for (auto& t : textures) {
+						if (t.second->filename.empty() || !t.second->isReady()) continue;
+						t.second->settings = Texture::getSettings(t.second->filename);
+						TextureLoader::get().reload(t.second, 0);
+					}
+				}
+				ImGui::TreePop();
+			}
+
 			for (auto& t : textures) {
 				t.second->renderUI();
 			}
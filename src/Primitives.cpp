@@ -1,5 +1,10 @@
 #include "Primitives.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MICRO_TRIANGLE_SSE2
+#endif
+
 Sphere Sphere::instance;
 
 void renderLineParametric(const Line& line, float* pixels, int stride, int width, int height) {
@@ -155,7 +160,174 @@ void renderTriangleBoundingBox(Triangle& tri, float* pixels, int stride, int wid
 	}
 }
 
+RasterSetup classifyTriangle(const Triangle& tri, int width, int height) {
+	vec2 min = vec2(tri.vertices[0].position);
+	vec2 max = min;
+
+	for (int i = 1; i < 3; i++) {
+		min = glm::min(min, vec2(tri.vertices[i].position));
+		max = glm::max(max, vec2(tri.vertices[i].position));
+	}
+
+	// First and last sample inside the bounding box, clipped to the screen
+	vec2 first = glm::ceil(glm::max(min, vec2(0.f)));
+	vec2 last = glm::floor(glm::min(max, vec2(width - 1, height - 1)));
+
+	RasterSetup setup;
+
+	// Written so that NaN positions are culled too
+	if (!(first.x <= last.x && first.y <= last.y)) {
+		setup.path = RasterPath::Culled;
+	}
+	else {
+		setup.sample = ivec2(first);
+		setup.samples = ivec2(last - first) + 1;
+		setup.path = (setup.samples.x <= 2 && setup.samples.y <= 2) ? RasterPath::Micro : RasterPath::BoundingBox;
+	}
+
+	return setup;
+}
+
+void MicroTriangleBatch::add(Triangle& tri, ivec2 sample, float* pixel) {
+	triangles[count] = &tri;
+	pixels[count] = pixel;
+
+	x0[count] = tri.vertices[0].position.x;
+	y0[count] = tri.vertices[0].position.y;
+	x1[count] = tri.vertices[1].position.x;
+	y1[count] = tri.vertices[1].position.y;
+	x2[count] = tri.vertices[2].position.x;
+	y2[count] = tri.vertices[2].position.y;
+	sampleX[count] = float(sample.x);
+	sampleY[count] = float(sample.y);
+
+	count++;
+}
+
+void MicroTriangleBatch::flush() {
+	if (count == 0) return;
+
+	alignas(16) float b0[Size], b1[Size], b2[Size];
+	int inside = 0;
+
+#ifdef MICRO_TRIANGLE_SSE2
+	// Unused lanes would otherwise hold stale values
+	for (int i = count; i < Size; i++) {
+		x0[i] = y0[i] = x1[i] = y1[i] = x2[i] = y2[i] = sampleX[i] = sampleY[i] = 0.f;
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 signBit = _mm_set1_ps(-0.f);
+
+	// Same steps, in the same order, as Triangle::barycentric and Triangle::baryInTriangle so the
+	// results are identical: solve P - p0 = R * L with R's inverse, then check the weights.
+	for (int i = 0; i < Size; i += 4) {
+		__m128 px0 = _mm_load_ps(x0 + i), py0 = _mm_load_ps(y0 + i);
+
+		__m128 e1x = _mm_sub_ps(_mm_load_ps(x1 + i), px0);
+		__m128 e1y = _mm_sub_ps(_mm_load_ps(y1 + i), py0);
+		__m128 e2x = _mm_sub_ps(_mm_load_ps(x2 + i), px0);
+		__m128 e2y = _mm_sub_ps(_mm_load_ps(y2 + i), py0);
+
+		__m128 Px = _mm_sub_ps(_mm_load_ps(sampleX + i), px0);
+		__m128 Py = _mm_sub_ps(_mm_load_ps(sampleY + i), py0);
+
+		__m128 oneOverDet = _mm_div_ps(one, _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e2x, e1y)));
+
+		__m128 Lx = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(e2y, oneOverDet), Px),
+			_mm_mul_ps(_mm_mul_ps(_mm_xor_ps(e2x, signBit), oneOverDet), Py));
+		__m128 Ly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_xor_ps(e1y, signBit), oneOverDet), Px),
+			_mm_mul_ps(_mm_mul_ps(e1x, oneOverDet), Py));
+		__m128 L0 = _mm_sub_ps(_mm_sub_ps(one, Lx), Ly);
+
+		__m128 outside = _mm_or_ps(_mm_cmplt_ps(L0, zero), _mm_cmpgt_ps(L0, one));
+		outside = _mm_or_ps(outside, _mm_or_ps(_mm_cmplt_ps(Lx, zero), _mm_cmpgt_ps(Lx, one)));
+		outside = _mm_or_ps(outside, _mm_or_ps(_mm_cmplt_ps(Ly, zero), _mm_cmpgt_ps(Ly, one)));
+
+		__m128 sum = _mm_add_ps(_mm_add_ps(L0, Lx), Ly);
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(sum, _mm_set1_ps(0.99f)));
+		outside = _mm_or_ps(outside, _mm_cmpgt_ps(sum, _mm_set1_ps(1.01f)));
+
+		_mm_store_ps(b0 + i, L0);
+		_mm_store_ps(b1 + i, Lx);
+		_mm_store_ps(b2 + i, Ly);
+
+		inside |= (~_mm_movemask_ps(outside) & 0xF) << i;
+	}
+#else
+	for (int i = 0; i < count; i++) {
+		vec3 bary = triangles[i]->barycentric(vec3(sampleX[i], sampleY[i], 0));
+		b0[i] = bary[0];
+		b1[i] = bary[1];
+		b2[i] = bary[2];
+
+		if (triangles[i]->baryInTriangle(bary)) {
+			inside |= 1 << i;
+		}
+	}
+#endif
+
+	for (int i = 0; i < count; i++) {
+		if (!(inside & (1 << i))) continue;
+
+		Triangle& tri = *triangles[i];
+		Vertex interpolated = tri.computeFromBarycentric(vec3(b0[i], b1[i], b2[i]));
+		vec4* pixel = (vec4*)pixels[i];
+
+		if (interpolated.position.z < pixel->w) {
+			*pixel = vec4(tri.color * interpolated.color, interpolated.position.z);
+		}
+	}
+
+	count = 0;
+}
+
 void renderIcosphere(Icosphere& ico, float* pixels, int stride, int width, int height, bool useColors) {
+	std::vector<Triangle> triangles;
+	appendIcosphereTriangles(ico, triangles, useColors);
+
+	for (auto& tri : triangles) {
+		renderTriangleBoundingBox(tri, pixels, stride, width, height);
+	}
+}
+
+vec3 WorldToScreen(vec3 world, mat4 modelview, mat4 projection, int viewportWidth, int viewportHeight)
+{
+	vec3 projected = glm::project(world, modelview, projection, vec4(0, 0, viewportWidth, viewportHeight));
+	return projected;
+}
+
+void renderSphere(mat4 model, mat4 view, mat4 projection, vec3 color, float* pixels, int stride, int width, int height, vec3* lightSource) {
+	std::vector<Triangle> triangles;
+	appendSphereTriangles(model, view, projection, color, width, height, triangles, lightSource);
+
+	for (auto& tri : triangles) {
+		renderTriangleBoundingBox(tri, pixels, stride, width, height);
+	}
+}
+
+void transformIcosphere(Icosphere& ico, const mat4& M) {
+	vec2 zRange = vec2(0.0f);
+
+	for (auto& pos : ico.positions) {
+		vec4 p(pos.x, pos.y, pos.z, 1);
+		p = M * p;
+		pos = vec3(p);
+
+		zRange.x = glm::min(zRange.x, pos.z);
+		zRange.y = glm::max(zRange.y, pos.z);
+	}
+
+	// Renormalize the z-values so that they are all between 0 (closest, minimum depth) and 1 (farthest, maximum depth)
+	float zDist = zRange.y - zRange.x - 1e-4f;
+
+	for (auto& pos : ico.positions) {
+		pos.z = 1e-4f + (pos.z - zRange.x) / zDist;
+	}
+}
+
+void appendIcosphereTriangles(const Icosphere& ico, std::vector<Triangle>& triangles, bool useColors) {
 	for (auto& triangleIndices : ico.indices) {
 		Triangle tri;
 
@@ -166,8 +338,59 @@ void renderIcosphere(Icosphere& ico, float* pixels, int stride, int width, int h
 			if (useColors) {
 				tri.vertices[i].color *= ico.colors[triangleIndices[i]];
 			}
-		}	
+		}
 
-		renderTriangleBoundingBox(tri, pixels, stride, width, height);
+		triangles.push_back(tri);
+	}
+}
+
+// Projects one object-space triangle to the screen. Lighting uses the face normal in object space,
+// moved into world space by the model matrix.
+static Triangle projectTriangle(const vec3 (&p)[3], const mat4& model, const mat4& modelview, const mat4& projection,
+	vec3 color, int width, int height, const vec3* lightSource) {
+	Triangle tri;
+
+	for (int i = 0; i < 3; i++) {
+		tri.vertices[i].position = WorldToScreen(p[i], modelview, projection, width, height);
+		tri.vertices[i].color = color;
+	}
+
+	if (lightSource) {
+		vec3 N = glm::normalize(glm::cross(p[2] - p[0], p[1] - p[0]));
+
+		N = model * vec4(N, 0);
+
+		for (int i = 0; i < 3; i++) {
+			vec3 worldPos = model * vec4(p[i], 1);
+			vec3 L = glm::normalize(worldPos - *lightSource);
+			tri.vertices[i].color = color * glm::dot(N, L);
+		}
+	}
+
+	return tri;
+}
+
+void appendMeshTriangles(const vec3* positions, const unsigned int* indices, size_t numIndices,
+	mat4 model, mat4 view, mat4 projection, vec3 color, int width, int height,
+	std::vector<Triangle>& triangles, const vec3* lightSource) {
+	mat4 modelview = view * model;
+
+	for (size_t i = 0; i + 2 < numIndices; i += 3) {
+		vec3 p[3] = { positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]] };
+		triangles.push_back(projectTriangle(p, model, modelview, projection, color, width, height, lightSource));
+	}
+}
+
+void appendSphereTriangles(mat4 model, mat4 view, mat4 projection, vec3 color, int width, int height,
+	std::vector<Triangle>& triangles, const vec3* lightSource) {
+	mat4 modelview = view * model;
+
+	for (auto& triangleIndices : Sphere::instance.indices) {
+		vec3 p[3];
+		for (int i = 0; i < 3; i++) {
+			p[i] = Sphere::instance.positions[triangleIndices[i]];
+		}
+
+		triangles.push_back(projectTriangle(p, model, modelview, projection, color, width, height, lightSource));
 	}
 }
\ No newline at end of file
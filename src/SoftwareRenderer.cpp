@@ -71,8 +71,9 @@ void SoftwareRenderer::init()
 			sr->resolution = ivec2(newWidth, newHeight);
 			sr->viewport = ivec4(0, 0, newWidth, newHeight);
 			if (sr->lockResolutionToWindow) {
-				//ogl->gbuffer = std::make_shared<Framebuffer> (newWidth, newHeight);
-				sr->gbuffer = std::make_shared<Framebuffer>(newWidth, newHeight, 2, std::vector<GBufferMode>{ GBufferMode::Rendered, GBufferMode::Rendered });
+				// Resizing keeps the framebuffer and its textures, which saves recreating them for
+				// every size the window passes through
+				sr->gbuffer->resize(ivec2(newWidth, newHeight));
 			}
 			sr->refresh = true;
 		}
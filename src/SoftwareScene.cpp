@@ -0,0 +1,776 @@
+#include "SoftwareScene.h"
+
+#include "InputOutput.h"
+#include "JobSystem.h"
+#include "OBJMesh.h"
+#include "Texture.h"
+
+#include <functional>
+#include <map>
+#include <random>
+
+// Reads a vector that is either written as an array ([1, 2, 3]) or as an object ({"x": 1, ...})
+template <int L>
+static glm::vec<L, float> readVec(const json & j, const char * key, const glm::vec<L, float> & fallback)
+{
+	if (!j.contains(key)) return fallback;
+
+	const json & value = j.at(key);
+	glm::vec<L, float> result = fallback;
+
+	if (value.is_array()) {
+		for (int i = 0; i < L && i < (int)value.size(); i++) {
+			result[i] = value[i].get<float>();
+		}
+	}
+	else {
+		value.get_to(result);
+	}
+
+	return result;
+}
+
+static Transform2D readTransform(const json & j)
+{
+	Transform2D transform;
+	transform.translation = readVec<3>(j, "translation", transform.translation);
+	transform.rotation = readVec<4>(j, "rotation", transform.rotation);
+	transform.scale = readVec<3>(j, "scale", transform.scale);
+
+	if (j.contains("axis")) {
+		transform.axis = RotationAxis::_from_string_nocase(j["axis"].get<std::string>().c_str());
+	}
+
+	return transform;
+}
+
+// Runs job(0) to job(count - 1) on at most numThreads of the JobSystem's threads (the calling one
+// included). Jobs are handed out one at a time, so threads that get cheap jobs simply take more of them.
+static void runJobs(int count, int numThreads, const std::function<void(int)> & job)
+{
+	JobSystem::get().parallelFor(0, count, 1, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			job(i);
+		}
+	}, numThreads);
+}
+
+// Twice the signed area of the triangle with edges a and b
+static float cross2(vec2 a, vec2 b)
+{
+	return a.x * b.y - a.y * b.x;
+}
+
+// Square tiles of size pixels covering an image of the given resolution, numbered row by row
+static ivec2 getTileCount(ivec2 resolution, int size)
+{
+	return (resolution + size - 1) / size;
+}
+
+// Pixels of a tile as (x0, y0, x1, y1), ends exclusive
+static ivec4 getTileRect(int tile, ivec2 resolution, int size)
+{
+	ivec2 tileCount = getTileCount(resolution, size);
+	ivec2 first = ivec2(tile % tileCount.x, tile / tileCount.x) * size;
+	ivec2 last = glm::min(first + size, resolution);
+	return ivec4(first, last);
+}
+
+// Adds triangle index to every tile that holds one of the samples inside the triangle's box
+static void binTriangle(std::vector<std::vector<uint32_t>> & tiles, ivec2 resolution, int size, uint32_t index,
+	vec2 p0, vec2 p1, vec2 p2)
+{
+	vec2 min = glm::min(p0, glm::min(p1, p2));
+	vec2 max = glm::max(p0, glm::max(p1, p2));
+
+	vec2 first = glm::ceil(glm::max(min, vec2(0.f)));
+	vec2 last = glm::floor(glm::min(max, vec2(resolution - 1)));
+
+	if (!(first.x <= last.x && first.y <= last.y)) return;
+
+	int tilesPerRow = getTileCount(resolution, size).x;
+	ivec2 firstTile = ivec2(first) / size;
+	ivec2 lastTile = ivec2(last) / size;
+
+	for (int ty = firstTile.y; ty <= lastTile.y; ty++) {
+		for (int tx = firstTile.x; tx <= lastTile.x; tx++) {
+			tiles[ty * tilesPerRow + tx].push_back(index);
+		}
+	}
+}
+
+// Empties the tile lists, keeping their memory for the next frame
+static void resetTiles(std::vector<std::vector<uint32_t>> & tiles, ivec2 resolution, int size)
+{
+	ivec2 tileCount = getTileCount(resolution, size);
+
+	tiles.resize(tileCount.x * tileCount.y);
+	for (auto & tile : tiles) {
+		tile.clear();
+	}
+}
+
+static SceneObject readObject(const json & j, const std::string & defaultName)
+{
+	SceneObject object;
+	object.name = j.value("name", defaultName);
+	object.color = readVec<3>(j, "color", object.color);
+	object.lightSource = j.value("lightSource", false);
+	object.enabled = j.value("enabled", true);
+	object.transform = readTransform(j);
+	return object;
+}
+
+bool SoftwareScene::load(const std::string & filename)
+{
+	std::ifstream fin(filename);
+
+	if (!fin) {
+		log("Unable to open scene {0}\n", filename);
+		return false;
+	}
+
+	try {
+		json j = json::parse(fin);
+
+		name = j.value("name", filename);
+
+		if (j.contains("resolution")) {
+			resolution = ivec2(readVec<2>(j, "resolution", vec2(resolution)));
+		}
+
+		clearColor = readVec<4>(j, "clearColor", clearColor);
+
+		if (j.contains("camera")) {
+			const json & jc = j["camera"];
+			camera.cameraPosition = readVec<3>(jc, "position", camera.cameraPosition);
+			camera.cameraLookat = readVec<3>(jc, "lookat", camera.cameraLookat);
+			camera.cameraUp = readVec<3>(jc, "up", camera.cameraUp);
+			camera.cameraFOVY = jc.value("fovy", camera.cameraFOVY);
+			camera.nearFar = readVec<2>(jc, "nearFar", camera.nearFar);
+			camera.cameraOrtho = jc.value("ortho", camera.cameraOrtho);
+		}
+
+		if (j.contains("shading")) {
+			shading = SoftwareShading::_from_string_nocase(j["shading"].get<std::string>().c_str());
+		}
+
+		if (j.contains("lighting")) {
+			const json & jl = j["lighting"];
+			lighting.Ia = jl.value("Ia", lighting.Ia);
+			lighting.Ka = readVec<3>(jl, "Ka", lighting.Ka);
+			lighting.Id = jl.value("Id", lighting.Id);
+			lighting.Kd = readVec<3>(jl, "Kd", lighting.Kd);
+			lighting.shininess = jl.value("shininess", lighting.shininess);
+			lighting.Ks = readVec<3>(jl, "Ks", lighting.Ks);
+			lighting.lightDirection = readVec<3>(jl, "lightDirection", lighting.lightDirection);
+		}
+
+		// Either true, or the shadow map's settings
+		if (j.contains("shadows")) {
+			const json & js = j["shadows"];
+			if (js.is_boolean()) {
+				shadows = js.get<bool>();
+			}
+			else {
+				shadows = js.value("enabled", true);
+				shadowMap.resolution = js.value("resolution", shadowMap.resolution);
+				shadowMap.bias = js.value("bias", shadowMap.bias);
+				shadowMap.pcfRadius = js.value("pcf", shadowMap.pcfRadius);
+			}
+		}
+
+		if (j.contains("lights")) {
+			for (auto & jl : j["lights"]) {
+				lights.push_back(readVec<3>(jl, "position", vec3(0.f)));
+			}
+		}
+
+		if (j.contains("triangles")) {
+			for (auto & jt : j["triangles"]) {
+				const json & jv = jt.at("vertices");
+				vec3 color = readVec<3>(jt, "color", vec3(1.f));
+				Triangle tri(vec3(jv[0][0], jv[0][1], jv[0][2]), vec3(jv[1][0], jv[1][1], jv[1][2]),
+					vec3(jv[2][0], jv[2][1], jv[2][2]), color);
+				triangles.push_back(tri);
+			}
+		}
+
+		icosphereColors = j.value("icosphereColors", icosphereColors);
+
+		if (j.contains("icospheres")) {
+			for (auto & ji : j["icospheres"]) {
+				icospheres.push_back(TransformIcosphere(readTransform(ji)));
+			}
+		}
+
+		if (j.contains("randomIcospheres")) {
+			const json & jr = j["randomIcospheres"];
+			generateIcospheres(jr.at("count").get<int>(), jr.value("seed", 3480u), readVec<2>(jr, "scale", vec2(25.f)));
+		}
+
+		if (j.contains("bodies")) {
+			for (auto & jb : j["bodies"]) {
+				bodies.push_back(readObject(jb, fmt::format("Body {0}", bodies.size() + 1)));
+			}
+		}
+
+		// Texture paths are relative to the scene file too. Meshes that name the same image share it.
+		std::map<std::string, s_ptr<SoftwareTexture>> textures;
+
+		// Normal maps get their own mip filtering, the rest are colors
+		auto loadTexture = [&](const json & jm, const char * key, s_ptr<SoftwareTexture> & texture) {
+			MipSettings settings = MipSettings::forRole(std::string(key) == "normalTexture" ? TextureRole::Normal : TextureRole::Albedo);
+
+			if (!jm.contains(key)) return true;
+
+			std::string textureFile = jm[key].get<std::string>();
+			std::string texturePath = IO::joinPath(IO::pathOfFile(filename), textureFile);
+			if (!IO::pathExists(texturePath)) {
+				texturePath = textureFile;
+			}
+
+			auto & cached = textures[texturePath + ":" + key];
+			if (!cached) {
+				auto loaded = std::make_shared<SoftwareTexture>();
+				if (!loaded->load(texturePath, settings)) {
+					log("Unable to load texture {0} for scene {1}\n", textureFile, filename);
+					return false;
+				}
+				cached = loaded;
+			}
+
+			texture = cached;
+			return true;
+		};
+
+		if (j.contains("meshes")) {
+			for (auto & jm : j["meshes"]) {
+				MeshEntry entry;
+				entry.filename = jm.at("file").get<std::string>();
+
+				// Mesh paths are relative to the scene file
+				std::string meshPath = IO::joinPath(IO::pathOfFile(filename), entry.filename);
+				if (!IO::pathExists(meshPath)) {
+					meshPath = entry.filename;
+				}
+
+				entry.mesh = std::make_shared<OBJMesh>(OBJMesh::parse(meshPath.c_str()));
+
+				if (entry.mesh->vertices.empty()) {
+					log("Unable to load mesh {0} for scene {1}\n", entry.filename, filename);
+					return false;
+				}
+
+				if (!loadTexture(jm, "texture", entry.material.texture) ||
+					!loadTexture(jm, "normalTexture", entry.material.normalTexture)) {
+					return false;
+				}
+
+				if (jm.contains("instances")) {
+					for (auto & jo : jm["instances"]) {
+						entry.instances.push_back(readObject(jo, entry.filename));
+					}
+				}
+				else {
+					entry.instances.push_back(readObject(jm, entry.filename));
+				}
+
+				meshes.push_back(entry);
+			}
+		}
+	}
+	catch (const std::exception & e) {
+		log("Unable to parse scene {0}: {1}\n", filename, e.what());
+		return false;
+	}
+
+	return true;
+}
+
+void SoftwareScene::generateIcospheres(int count, unsigned int seed, vec2 scaleRange)
+{
+	// The standard distributions differ between libraries, so turn the raw 32-bit output of the
+	// engine (which is fully specified) into floats by hand
+	std::mt19937 rng(seed);
+	auto random = [&](float lo, float hi) {
+		return lo + (hi - lo) * float(rng() >> 8) / float(1 << 24);
+	};
+
+	icospheres.reserve(icospheres.size() + count);
+
+	for (int i = 0; i < count; i++) {
+		// Draw each number in its own statement, argument evaluation order isn't fixed
+		Transform2D transform;
+		transform.translation.x = random(0.f, float(resolution.x));
+		transform.translation.y = random(0.f, float(resolution.y));
+		transform.rotation.w = random(0.f, glm::two_pi<float>());
+		transform.scale = vec3(random(scaleRange.x, scaleRange.y));
+		transform.axis = RotationAxis::_from_integral(int(rng() % 3));
+		icospheres.push_back(TransformIcosphere(transform));
+	}
+}
+
+mat4 SoftwareScene::getView() const
+{
+	return glm::lookAt(camera.cameraPosition, camera.cameraLookat, camera.cameraUp);
+}
+
+// Same projection as Lab 05: orthographic views are measured in pixels
+mat4 SoftwareScene::getProjection(int width, int height) const
+{
+	if (camera.cameraOrtho) {
+		float halfWidth = width * 0.5f;
+		float halfHeight = height * 0.5f;
+		return glm::ortho(-halfWidth, halfWidth, -halfHeight, halfHeight, camera.nearFar.x, camera.nearFar.y);
+	}
+
+	float fovy = glm::radians(camera.cameraFOVY);
+	float aspectRatio = float(width) / float(height);
+	return glm::perspective(fovy, aspectRatio, camera.nearFar.x, camera.nearFar.y);
+}
+
+// Light sources aren't lit themselves. Everything else is lit by the first light-source body, then
+// the first light, then the camera's lookat point, the same fallbacks Lab 05 uses.
+const vec3 * SoftwareScene::getLightSource(const SceneObject & object) const
+{
+	if (object.lightSource) {
+		return nullptr;
+	}
+
+	for (auto & body : bodies) {
+		if (body.lightSource) {
+			return &body.transform.translation;
+		}
+	}
+
+	if (!lights.empty()) {
+		return &lights[0];
+	}
+
+	return &camera.cameraLookat;
+}
+
+void SoftwareScene::setup(int width, int height)
+{
+	screenTriangles.clear();
+
+	for (auto & tri : triangles) {
+		if (tri.enabled) {
+			screenTriangles.push_back(tri);
+		}
+	}
+
+	for (auto & icoTf : icospheres) {
+		if (!icoTf.enabled) continue;
+
+		Icosphere ico;
+		transformIcosphere(ico, icoTf.transform.getMatrix());
+		appendIcosphereTriangles(ico, screenTriangles, icosphereColors);
+	}
+
+	mat4 view = getView();
+	mat4 projection = getProjection(width, height);
+
+	for (auto & body : bodies) {
+		if (!body.enabled) continue;
+
+		mat4 model = body.transform.getMatrixGLM();
+		appendSphereTriangles(model, view, projection, body.color, width, height, screenTriangles, getLightSource(body));
+	}
+
+	std::vector<vec3> positions;
+
+	for (auto & entry : meshes) {
+		positions.resize(entry.mesh->vertices.size());
+		for (size_t i = 0; i < positions.size(); i++) {
+			positions[i] = entry.mesh->vertices[i].position;
+		}
+
+		for (auto & instance : entry.instances) {
+			if (!instance.enabled) continue;
+
+			mat4 model = instance.transform.getMatrixGLM();
+			appendMeshTriangles(positions.data(), entry.mesh->indices.data(), entry.mesh->indices.size(),
+				model, view, projection, instance.color, width, height, screenTriangles, getLightSource(instance));
+		}
+	}
+
+	rasterSetups.resize(screenTriangles.size());
+	pathCounts.fill(0);
+
+	// Keep the vectors around so their memory is reused from frame to frame
+	bandTriangles.resize((height + bandHeight - 1) / bandHeight);
+	for (auto & band : bandTriangles) {
+		band.clear();
+	}
+
+	for (size_t i = 0; i < screenTriangles.size(); i++) {
+		RasterSetup & rasterSetup = rasterSetups[i];
+		rasterSetup = classifyTriangle(screenTriangles[i], width, height);
+		pathCounts[rasterSetup.path._to_integral()]++;
+
+		if (rasterSetup.path == +RasterPath::Culled) continue;
+
+		// Every band that holds one of the triangle's sample rows draws it
+		int firstBand = rasterSetup.sample.y / bandHeight;
+		int lastBand = (rasterSetup.sample.y + rasterSetup.samples.y - 1) / bandHeight;
+
+		for (int band = firstBand; band <= lastBand; band++) {
+			bandTriangles[band].push_back((uint32_t)i);
+		}
+	}
+}
+
+void SoftwareScene::clear(float * pixels, int stride, int width, int height)
+{
+	size_t numPixels = (size_t)width * height;
+
+	for (size_t i = 0; i < numPixels; i++) {
+		float * pixel = pixels + i * stride;
+		for (int c = 0; c < stride; c++) {
+			pixel[c] = clearColor[glm::min(c, 3)];
+		}
+		// Depth lives in the last channel, and nothing is farther than this
+		pixel[stride - 1] = FLT_MAX;
+	}
+}
+
+void SoftwareScene::rasterize(float * pixels, int stride, int width, int height, int numThreads)
+{
+	int numBands = glm::min((int)bandTriangles.size(), (height + bandHeight - 1) / bandHeight);
+
+	runJobs(numBands, numThreads, [&](int band) {
+		int y0 = band * bandHeight;
+		int rows = glm::min(bandHeight, height - y0);
+
+		float * bandPixels = pixels + (size_t)y0 * width * stride;
+
+		MicroTriangleBatch batch;
+
+		for (uint32_t i : bandTriangles[band]) {
+			Triangle & screenTri = screenTriangles[i];
+			const RasterSetup & rasterSetup = rasterSetups[i];
+
+			if (rasterSetup.path == +RasterPath::Micro) {
+				int yEnd = glm::min(rasterSetup.sample.y + rasterSetup.samples.y, y0 + rows);
+
+				for (int y = glm::max(rasterSetup.sample.y, y0); y < yEnd; y++) {
+					for (int x = rasterSetup.sample.x; x < rasterSetup.sample.x + rasterSetup.samples.x; x++) {
+						batch.add(screenTri, ivec2(x, y), pixels + ((size_t)y * width + x) * stride);
+						if (batch.full()) {
+							batch.flush();
+						}
+					}
+				}
+				continue;
+			}
+
+			// Earlier micro triangles have to land first, or depth ties would resolve differently
+			batch.flush();
+
+			// Move the triangle into the band's coordinates. Shifting by whole rows keeps the
+			// exact same sample positions as drawing into the full image.
+			Triangle tri = screenTri;
+			for (auto & vertex : tri.vertices) {
+				vertex.position.y -= y0;
+			}
+
+			renderTriangleBoundingBox(tri, bandPixels, stride, width, rows);
+		}
+
+		batch.flush();
+	});
+}
+
+void SoftwareScene::setupShading(int width, int height)
+{
+	shadingTriangles.clear();
+	shadowTriangles.clear();
+	shadingResolution = ivec2(width, height);
+
+	int object = 0;
+
+	auto addScreenTriangle = [&](const Triangle & tri) {
+		ShadingTriangle shadingTri;
+		for (int i = 0; i < 3; i++) {
+			shadingTri.vertices[i] = screenVertex(tri.vertices[i].position, tri.color * tri.vertices[i].color);
+		}
+		shadingTri.lit = false;
+		shadingTri.object = object;
+		shadingTriangles.push_back(shadingTri);
+	};
+
+	for (auto & tri : triangles) {
+		if (!tri.enabled) continue;
+
+		addScreenTriangle(tri);
+		object++;
+	}
+
+	std::vector<Triangle> icoTriangles;
+
+	for (auto & icoTf : icospheres) {
+		if (!icoTf.enabled) continue;
+
+		Icosphere ico;
+		transformIcosphere(ico, icoTf.transform.getMatrix());
+
+		icoTriangles.clear();
+		appendIcosphereTriangles(ico, icoTriangles, icosphereColors);
+
+		for (auto & tri : icoTriangles) {
+			addScreenTriangle(tri);
+		}
+		object++;
+	}
+
+	mat4 viewProjection = getProjection(width, height) * getView();
+
+	std::vector<ShadingVertex> vertices;
+	std::vector<char> visible;
+
+	// modelVertices hold the model-space attributes vertex.vert reads
+	auto addMesh = [&](const std::vector<ShadingVertex> & modelVertices, const unsigned int * indices, size_t numIndices,
+		const SceneObject & instance, const SoftwareMaterial * material) {
+		mat4 model = instance.transform.getMatrixGLM();
+		mat4 normalMatrix = glm::transpose(glm::inverse(model));
+
+		vertices.resize(modelVertices.size());
+		visible.resize(modelVertices.size());
+
+		for (size_t i = 0; i < modelVertices.size(); i++) {
+			visible[i] = shadeVertex(vertices[i], modelVertices[i], model, normalMatrix, viewProjection, width, height);
+			vertices[i].color = instance.color;
+		}
+
+		for (size_t i = 0; i + 2 < numIndices; i += 3) {
+			unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+
+			// Triangles the camera can't see still cast shadows. Light sources don't.
+			if (shadows && !instance.lightSource) {
+				shadowTriangles.push_back({ { vertices[a].position, vertices[b].position, vertices[c].position } });
+			}
+
+			if (!visible[a] || !visible[b] || !visible[c]) continue;
+
+			ShadingTriangle shadingTri;
+			shadingTri.vertices[0] = vertices[a];
+			shadingTri.vertices[1] = vertices[b];
+			shadingTri.vertices[2] = vertices[c];
+			shadingTri.lit = !instance.lightSource;
+			shadingTri.object = object;
+			shadingTri.material = material;
+
+			if (material) {
+				vec2 s0 = vec2(vertices[a].screen), s1 = vec2(vertices[b].screen), s2 = vec2(vertices[c].screen);
+				vec2 t0 = vertices[a].uv, t1 = vertices[b].uv, t2 = vertices[c].uv;
+				float screenArea = glm::abs(cross2(s1 - s0, s2 - s0));
+				float uvArea = glm::abs(cross2(t1 - t0, t2 - t0));
+				shadingTri.uvPerPixel = screenArea > 0.f ? uvArea / screenArea : 0.f;
+			}
+
+			shadingTriangles.push_back(shadingTri);
+		}
+
+		object++;
+	};
+
+	if (!bodies.empty()) {
+		// The unit sphere's normals are its positions
+		std::vector<ShadingVertex> sphereVertices;
+		std::vector<unsigned int> indices;
+
+		for (auto & p : Sphere::instance.positions) {
+			ShadingVertex vertex;
+			vertex.position = vec3(p);
+			vertex.normal = glm::length(vec3(p)) > 0.f ? glm::normalize(vec3(p)) : vec3(0.f);
+			sphereVertices.push_back(vertex);
+		}
+
+		for (auto & tri : Sphere::instance.indices) {
+			indices.insert(indices.end(), { tri.x, tri.y, tri.z });
+		}
+
+		for (auto & body : bodies) {
+			if (body.enabled) {
+				addMesh(sphereVertices, indices.data(), indices.size(), body, nullptr);
+			}
+		}
+	}
+
+	std::vector<ShadingVertex> meshVertices;
+
+	for (auto & entry : meshes) {
+		meshVertices.resize(entry.mesh->vertices.size());
+
+		for (size_t i = 0; i < meshVertices.size(); i++) {
+			const OBJMeshVertex & omv = entry.mesh->vertices[i];
+			meshVertices[i].position = omv.position;
+			meshVertices[i].normal = omv.normal;
+			meshVertices[i].uv = omv.texCoord;
+			meshVertices[i].tangent = omv.tangent;
+			meshVertices[i].bitangent = omv.bitangent;
+		}
+
+		bool textured = entry.material.texture || entry.material.normalTexture;
+
+		for (auto & instance : entry.instances) {
+			if (instance.enabled) {
+				addMesh(meshVertices, entry.mesh->indices.data(), entry.mesh->indices.size(), instance,
+					textured ? &entry.material : nullptr);
+			}
+		}
+	}
+
+	resetTiles(tileTriangles, shadingResolution, tileSize);
+
+	for (size_t i = 0; i < shadingTriangles.size(); i++) {
+		const ShadingVertex * v = shadingTriangles[i].vertices;
+		binTriangle(tileTriangles, shadingResolution, tileSize, (uint32_t)i,
+			vec2(v[0].screen), vec2(v[1].screen), vec2(v[2].screen));
+	}
+}
+
+void SoftwareScene::setupShadows()
+{
+	if (shadowTriangles.empty()) {
+		shadowMap.depth.clear();
+		return;
+	}
+
+	vec3 boundsMin = vec3(FLT_MAX), boundsMax = vec3(-FLT_MAX);
+
+	for (auto & tri : shadowTriangles) {
+		for (auto & v : tri.vertices) {
+			boundsMin = glm::min(boundsMin, v);
+			boundsMax = glm::max(boundsMax, v);
+		}
+	}
+
+	shadowMap.fit(lighting.lightDirection, boundsMin, boundsMax);
+
+	ivec2 resolution = ivec2(shadowMap.resolution);
+	resetTiles(shadowTileTriangles, resolution, shadowTileSize);
+
+	for (size_t i = 0; i < shadowTriangles.size(); i++) {
+		vec3 * v = shadowTriangles[i].vertices;
+		for (int k = 0; k < 3; k++) {
+			v[k] = shadowMap.project(v[k]);
+		}
+
+		binTriangle(shadowTileTriangles, resolution, shadowTileSize, (uint32_t)i, vec2(v[0]), vec2(v[1]), vec2(v[2]));
+	}
+}
+
+void SoftwareScene::renderShadowMap(int numThreads)
+{
+	if (shadowMap.depth.empty()) return;
+
+	ivec2 resolution = ivec2(shadowMap.resolution);
+
+	runJobs((int)shadowTileTriangles.size(), numThreads, [&](int tile) {
+		ivec4 rect = getTileRect(tile, resolution, shadowTileSize);
+		shadowMap.clear(rect);
+		rasterizeShadowDepth(shadowTriangles, shadowTileTriangles[tile], shadowMap, rect);
+	});
+}
+
+void SoftwareScene::rasterizeDeferred(int numThreads)
+{
+	runJobs((int)tileTriangles.size(), numThreads, [&](int tile) {
+		ivec4 rect = getTileRect(tile, shadingResolution, tileSize);
+		gbuffer.clear(rect);
+		rasterizeGBuffer(shadingTriangles, tileTriangles[tile], gbuffer, rect);
+	});
+}
+
+void SoftwareScene::shadeDeferred(float * pixels, int stride, int numThreads)
+{
+	runJobs((int)tileTriangles.size(), numThreads, [&](int tile) {
+		shadeGBuffer(gbuffer, lighting, getShadowMap(), camera.cameraPosition, clearColor, pixels, stride,
+			getTileRect(tile, shadingResolution, tileSize));
+	});
+}
+
+void SoftwareScene::renderForward(float * pixels, int stride, int numThreads)
+{
+	runJobs((int)tileTriangles.size(), numThreads, [&](int tile) {
+		rasterizeForward(shadingTriangles, tileTriangles[tile], lighting, getShadowMap(), camera.cameraPosition,
+			clearColor, pixels, stride, shadingResolution.x, getTileRect(tile, shadingResolution, tileSize));
+	});
+}
+
+const SoftwareShadowMap * SoftwareScene::getShadowMap() const
+{
+	return shadows && !shadowMap.depth.empty() ? &shadowMap : nullptr;
+}
+
+size_t SoftwareScene::triangleCount() const
+{
+	return shading == +SoftwareShading::Vertex ? screenTriangles.size() : shadingTriangles.size();
+}
+
+double SoftwareScene::render(TextureMemory & target, int numThreads)
+{
+	auto pixels = (float*)target.value;
+	int width = target.width;
+	int height = target.height;
+
+	_time start = _clock::now();
+
+	if (shading != +SoftwareShading::Vertex) {
+		bool deferred = shading == +SoftwareShading::Deferred;
+
+		if (deferred) {
+			gbuffer.resize(width, height);
+		}
+
+		setupShading(width, height);
+		setupShadows();
+
+		_time setupDone = _clock::now();
+
+		renderShadowMap(numThreads);
+
+		_time shadowDone = _clock::now();
+
+		if (deferred) {
+			rasterizeDeferred(numThreads);
+		}
+		else {
+			renderForward(pixels, target.stride, numThreads);
+		}
+
+		_time rasterDone = _clock::now();
+
+		if (deferred) {
+			shadeDeferred(pixels, target.stride, numThreads);
+		}
+
+		_time shadeDone = _clock::now();
+
+		setupTime = _elapsed(setupDone - start).count();
+		shadowTime = _elapsed(shadowDone - setupDone).count();
+		rasterTime = _elapsed(rasterDone - shadowDone).count();
+		shadeTime = _elapsed(shadeDone - rasterDone).count();
+
+		return _elapsed(shadeDone - start).count();
+	}
+
+	clear(pixels, target.stride, width, height);
+	setup(width, height);
+
+	_time setupDone = _clock::now();
+
+	rasterize(pixels, target.stride, width, height, numThreads);
+
+	_time rasterDone = _clock::now();
+
+	setupTime = _elapsed(setupDone - start).count();
+	rasterTime = _elapsed(rasterDone - setupDone).count();
+	shadowTime = 0.;
+	shadeTime = 0.;
+
+	return _elapsed(rasterDone - start).count();
+}
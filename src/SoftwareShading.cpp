@@ -0,0 +1,541 @@
+#include "SoftwareShading.h"
+
+#include "ImageIO.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SHADING_QUAD_SSE2
+#endif
+
+bool SoftwareTexture::load(const std::string& filename, MipSettings settings) {
+	MipChain chain;
+	if (!chain.load(filename, settings)) {
+		return false;
+	}
+
+	levels.resize(chain.levels.size());
+
+	for (size_t l = 0; l < levels.size(); l++) {
+		const ImageIO::DecodedImage& image = chain.levels[l];
+		Level& level = levels[l];
+
+		level.width = image.width;
+		level.height = image.height;
+		level.texels.resize((size_t)image.width * image.height);
+
+		// Expanded to RGBA the way stb_image does it: gray goes to all three colors, and alpha is 1
+		// unless the image has one
+		float scale = image.bytesPerChannel == 2 ? 65535.f : 255.f;
+
+		for (size_t i = 0; i < level.texels.size(); i++) {
+			float pixel[4] = {};
+			for (int c = 0; c < image.channels; c++) {
+				size_t index = i * image.channels + c;
+				pixel[c] = image.bytesPerChannel == 2 ? ((const uint16_t*)image.pixels.data())[index] : image.pixels[index];
+			}
+
+			vec4 texel = vec4(pixel[0], pixel[0], pixel[0], scale);
+
+			if (image.channels == 2) texel.a = pixel[1];
+			if (image.channels >= 3) texel = vec4(pixel[0], pixel[1], pixel[2], scale);
+			if (image.channels == 4) texel.a = pixel[3];
+
+			level.texels[i] = texel / scale;
+		}
+	}
+
+	return true;
+}
+
+static int wrapRepeat(int i, int size) {
+	i %= size;
+	return i < 0 ? i + size : i;
+}
+
+static vec4 sampleLevel(const SoftwareTexture::Level& level, vec2 uv) {
+	int width = level.width, height = level.height;
+	const std::vector<vec4>& texels = level.texels;
+
+	// Texel centers are at half coordinates, like GL_LINEAR
+	vec2 st = uv * vec2(width, height) - 0.5f;
+	vec2 base = glm::floor(st);
+	vec2 f = st - base;
+
+	int x0 = wrapRepeat((int)base.x, width), x1 = wrapRepeat(x0 + 1, width);
+	int y0 = wrapRepeat((int)base.y, height), y1 = wrapRepeat(y0 + 1, height);
+
+	vec4 bottom = glm::mix(texels[(size_t)y0 * width + x0], texels[(size_t)y0 * width + x1], f.x);
+	vec4 top = glm::mix(texels[(size_t)y1 * width + x0], texels[(size_t)y1 * width + x1], f.x);
+
+	return glm::mix(bottom, top, f.y);
+}
+
+vec4 SoftwareTexture::sample(vec2 uv) const {
+	if (levels.empty()) return vec4(1.f);
+
+	return sampleLevel(levels[0], uv);
+}
+
+vec4 SoftwareTexture::sample(vec2 uv, float lod) const {
+	if (levels.empty()) return vec4(1.f);
+
+	// Magnified, or minified too little to matter
+	if (!(lod > 0.f)) return sampleLevel(levels[0], uv);
+
+	lod = glm::min(lod, (float)levels.size() - 1.f);
+	int level = (int)lod;
+	float f = lod - level;
+
+	vec4 result = sampleLevel(levels[level], uv);
+	if (f > 0.f) {
+		result = glm::mix(result, sampleLevel(levels[level + 1], uv), f);
+	}
+
+	return result;
+}
+
+float SoftwareTexture::getLod(float uvArea) const {
+	if (levels.empty() || !(uvArea > 0.f)) return 0.f;
+
+	// Texels per pixel along one side
+	return 0.5f * glm::log2(uvArea * levels[0].width * levels[0].height);
+}
+
+bool shadeVertex(ShadingVertex& result, const ShadingVertex& vertex, const mat4& model, const mat4& normalMatrix,
+	const mat4& viewProjection, int width, int height) {
+	vec4 world = model * vec4(vertex.position, 1.f);
+	vec4 clip = viewProjection * world;
+
+	result.position = vec3(world);
+	result.normal = vec3(normalMatrix * vec4(vertex.normal, 0.f));
+	result.uv = vertex.uv;
+
+	// vertex.vert moves the tangents by the model matrix, not the normal matrix. Meshes without
+	// texture coordinates have no tangents, those are left at zero instead of becoming NaN.
+	vec3 tangent = vec3(model * vec4(vertex.tangent, 0.f));
+	vec3 bitangent = vec3(model * vec4(vertex.bitangent, 0.f));
+	result.tangent = glm::length(tangent) > 0.f ? glm::normalize(tangent) : vec3(0.f);
+	result.bitangent = glm::length(bitangent) > 0.f ? glm::normalize(bitangent) : vec3(0.f);
+
+	// Nothing is clipped against the near plane, triangles that cross it are dropped instead
+	if (!(clip.w > 0.f)) return false;
+
+	result.invW = 1.f / clip.w;
+
+	vec3 ndc = vec3(clip) * result.invW;
+	result.screen = vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+
+	return true;
+}
+
+ShadingVertex screenVertex(vec3 screen, vec3 color) {
+	ShadingVertex result;
+	result.screen = screen;
+	result.color = color;
+	return result;
+}
+
+void shadeSurface(const ShadingTriangle& tri, vec3 w, vec3& position, vec3& albedo, vec3& normal) {
+	const ShadingVertex& v0 = tri.vertices[0];
+	const ShadingVertex& v1 = tri.vertices[1];
+	const ShadingVertex& v2 = tri.vertices[2];
+
+	position = w.x * v0.position + w.y * v1.position + w.z * v2.position;
+	albedo = w.x * v0.color + w.y * v1.color + w.z * v2.color;
+
+	if (!tri.lit) {
+		normal = vec3(0.f);
+		return;
+	}
+
+	vec3 fNormal = w.x * v0.normal + w.y * v1.normal + w.z * v2.normal;
+	normal = glm::normalize(fNormal);
+
+	if (!tri.material) return;
+
+	vec2 uv = w.x * v0.uv + w.y * v1.uv + w.z * v2.uv;
+
+	if (tri.material->texture) {
+		const SoftwareTexture& texture = *tri.material->texture;
+		albedo *= vec3(texture.sample(uv, texture.getLod(tri.uvPerPixel)));
+	}
+
+	if (tri.material->normalTexture) {
+		mat3 TBN = mat3(w.x * v0.tangent + w.y * v1.tangent + w.z * v2.tangent,
+			w.x * v0.bitangent + w.y * v1.bitangent + w.z * v2.bitangent, fNormal);
+
+		const SoftwareTexture& normalTexture = *tri.material->normalTexture;
+		vec3 mapped = vec3(normalTexture.sample(uv, normalTexture.getLod(tri.uvPerPixel))) * 2.f - 1.f;
+		normal = glm::normalize(TBN * mapped);
+	}
+}
+
+vec3 blinnPhong(const Lighting& light, vec3 normal, vec3 viewDirection, float visibility) {
+	vec3 ambientTerm = light.Ia * light.Ka;
+	vec3 diffuseTerm = light.Id * glm::max(0.f, glm::dot(normal, -light.lightDirection)) * light.Kd;
+
+	vec3 halfway = glm::normalize(-light.lightDirection + viewDirection);
+	vec3 specularTerm = glm::pow(glm::max(0.f, glm::dot(halfway, normal)), light.shininess) * light.Ks;
+
+	if (visibility < 1.f) {
+		return ambientTerm + visibility * (diffuseTerm + specularTerm);
+	}
+
+	return ambientTerm + diffuseTerm + specularTerm;
+}
+
+// Both shading paths end here
+static vec3 lightSurface(const Lighting& light, const SoftwareShadowMap* shadowMap, vec3 cameraPosition,
+	vec3 position, vec3 albedo, vec3 normal, bool lit) {
+	if (!lit) return albedo;
+
+	float visibility = shadowMap ? shadowMap->visibility(position) : 1.f;
+
+	vec3 viewDirection = glm::normalize(cameraPosition - position);
+	return albedo * blinnPhong(light, normal, viewDirection, visibility);
+}
+
+// Edge function of the edge a -> b, always evaluated from the same endpoint so the two triangles
+// that share an edge get exactly opposite values and no pixel on it is dropped by both
+struct EdgeFunction {
+	vec2 origin;
+	vec2 direction;
+	float sign;
+
+	EdgeFunction(vec2 a, vec2 b) {
+		bool swap = b.x < a.x || (b.x == a.x && b.y < a.y);
+		origin = swap ? b : a;
+		direction = swap ? a - b : b - a;
+		sign = swap ? -1.f : 1.f;
+	}
+
+	float operator()(float x, float y) const {
+		return sign * (direction.x * (y - origin.y) - direction.y * (x - origin.x));
+	}
+};
+
+// Sample offsets of the four lanes of a quad
+static const int quadX[4] = { 0, 1, 0, 1 };
+static const int quadY[4] = { 0, 0, 1, 1 };
+
+// Walks the samples of tri inside rect a 2x2 quad at a time. Coverage, depth and the barycentric
+// weights of a quad are computed together (in SSE2 lanes when available), then fragment(x, y, z, w)
+// is called for every covered sample with its window depth and perspective-correct weights.
+// Each barycentric weight is the edge function of the opposite edge over the area, and both edges
+// are included, like Triangle::baryInTriangle does.
+template <typename Fragment>
+static void rasterizeQuads(const ShadingTriangle& tri, ivec4 rect, Fragment&& fragment) {
+	const ShadingVertex& v0 = tri.vertices[0];
+	const ShadingVertex& v1 = tri.vertices[1];
+	const ShadingVertex& v2 = tri.vertices[2];
+
+	vec2 p0 = vec2(v0.screen), p1 = vec2(v1.screen), p2 = vec2(v2.screen);
+
+	float area = (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+
+	// Degenerate, or NaN from a bad projection
+	if (!(glm::abs(area) > 0.f)) return;
+
+	vec2 min = glm::min(p0, glm::min(p1, p2));
+	vec2 max = glm::max(p0, glm::max(p1, p2));
+
+	ivec2 first = ivec2(glm::ceil(glm::max(min, vec2(rect.x, rect.y))));
+	ivec2 last = ivec2(glm::floor(glm::min(max, vec2(rect.z - 1, rect.w - 1))));
+
+	if (first.x > last.x || first.y > last.y) return;
+
+	EdgeFunction edges[3] = { EdgeFunction(p1, p2), EdgeFunction(p2, p0), EdgeFunction(p0, p1) };
+	float invArea = 1.f / area;
+
+	alignas(16) float b0[4], b1[4], b2[4], z[4];
+
+#ifdef SHADING_QUAD_SSE2
+	const __m128 laneX = _mm_setr_ps(0.f, 1.f, 0.f, 1.f);
+	const __m128 laneY = _mm_setr_ps(0.f, 0.f, 1.f, 1.f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 invAreas = _mm_set1_ps(invArea);
+
+	__m128 originX[3], originY[3], directionX[3], directionY[3], signs[3];
+	for (int e = 0; e < 3; e++) {
+		originX[e] = _mm_set1_ps(edges[e].origin.x);
+		originY[e] = _mm_set1_ps(edges[e].origin.y);
+		directionX[e] = _mm_set1_ps(edges[e].direction.x);
+		directionY[e] = _mm_set1_ps(edges[e].direction.y);
+		signs[e] = _mm_set1_ps(edges[e].sign);
+	}
+
+	const __m128 z0 = _mm_set1_ps(v0.screen.z), z1 = _mm_set1_ps(v1.screen.z), z2 = _mm_set1_ps(v2.screen.z);
+#endif
+
+	// Quads start on even pixels, so they line up across triangles
+	for (int y = first.y & ~1; y <= last.y; y += 2) {
+		for (int x = first.x & ~1; x <= last.x; x += 2) {
+			int covered = 0;
+
+#ifdef SHADING_QUAD_SSE2
+			// Same steps, in the same order, as EdgeFunction so both paths give identical results
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneX);
+			__m128 py = _mm_add_ps(_mm_set1_ps((float)y), laneY);
+
+			__m128 b[3];
+			for (int e = 0; e < 3; e++) {
+				__m128 value = _mm_sub_ps(_mm_mul_ps(directionX[e], _mm_sub_ps(py, originY[e])),
+					_mm_mul_ps(directionY[e], _mm_sub_ps(px, originX[e])));
+				b[e] = _mm_mul_ps(_mm_mul_ps(signs[e], value), invAreas);
+			}
+
+			__m128 depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b[0], z0), _mm_mul_ps(b[1], z1)), _mm_mul_ps(b[2], z2));
+
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(b[0], zero), _mm_cmpge_ps(b[1], zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(b[2], zero));
+			inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(depth, zero), _mm_cmple_ps(depth, one)));
+
+			_mm_store_ps(b0, b[0]);
+			_mm_store_ps(b1, b[1]);
+			_mm_store_ps(b2, b[2]);
+			_mm_store_ps(z, depth);
+
+			covered = _mm_movemask_ps(inside);
+#else
+			for (int lane = 0; lane < 4; lane++) {
+				float sx = float(x + quadX[lane]), sy = float(y + quadY[lane]);
+				b0[lane] = edges[0](sx, sy) * invArea;
+				b1[lane] = edges[1](sx, sy) * invArea;
+				b2[lane] = edges[2](sx, sy) * invArea;
+				z[lane] = b0[lane] * v0.screen.z + b1[lane] * v1.screen.z + b2[lane] * v2.screen.z;
+
+				if (b0[lane] >= 0.f && b1[lane] >= 0.f && b2[lane] >= 0.f && z[lane] >= 0.f && z[lane] <= 1.f) {
+					covered |= 1 << lane;
+				}
+			}
+#endif
+
+			if (!covered) continue;
+
+			for (int lane = 0; lane < 4; lane++) {
+				int sx = x + quadX[lane], sy = y + quadY[lane];
+
+				// Lanes that hang over the triangle's box or the rect are skipped
+				if (!(covered & (1 << lane)) || sx < first.x || sx > last.x || sy < first.y || sy > last.y) continue;
+
+				// Window z is already linear across the screen, everything else is interpolated
+				// with perspective correction
+				vec3 w = vec3(b0[lane] * v0.invW, b1[lane] * v1.invW, b2[lane] * v2.invW);
+				w /= w.x + w.y + w.z;
+
+				fragment(sx, sy, z[lane], w);
+			}
+		}
+	}
+}
+
+void SoftwareGBuffer::resize(int w, int h) {
+	width = w;
+	height = h;
+
+	size_t numPixels = (size_t)w * h;
+	color.resize(numPixels);
+	position.resize(numPixels);
+	normal.resize(numPixels);
+	primitiveData.resize(numPixels);
+	depth.resize(numPixels);
+}
+
+void SoftwareGBuffer::clear(ivec4 rect) {
+	for (int y = rect.y; y < rect.w; y++) {
+		size_t row = (size_t)y * width;
+
+		// Only depth and primitive data are read before being written
+		std::fill(depth.begin() + row + rect.x, depth.begin() + row + rect.z, FLT_MAX);
+		std::fill(primitiveData.begin() + row + rect.x, primitiveData.begin() + row + rect.z, ivec4(-1));
+	}
+}
+
+void rasterizeGBuffer(const std::vector<ShadingTriangle>& triangles, const std::vector<uint32_t>& indices,
+	SoftwareGBuffer& gbuffer, ivec4 rect) {
+	for (uint32_t index : indices) {
+		const ShadingTriangle& tri = triangles[index];
+
+		rasterizeQuads(tri, rect, [&](int x, int y, float z, vec3 w) {
+			size_t i = (size_t)y * gbuffer.width + x;
+			if (z >= gbuffer.depth[i]) return;
+
+			vec3 albedo;
+			shadeSurface(tri, w, gbuffer.position[i], albedo, gbuffer.normal[i]);
+
+			gbuffer.depth[i] = z;
+			gbuffer.color[i] = vec4(albedo, tri.lit ? 1.f : 0.f);
+			gbuffer.primitiveData[i] = ivec4(tri.object, (int)index, 0, 0);
+		});
+	}
+}
+
+void shadeGBuffer(const SoftwareGBuffer& gbuffer, const Lighting& light, const SoftwareShadowMap* shadowMap,
+	vec3 cameraPosition, vec4 clearColor, float* pixels, int stride, ivec4 rect) {
+	for (int y = rect.y; y < rect.w; y++) {
+		for (int x = rect.x; x < rect.z; x++) {
+			size_t i = (size_t)y * gbuffer.width + x;
+			vec4* pixel = (vec4*)(pixels + i * stride);
+
+			if (gbuffer.primitiveData[i].x < 0) {
+				*pixel = vec4(vec3(clearColor), FLT_MAX);
+				continue;
+			}
+
+			vec4 albedo = gbuffer.color[i];
+			vec3 color = lightSurface(light, shadowMap, cameraPosition, gbuffer.position[i], vec3(albedo),
+				gbuffer.normal[i], albedo.a > 0.f);
+
+			*pixel = vec4(color, gbuffer.depth[i]);
+		}
+	}
+}
+
+void rasterizeForward(const std::vector<ShadingTriangle>& triangles, const std::vector<uint32_t>& indices,
+	const Lighting& light, const SoftwareShadowMap* shadowMap, vec3 cameraPosition, vec4 clearColor,
+	float* pixels, int stride, int width, ivec4 rect) {
+	for (int y = rect.y; y < rect.w; y++) {
+		for (int x = rect.x; x < rect.z; x++) {
+			*(vec4*)(pixels + ((size_t)y * width + x) * stride) = vec4(vec3(clearColor), FLT_MAX);
+		}
+	}
+
+	for (uint32_t index : indices) {
+		const ShadingTriangle& tri = triangles[index];
+
+		rasterizeQuads(tri, rect, [&](int x, int y, float z, vec3 w) {
+			vec4* pixel = (vec4*)(pixels + ((size_t)y * width + x) * stride);
+			if (z >= pixel->w) return;
+
+			vec3 position, albedo, normal;
+			shadeSurface(tri, w, position, albedo, normal);
+
+			*pixel = vec4(lightSurface(light, shadowMap, cameraPosition, position, albedo, normal, tri.lit), z);
+		});
+	}
+}
+
+void SoftwareShadowMap::fit(vec3 lightDirection, vec3 boundsMin, vec3 boundsMax) {
+	vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = glm::max(glm::length(boundsMax - boundsMin) * 0.5f, 1e-3f);
+
+	vec3 direction = glm::normalize(lightDirection);
+	vec3 up = glm::abs(direction.y) > 0.99f ? vec3(1, 0, 0) : vec3(0, 1, 0);
+
+	// The light sits outside the scene's bounding sphere, looking through all of it
+	mat4 view = glm::lookAt(center - direction * radius * 2.f, center, up);
+	mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, radius * 3.f);
+
+	// From clip space to [0, 1]
+	mat4 toMap = glm::translate(vec3(0.5f)) * glm::scale(vec3(0.5f));
+
+	lightViewProjection = toMap * projection * view;
+	depth.resize((size_t)resolution * resolution);
+}
+
+vec3 SoftwareShadowMap::project(vec3 position) const {
+	vec3 mapped = vec3(lightViewProjection * vec4(position, 1.f));
+	return vec3(vec2(mapped) * float(resolution), mapped.z);
+}
+
+void SoftwareShadowMap::clear(ivec4 rect) {
+	for (int y = rect.y; y < rect.w; y++) {
+		size_t row = (size_t)y * resolution;
+		std::fill(depth.begin() + row + rect.x, depth.begin() + row + rect.z, FLT_MAX);
+	}
+}
+
+float SoftwareShadowMap::visibility(vec3 position) const {
+	vec3 mapped = project(position);
+
+	// Texels are sampled at whole coordinates, like every other CPU raster
+	ivec2 center = ivec2(glm::round(vec2(mapped)));
+	float compare = mapped.z - bias;
+
+	int lit = 0, total = 0;
+
+	for (int y = center.y - pcfRadius; y <= center.y + pcfRadius; y++) {
+		for (int x = center.x - pcfRadius; x <= center.x + pcfRadius; x++) {
+			total++;
+
+			// Nothing outside the map casts a shadow
+			if (x < 0 || y < 0 || x >= resolution || y >= resolution) {
+				lit++;
+				continue;
+			}
+
+			if (compare <= depth[(size_t)y * resolution + x]) {
+				lit++;
+			}
+		}
+	}
+
+	return float(lit) / float(total);
+}
+
+void rasterizeShadowDepth(const std::vector<ShadowTriangle>& triangles, const std::vector<uint32_t>& indices,
+	SoftwareShadowMap& shadowMap, ivec4 rect) {
+	for (uint32_t index : indices) {
+		const ShadowTriangle& tri = triangles[index];
+		vec3 v0 = tri.vertices[0], v1 = tri.vertices[1], v2 = tri.vertices[2];
+
+		vec2 p0 = vec2(v0), p1 = vec2(v1), p2 = vec2(v2);
+
+		float area = (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+		if (!(glm::abs(area) > 0.f)) continue;
+
+		vec2 min = glm::min(p0, glm::min(p1, p2));
+		vec2 max = glm::max(p0, glm::max(p1, p2));
+
+		ivec2 first = ivec2(glm::ceil(glm::max(min, vec2(rect.x, rect.y))));
+		ivec2 last = ivec2(glm::floor(glm::min(max, vec2(rect.z - 1, rect.w - 1))));
+
+		// The light's view is orthographic, so depth is a plane over the map: z = A * x + B * y + C
+		float invArea = 1.f / area;
+
+		vec3 depthPlane = vec3(
+			(v0.z * (p1.y - p2.y) + v1.z * (p2.y - p0.y) + v2.z * (p0.y - p1.y)) * invArea,
+			(v0.z * (p2.x - p1.x) + v1.z * (p0.x - p2.x) + v2.z * (p1.x - p0.x)) * invArea, 0.f);
+		depthPlane.z = v0.z - depthPlane.x * p0.x - depthPlane.y * p0.y;
+
+		// The edges as planes too, facing so the inside is positive. Each row then only needs the
+		// span where all three are, and the span is filled without any per-texel tests.
+		vec3 edges[3];
+		float invSlopes[3];
+		vec2 corners[3][2] = { { p1, p2 }, { p2, p0 }, { p0, p1 } };
+		float orientation = area > 0.f ? 1.f : -1.f;
+
+		for (int k = 0; k < 3; k++) {
+			vec2 a = corners[k][0], b = corners[k][1];
+			edges[k].x = -(b.y - a.y) * orientation;
+			edges[k].y = (b.x - a.x) * orientation;
+			edges[k].z = -(edges[k].x * a.x + edges[k].y * a.y);
+			invSlopes[k] = edges[k].x != 0.f ? -1.f / edges[k].x : 0.f;
+		}
+
+		for (int y = first.y; y <= last.y; y++) {
+			float fy = (float)y;
+			float spanMin = (float)first.x, spanMax = (float)last.x;
+
+			for (int k = 0; k < 3; k++) {
+				float rowValue = edges[k].y * fy + edges[k].z;
+
+				if (edges[k].x > 0.f) spanMin = glm::max(spanMin, rowValue * invSlopes[k]);
+				else if (edges[k].x < 0.f) spanMax = glm::min(spanMax, rowValue * invSlopes[k]);
+				else if (rowValue < 0.f) spanMax = -1.f;
+			}
+
+			if (!(spanMin <= spanMax)) continue;
+
+			int x0 = (int)glm::ceil(spanMin), x1 = (int)glm::floor(spanMax);
+
+			float* row = shadowMap.depth.data() + (size_t)y * shadowMap.resolution;
+			float rowDepth = depthPlane.y * fy + depthPlane.z;
+
+			for (int x = x0; x <= x1; x++) {
+				row[x] = glm::min(row[x], depthPlane.x * (float)x + rowDepth);
+			}
+		}
+	}
+}
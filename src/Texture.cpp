@@ -1,23 +1,15 @@
 #include "Texture.h"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
-
 #include "Application.h"
 #include "Framebuffer.h"
+#include "MipChain.h"
+#include "TextureFile.h"
+#include "TextureReadback.h"
+#include "TextureRegistry.h"
 #include "imgui.h"
 #include "UIHelpers.h"
 #include "Renderer.h"
 
-//std::map<GLuint, s_ptr<Texture>> Texture::_registry;
-
-/*
-std::map<GLuint, s_ptr<Texture>>& Texture::registry() {
-    static std::map<GLuint, s_ptr<Texture>> r;
-    return r;
-}
-*/
-
 /*
 s_ptr<Texture> Texture::createTexture(const std::string& filename) {
     if (auto tex = std::make_shared<Texture>(filename)) {
@@ -28,59 +20,299 @@ s_ptr<Texture> Texture::createTexture(const std::string& filename) {
 }
 */
 
-Texture::Texture(const std::string & fname) : filename(fname) {
-    //auto& reg = registry();
-    stbi_set_flip_vertically_on_load(1);
-    // load and generate the texture
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrChannels, 0);
-    if (data)
+// A future that has already resolved to value
+static std::shared_future<bool> resolved(bool value) {
+    std::promise<bool> promise;
+    promise.set_value(value);
+    return promise.get_future().share();
+}
+
+Texture::Texture(const std::string & fname, bool loadNow) : filename(fname) {
+    TextureRegistry::get().add(this);
+    glGenTextures(1, &id);
+
+    settings = getSettings(filename);
+
+    if (!loadNow) {
+        // Bound in place of the image until TextureLoader has uploaded it
+        const unsigned char white[4] = { 255, 255, 255, 255 };
+        beginUpload(uvec2(1), 4);
+        uploadRows(white, 0, 1);
+        finishUpload();
+        return;
+    }
+
+    // Texture files are uploaded straight from the mapped file, a call per level
+    if (TextureFile::isTextureFile(filename)) {
+        TextureFile file;
+        if (!file.open(filename)) {
+            ready = resolved(false);
+            return;
+        }
+
+        if (file.format == +BlockFormat::None || compressionSupported()) {
+            upload(file);
+            ready = resolved(true);
+            return;
+        }
+    }
+
+    // load the texture and its mips
+    MipChain chain;
+    if (chain.load(filename, settings))
+    {
+        auto& image = chain.levels[0];
+        beginUpload(uvec2(image.width, image.height), image.channels, (int)chain.levels.size(), chain.format, image.bytesPerChannel);
+        for (int level = 0; level < mipLevels; level++) {
+            uploadRows(chain.levels[level].pixels.data(), 0, chain.levels[level].height, level);
+        }
+        finishUpload();
+        ready = resolved(true);
+    }
+    else
     {
-        resolution = uvec2(width, height);
-        numChannels = nrChannels;
+        log("Failed to load texture from file {0}\n", filename);
+        ready = resolved(false);
+    }
+}
+
+// The GL internal format of each BlockFormat
+static GLenum getCompressedFormat(BlockFormat format, bool srgb) {
+    switch (format) {
+    case BlockFormat::BC1: return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+    case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+    case BlockFormat::BC7: return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default: return 0;
+    }
+}
+
+MipSettings Texture::getSettings(const std::string& filename) {
+    MipSettings settings = MipSettings::forFile(filename);
+    settings.compress = storagePolicy[settings.role] == +TextureStorage::Compressed && compressionSupported();
+    return settings;
+}
+
+bool Texture::compressionSupported() {
+    // RGTC (BC4 and BC5) is core since 3.0 and BPTC (BC7) since 4.2. S3TC (BC1) is an extension
+    // every desktop driver has.
+    return GLEW_EXT_texture_compression_s3tc && (GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc) &&
+        (GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc);
+}
+
+// Formats by number of channels
+static const GLenum pixelFormats[] = { GL_RGBA, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+static const GLenum fullFormats[] = { GL_RGBA8, GL_R32F, GL_RG8, GL_RGB8, GL_RGBA8 };
+static const GLenum compactFormats[] = { GL_RGBA8, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+
+void Texture::setFormat(uvec2 size, unsigned int channels, int levels, BlockFormat compressed, int bytes) {
+    resolution = size;
+    numChannels = channels;
+    mipLevels = levels;
+    compression = compressed;
+    bytesPerChannel = bytes;
+    generatedMips = false;
+
+    int index = glm::min(numChannels, 4u);
+    format = pixelFormats[index];
+    pixelDataType = bytesPerChannel == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+
+    // Images that were meant to be compressed and weren't (the driver can't sample the formats)
+    // take the compact formats instead
+    TextureRole role = settings.role;
+    storage = storagePolicy[role];
+    if (compression != +BlockFormat::None) {
+        storage = TextureStorage::Compressed;
+    }
+    else if (storage == +TextureStorage::Compressed) {
+        storage = TextureStorage::Compact;
+    }
+
+    srgb = false;
+
+    if (storage == +TextureStorage::Compressed) {
+        srgb = role == +TextureRole::Albedo && (compression == +BlockFormat::BC1 || compression == +BlockFormat::BC7);
+        internalFormat = getCompressedFormat(compression, srgb);
+    }
+    else if (storage == +TextureStorage::Full) {
+        internalFormat = fullFormats[index];
+    }
+    else if (role == +TextureRole::Albedo && numChannels >= 3) {
+        // The GPU decodes sRGB to linear before filtering, so mips and bilinear lookups blend in
+        // linear space
+        internalFormat = GL_SRGB8_ALPHA8;
+        srgb = true;
+    }
+    else if (role == +TextureRole::Normal && numChannels >= 2) {
+        // x and y only: the shader rebuilds z
+        internalFormat = GL_RG8;
+    }
+    else if (role == +TextureRole::Height || role == +TextureRole::Displacement) {
+        internalFormat = bytesPerChannel == 2 ? GL_R16 : GL_R8;
+    }
+    else {
+        internalFormat = compactFormats[index];
+    }
+
+    glBindTexture(bindTarget, id);
 
-        if (numChannels == 3) {
-            internalFormat = GL_RGB;
-            format = GL_RGB;
+    glTexParameteri(bindTarget, GL_TEXTURE_WRAP_S, wrapS._to_integral());
+    glTexParameteri(bindTarget, GL_TEXTURE_WRAP_T, wrapT._to_integral());
+    minFilter = TextureFilterMode::LinearMipMap;
+    glTexParameteri(bindTarget, GL_TEXTURE_MIN_FILTER, minFilter._to_integral());
+    glTexParameteri(bindTarget, GL_TEXTURE_MAG_FILTER, magFilter._to_integral());
+
+    glBindTexture(bindTarget, 0);
+}
+
+void Texture::upload(const TextureFile& file) {
+    setFormat(uvec2(file.width, file.height), file.channels, (int)file.levels.size(), file.format, file.bytesPerChannel);
+
+    glBindTexture(bindTarget, id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (int level = 0; level < mipLevels; level++) {
+        const TextureFile::Level& data = file.levels[level];
+        if (compression != +BlockFormat::None) {
+            glCompressedTexImage2D(bindTarget, lod + level, internalFormat, data.width, data.height, border,
+                (GLsizei)data.size, data.data);
+        }
+        else {
+            glTexImage2D(bindTarget, lod + level, internalFormat, data.width, data.height, border, format, pixelDataType, data.data);
         }
+    }
+
+    glTexParameteri(bindTarget, GL_TEXTURE_BASE_LEVEL, lod);
+    glTexParameteri(bindTarget, GL_TEXTURE_MAX_LEVEL, lod + mipLevels - 1);
+
+    glBindTexture(bindTarget, 0);
+}
 
-        if (numChannels == 1) {
-            internalFormat = GL_R32F;
-            format = GL_RED;
+void Texture::beginUpload(uvec2 size, unsigned int channels, int levels, BlockFormat compressed, int bytes) {
+    setFormat(size, channels, levels, compressed, bytes);
+
+    glBindTexture(bindTarget, id);
+
+    for (int level = 0; level < mipLevels; level++) {
+        uvec2 levelSize = glm::max(resolution >> uvec2(level), uvec2(1));
+        if (compression != +BlockFormat::None) {
+            glCompressedTexImage2D(bindTarget, lod + level, internalFormat, levelSize.x, levelSize.y, border,
+                (GLsizei)BlockCompression::compressedSize(compression, levelSize.x, levelSize.y), nullptr);
+        }
+        else {
+            glTexImage2D(bindTarget, lod + level, internalFormat, levelSize.x, levelSize.y, border, format, pixelDataType, nullptr);
         }
-        
-        glGenTextures(1, &id);
-        glBindTexture(bindTarget, id);
+    }
 
-        glTexParameteri(bindTarget, GL_TEXTURE_WRAP_S, wrapS._to_integral());
-        glTexParameteri(bindTarget, GL_TEXTURE_WRAP_T, wrapT._to_integral());
-        minFilter = TextureFilterMode::LinearMipMap;
-        glTexParameteri(bindTarget, GL_TEXTURE_MIN_FILTER, minFilter._to_integral());
-        glTexParameteri(bindTarget, GL_TEXTURE_MAG_FILTER, magFilter._to_integral());
+    glTexParameteri(bindTarget, GL_TEXTURE_BASE_LEVEL, lod + mipLevels - 1);
+    glTexParameteri(bindTarget, GL_TEXTURE_MAX_LEVEL, lod + mipLevels - 1);
 
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(bindTarget, 0);
+}
 
-        glTexImage2D(bindTarget, lod, internalFormat, width, height, border, format, pixelDataType, data);
-        glGenerateMipmap(bindTarget);
+void Texture::uploadRows(const unsigned char* pixels, GLuint firstRow, GLuint numRows, int level) {
+    GLuint levelWidth = glm::max(resolution.x >> level, 1u);
+    size_t rowSize = (size_t)levelWidth * numChannels * bytesPerChannel;
 
-        stbi_image_free(data);
-        data = nullptr;
+    glBindTexture(bindTarget, id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (compression != +BlockFormat::None) {
+        // Rows of blocks, 4 rows of texels each
+        size_t blockRowSize = BlockCompression::compressedSize(compression, levelWidth, 4);
+        size_t numBlockRows = (numRows + 3) / 4;
+
+        glCompressedTexSubImage2D(bindTarget, lod + level, 0, firstRow, levelWidth, numRows, internalFormat,
+            (GLsizei)(numBlockRows * blockRowSize), pixels + firstRow / 4 * blockRowSize);
     }
-    else
-    {
-        log("Failed to load texture from file {0}. Not adding texture to registry - check for memleak\n", filename);
+    else {
+        glTexSubImage2D(bindTarget, lod + level, 0, firstRow, levelWidth, numRows, format, pixelDataType,
+            pixels + firstRow * rowSize);
     }
 
     glBindTexture(bindTarget, 0);
 }
 
+void Texture::setBaseLevel(int level) {
+    glBindTexture(bindTarget, id);
+    glTexParameteri(bindTarget, GL_TEXTURE_BASE_LEVEL, lod + level);
+    glBindTexture(bindTarget, 0);
+}
+
+void Texture::finishUpload() {
+    glBindTexture(bindTarget, id);
+
+    glTexParameteri(bindTarget, GL_TEXTURE_BASE_LEVEL, lod);
+
+    if (mipLevels == 1 && compression == +BlockFormat::None) {
+        glTexParameteri(bindTarget, GL_TEXTURE_MAX_LEVEL, 1000);
+        glGenerateMipmap(bindTarget);
+        generatedMips = true;
+    }
+
+    glBindTexture(bindTarget, 0);
+}
+
+bool Texture::isReady() const {
+    return !ready.valid() || ready.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void Texture::touch() {
+    lastUsed = TextureRegistry::get().frame;
+}
+
+size_t Texture::bytesPerTexel(GLenum internalFormat) {
+    switch (internalFormat) {
+    case GL_R8: return 1;
+    case GL_RG8: case GL_R16: case GL_DEPTH_COMPONENT16: return 2;
+    case GL_RGB8: case GL_SRGB8: case GL_RGBA8: case GL_SRGB8_ALPHA8: case GL_R32F: case GL_DEPTH_COMPONENT24: return 4;
+    case GL_RGB32F: return 12;
+    case GL_RGBA32F: case GL_RGBA32I: return 16;
+    default: return 0;
+    }
+}
+
+// Bytes of a texture's levels stored in internalFormat, or compressed
+static size_t getChainSize(uvec2 resolution, int levels, BlockFormat compression, GLenum internalFormat) {
+    size_t total = 0;
+    for (int level = 0; level < levels; level++) {
+        uvec2 levelSize = glm::max(resolution >> uvec2(level), uvec2(1));
+        if (compression != +BlockFormat::None) {
+            total += BlockCompression::compressedSize(compression, levelSize.x, levelSize.y);
+        }
+        else {
+            total += (size_t)levelSize.x * levelSize.y * Texture::bytesPerTexel(internalFormat);
+        }
+    }
+    return total;
+}
+
+// Levels on the GPU, including the ones glGenerateMipmap made
+static int getLevelCount(const Texture& texture) {
+    if (!texture.generatedMips) {
+        return texture.mipLevels;
+    }
+    return 1 + (int)std::floor(std::log2((float)glm::max(glm::max(texture.resolution.x, texture.resolution.y), 1u)));
+}
+
+size_t Texture::memorySize() const {
+    return getChainSize(resolution, getLevelCount(*this), compression, internalFormat);
+}
+
+size_t Texture::fullSize() const {
+    if (framebuffer) {
+        return memorySize();
+    }
+    return getChainSize(resolution, getLevelCount(*this), BlockFormat::None, fullFormats[glm::min(numChannels, 4u)]);
+}
+
 Texture::Texture(Framebuffer* fb,  GBufferMode _usage, GLenum _attachment) 
-    : framebuffer(fb), usage(_usage), attachment(_attachment) {
+    : framebuffer(fb), attachment(_attachment), usage(_usage) {
     if (framebuffer) {
         resolution = framebuffer->resolution;
     }
-    //auto& reg = registry();
-    
+    TextureRegistry::get().add(this);
+
     glGenTextures(1, &id);
     glBindTexture(bindTarget, id);
 
@@ -99,7 +331,19 @@ Texture::Texture(Framebuffer* fb,  GBufferMode _usage, GLenum _attachment)
     glTexParameteri(bindTarget, GL_TEXTURE_MIN_FILTER, minFilter._to_integral());
     glTexParameteri(bindTarget, GL_TEXTURE_MAG_FILTER, magFilter._to_integral());
 
+    resizeStorage();
+}
+
+void Texture::resizeStorage() {
+    if (!framebuffer) return;
+
+    resolution = framebuffer->resolution;
+    glBindTexture(bindTarget, id);
+
     auto texDesc = textureDescriptions[usage];
+    internalFormat = texDesc.internalFormat;
+    format = texDesc.pixelDataFormat;
+    pixelDataType = texDesc.pixelDataType;
 
     glTexImage2D(bindTarget,
         0,
@@ -110,10 +354,14 @@ Texture::Texture(Framebuffer* fb,  GBufferMode _usage, GLenum _attachment)
         texDesc.pixelDataType,
         nullptr);
 
+    // The old buffer goes back to the pool first, so a resize within its size class reuses it
+    memory.reset();
     memory = std::make_shared<TextureMemory>(texDesc.pixelDataType, resolution.x, resolution.y, texDesc.stride);
 }
 
 Texture::~Texture() {
+    TextureRegistry::get().remove(this);
+
     if (framebuffer && framebuffer->textures.size() > 0) {
         for (auto it = framebuffer->textures.begin(); it != framebuffer->textures.end();) {
             if ((*it)->id == id) {
@@ -136,17 +384,30 @@ Texture::~Texture() {
 void Texture::renderUI() {
     ImGui::PushID((const void*)this);
 
-    auto label = fmt::format("Texture {0} {1}", id, filename);
+    auto label = fmt::format("Texture {0} {1}{2}", id, filename, isReady() ? "" : " (loading)");
 
     if (ImGui::CollapsingHeader(label.c_str())) {
         if (ImGui::Button("Delete texture")) {
-            auto texID = id;
-            /*Application::get().addCommand([texID]() {
+            /*Application::get().addCommand([texID = id]() {
                 TextureRegistry::removeTexture(texID);
             });*/
         }
         ImGui::Text("Texture ID: %u, Resolution: %u x %u (%u channels)", id, resolution.x, resolution.y, numChannels);
-        ImGui::Text("Size in MB: %.4f", (resolution.x * resolution.y * numChannels) / (1024.f * 1024.f));
+        if (!framebuffer) {
+            ImGui::Text("Role: %s, storage: %s%s", settings.role._to_string(), storage._to_string(), srgb ? " (sRGB)" : "");
+        }
+        if (compression != +BlockFormat::None) {
+            ImGui::Text("Compression: %s", compression._to_string());
+        }
+        if (droppedLevels > 0) {
+            ImGui::Text("Largest %d mip level(s) dropped to stay within the texture budget", droppedLevels);
+        }
+        ImGui::Text("Size in MB: %.4f, mip levels included (%.4f with full storage)", memorySize() / (1024.f * 1024.f),
+            fullSize() / (1024.f * 1024.f));
+
+        if (memory && ImGui::Button("Read back to memory")) {
+            copyToMemoryAsync();
+        }
 
         renderEnumDropDown<TextureWrapMode>("Wrap S", wrapS);
         renderEnumDropDown<TextureWrapMode>("Wrap T", wrapT);
@@ -154,6 +415,7 @@ void Texture::renderUI() {
         renderEnumDropDown<TextureFilterMode>("Min Filter", minFilter);
         renderEnumDropDown<TextureFilterMode>("Mag Filter", magFilter);
         ImGui::Image(reinterpret_cast<ImTextureID>(id), ImVec2(resolution.x, resolution.y));
+        touch();
     }
     
 
@@ -168,7 +430,7 @@ void Texture::copyToMemory()
             glFinish();
             glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer->framebuffer);
             glReadBuffer(attachment);
-            glReadPixels(0, 0, resolution.x, resolution.y, GL_RGBA, memory->type, memory->value);
+            glReadPixels(0, 0, resolution.x, resolution.y, format, memory->type, memory->value);
             glReadBuffer(GL_COLOR_ATTACHMENT0);
             glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
             
@@ -185,15 +447,78 @@ void Texture::copyToMemory()
     }
 }
 
+std::shared_future<bool> Texture::copyToMemoryAsync(ivec4 rect) {
+    return TextureReadback::get().read(shared_from_this(), rect);
+}
+
 vec4 Texture::getColor(ivec2 pos) {
-    vec4 result = vec4(0.f);
-    if (memory) {
-        if (!memory->read((GLvoid*)glm::value_ptr(result), pos.x, pos.y, sizeof(vec4))) {
-            log("Unable to read texture {0} at location {1}, {2}\n", id, pos.x, pos.y);
+    std::vector<vec4> result;
+    if (memory && !memory->readColors(ivec4(pos, 1, 1), result)) {
+        log("Unable to read texture {0} at location {1}, {2}\n", id, pos.x, pos.y);
+    }
+
+    return result.empty() ? vec4(0.f) : result[0];
+}
+
+bool Texture::getColors(ivec4 rect, std::vector<vec4>& result) {
+    result.clear();
+    return memory && memory->readColors(rect, result);
+}
+
+size_t Texture::getColors(const std::vector<ivec2>& points, std::vector<vec4>& result) {
+    result.clear();
+    if (!memory) {
+        result.assign(points.size(), vec4(0.f));
+        return 0;
+    }
+    return memory->readColors(points, result);
+}
+
+template<typename T>
+static void toColors(TexelSpan<T> texels, vec4* colors) {
+    GLuint channels = glm::min(texels.stride, 4u);
+    for (size_t i = 0; i < texels.count; i++) {
+        const T* texel = texels[i];
+        vec4 color(0.f, 0.f, 0.f, 1.f);
+        for (GLuint c = 0; c < channels; c++) {
+            color[c] = (float)texel[c];
         }
+        colors[i] = color;
+    }
+}
+
+template<typename T>
+static void toColors(const TextureMemory& memory, ivec4 rect, std::vector<vec4>& result) {
+    for (int y = 0; y < rect.w; y++) {
+        toColors(memory.row<T>(rect.x, rect.y + y, rect.z), result.data() + (size_t)y * rect.z);
     }
+}
+
+bool TextureMemory::readColors(ivec4 rect, std::vector<vec4>& result) const {
+    if (!value || !contains(rect)) return false;
+
+    result.resize((size_t)rect.z * rect.w);
+
+    if (holds<GLfloat>()) toColors<GLfloat>(*this, rect, result);
+    else if (holds<GLint>()) toColors<GLint>(*this, rect, result);
+    else return false;
 
-    return result;
+    return true;
+}
+
+size_t TextureMemory::readColors(const std::vector<ivec2>& points, std::vector<vec4>& result) const {
+    result.assign(points.size(), vec4(0.f));
+    if (!holds<GLfloat>() && !holds<GLint>()) return 0;
+
+    size_t inside = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (holds<GLfloat>()) toColors(row<GLfloat>(points[i].x, points[i].y, 1), &result[i]);
+        else toColors(row<GLint>(points[i].x, points[i].y, 1), &result[i]);
+
+        if (points[i].x >= 0 && points[i].y >= 0 && points[i].x < (int)width && points[i].y < (int)height) inside++;
+    }
+
+    return inside;
 }
 
 // Default texture descriptions for each gbuffer channel. Argument order is
@@ -233,4 +558,14 @@ std::map<GBufferMode, TextureDescription> Texture::textureDescriptions =
     { GBufferMode::PrimitiveData, primitiveDataTextureDescription },
 	{ GBufferMode::Depth, depthTextureDescription },
     { GBufferMode::Shadow, shadowTextureDescription },
+};
+
+std::map<TextureRole, TextureStorage> Texture::storagePolicy =
+{
+    { TextureRole::Albedo, TextureStorage::Compressed },
+    { TextureRole::Normal, TextureStorage::Compressed },
+    { TextureRole::Height, TextureStorage::Compressed },
+    // Displacement moves geometry, where BC4's steps show as ridges
+    { TextureRole::Displacement, TextureStorage::Compact },
+    { TextureRole::Data, TextureStorage::Compressed },
 };
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include "TextureAtlas.h"
+
+#include "JobSystem.h"
+#include "MipChain.h"
+
+#include <algorithm>
+
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+
+TextureAtlas::~TextureAtlas()
+{
+	clear();
+}
+
+void TextureAtlas::clear()
+{
+	if (id) {
+		glDeleteTextures(1, &id);
+	}
+
+	id = 0;
+	resolution = ivec2(0);
+	layers = 0;
+	mipLevels = 0;
+	entries.clear();
+}
+
+int TextureAtlas::find(const std::string& filename) const
+{
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (entries[i].filename == filename) return (int)i;
+	}
+	return -1;
+}
+
+size_t TextureAtlas::memorySize() const
+{
+	size_t total = 0;
+	for (int level = 0; level < mipLevels; level++) {
+		ivec2 size = glm::max(resolution >> level, ivec2(1));
+		total += (size_t)size.x * size.y * layers * 4;
+	}
+	return total;
+}
+
+static int wrap(int i, int size)
+{
+	i %= size;
+	return i < 0 ? i + size : i;
+}
+
+// Copies an image into a layer of RGBA texels with its first texel at origin, repeating it for
+// padding texels past every edge. Gray goes to all three colors, and alpha is opaque unless the
+// image has one.
+static void copyImage(const ImageIO::DecodedImage& image, unsigned char* layer, int layerWidth, ivec2 origin, int padding)
+{
+	for (int y = -padding; y < image.height + padding; y++) {
+		unsigned char* row = layer + ((size_t)(origin.y + y) * layerWidth + origin.x) * 4;
+		const unsigned char* sourceRow = image.pixels.data() + (size_t)wrap(y, image.height) * image.width * image.channels;
+
+		for (int x = -padding; x < image.width + padding; x++) {
+			const unsigned char* source = sourceRow + (size_t)wrap(x, image.width) * image.channels;
+			unsigned char* texel = row + (ptrdiff_t)x * 4;
+
+			if (image.channels >= 3) {
+				texel[0] = source[0];
+				texel[1] = source[1];
+				texel[2] = source[2];
+			}
+			else {
+				texel[0] = texel[1] = texel[2] = source[0];
+			}
+
+			texel[3] = image.channels == 2 ? source[1] : (image.channels == 4 ? source[3] : 255);
+		}
+	}
+}
+
+bool TextureAtlas::build(const std::vector<std::string>& filenames)
+{
+	clear();
+
+	if (filenames.empty()) return true;
+
+	int count = (int)filenames.size();
+
+	// Colors, uncompressed: the layers are put together texel by texel
+	std::vector<MipChain> chains(count);
+	std::vector<char> loaded(count, 0);
+
+	// Logged below rather than from the job threads
+	std::vector<std::string> errors(count);
+
+	JobSystem::get().parallelFor(0, count, 1, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			loaded[i] = chains[i].load(filenames[i], MipSettings::forRole(TextureRole::Albedo), &errors[i]);
+		}
+	});
+
+	for (int i = 0; i < count; i++) {
+		if (!errors[i].empty()) {
+			log("{0}", errors[i]);
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (!loaded[i] || chains[i].levels.empty()) {
+			log("Unable to add {0} to the texture atlas\n", filenames[i]);
+			clear();
+			return false;
+		}
+
+		Entry entry;
+		entry.filename = filenames[i];
+		entry.size = ivec2(chains[i].levels[0].width, chains[i].levels[0].height);
+		entries.push_back(entry);
+	}
+
+	// Where each image's first texel goes in its layer
+	std::vector<ivec2> origins(count, ivec2(0));
+
+	bool sameSize = std::all_of(entries.begin(), entries.end(), [&](const Entry& e) { return e.size == entries[0].size; });
+
+	int imagePadding = 0;
+
+	if (sameSize) {
+		resolution = entries[0].size;
+		layers = count;
+		mipLevels = (int)chains[0].levels.size();
+
+		for (int i = 0; i < count; i++) {
+			entries[i].layer = i;
+		}
+	}
+	else {
+		imagePadding = padding;
+		resolution = ivec2(layerSize);
+		mipLevels = 1 + (int)std::log2(padding);
+
+		auto roundUp = [](int size) { return (size + padding - 1) / padding * padding; };
+
+		std::vector<stbrp_rect> remaining;
+		for (int i = 0; i < count; i++) {
+			stbrp_rect rect = {};
+			rect.id = i;
+			rect.w = roundUp(entries[i].size.x + 2 * padding);
+			rect.h = roundUp(entries[i].size.y + 2 * padding);
+
+			if (rect.w > layerSize || rect.h > layerSize) {
+				log("{0} ({1}x{2}) doesn't fit in the {3}x{3} layers of the texture atlas\n", filenames[i],
+					entries[i].size.x, entries[i].size.y, layerSize);
+				clear();
+				return false;
+			}
+
+			remaining.push_back(rect);
+		}
+
+		// Each pass fills a new layer with what still fits. Every image fits in an empty layer, so
+		// each pass places at least one.
+		std::vector<stbrp_node> nodes(layerSize);
+		while (!remaining.empty()) {
+			stbrp_context context;
+			stbrp_init_target(&context, layerSize, layerSize, nodes.data(), (int)nodes.size());
+			stbrp_pack_rects(&context, remaining.data(), (int)remaining.size());
+
+			std::vector<stbrp_rect> next;
+			for (const stbrp_rect& rect : remaining) {
+				if (rect.was_packed) {
+					entries[rect.id].layer = layers;
+					origins[rect.id] = ivec2(rect.x, rect.y) + padding;
+				}
+				else {
+					next.push_back(rect);
+				}
+			}
+
+			remaining.swap(next);
+			layers++;
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		entries[i].rect = vec4(vec2(origins[i]) / vec2(resolution), vec2(entries[i].size) / vec2(resolution));
+	}
+
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	// sRGB like the compact albedo format, so filtering happens in linear space
+	std::vector<unsigned char> texels;
+	for (int level = 0; level < mipLevels; level++) {
+		ivec2 size = glm::max(resolution >> level, ivec2(1));
+		size_t layerBytes = (size_t)size.x * size.y * 4;
+		texels.assign(layerBytes * layers, 0);
+
+		JobSystem::get().parallelFor(0, count, 1, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				const auto& levels = chains[i].levels;
+				const ImageIO::DecodedImage& image = levels[glm::min(level, (int)levels.size() - 1)];
+				copyImage(image, texels.data() + layerBytes * entries[i].layer, size.x, origins[i] >> level,
+					imagePadding >> level);
+			}
+		});
+
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_SRGB8_ALPHA8, size.x, size.y, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+			texels.data());
+	}
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, sameSize ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, sameSize ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	return true;
+}
@@ -0,0 +1,276 @@
+#include "TextureFile.h"
+
+#include "MipChain.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char* TextureFile::extension = ".tex";
+
+static const uint32_t fileVersion = 2;
+
+// Level data starts on multiples of this, which suits both GL's unpack alignment and SSE loads
+static const size_t levelAlignment = 16;
+
+TextureFile::~TextureFile()
+{
+	close();
+}
+
+bool TextureFile::isTextureFile(const std::string& filename)
+{
+	std::string fileExtension = std::filesystem::path(filename).extension().string();
+	std::transform(fileExtension.begin(), fileExtension.end(), fileExtension.begin(), ::tolower);
+	return fileExtension == extension;
+}
+
+bool TextureFile::map(const std::string& filename)
+{
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* view = fileMapping ? MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view) {
+		if (fileMapping) CloseHandle(fileMapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = fileMapping;
+	mapping = (const unsigned char*)view;
+	mappingSize = (size_t)size.QuadPart;
+#else
+	int file = ::open(filename.c_str(), O_RDONLY);
+	if (file < 0) return false;
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size == 0) {
+		::close(file);
+		return false;
+	}
+
+	void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+	// The mapping keeps the file alive on its own
+	::close(file);
+
+	if (view == MAP_FAILED) return false;
+
+	mapping = (const unsigned char*)view;
+	mappingSize = (size_t)status.st_size;
+#endif
+
+	return true;
+}
+
+void TextureFile::close()
+{
+	if (mapping) {
+#if defined(_WIN32)
+		UnmapViewOfFile(mapping);
+		CloseHandle((HANDLE)mappingHandle);
+		CloseHandle((HANDLE)fileHandle);
+		mappingHandle = nullptr;
+		fileHandle = nullptr;
+#else
+		munmap((void*)mapping, mappingSize);
+#endif
+	}
+
+	mapping = nullptr;
+	mappingSize = 0;
+	levels.clear();
+}
+
+// Reads values one after the other out of the mapping, failing once past its end
+struct MappedReader {
+	const unsigned char* data;
+	size_t size;
+	size_t position = 0;
+
+	template <typename T>
+	bool read(T& value)
+	{
+		if (position + sizeof(T) > size) return false;
+		memcpy(&value, data + position, sizeof(T));
+		position += sizeof(T);
+		return true;
+	}
+};
+
+bool TextureFile::parse(const std::string& filename, std::string* error)
+{
+	MappedReader reader{ mapping, mappingSize };
+
+	char magic[4];
+	uint32_t version = 0;
+	int32_t header[6];
+	uint32_t sourceLength = 0;
+
+	if (!reader.read(magic) || memcmp(magic, "TEXF", 4) != 0) {
+		report(error, "{0} isn't a texture file\n", filename);
+		return false;
+	}
+
+	if (!reader.read(version) || version != fileVersion) {
+		report(error, "{0} is a texture file of an unknown version\n", filename);
+		return false;
+	}
+
+	if (!reader.read(header) || !reader.read(sourceLength) || reader.position + sourceLength > mappingSize) {
+		report(error, "{0} is cut short\n", filename);
+		return false;
+	}
+
+	width = header[0];
+	height = header[1];
+	channels = header[2];
+	int numLevels = header[4];
+	bytesPerChannel = header[5];
+
+	if (width <= 0 || height <= 0 || channels <= 0 || channels > 4 || !BlockFormat::_is_valid(header[3]) ||
+		numLevels <= 0 || numLevels > 32 || bytesPerChannel < 1 || bytesPerChannel > 2) {
+		report(error, "{0} has an invalid header\n", filename);
+		return false;
+	}
+
+	format = BlockFormat::_from_integral(header[3]);
+	source.assign((const char*)mapping + reader.position, sourceLength);
+	reader.position += sourceLength;
+
+	levels.resize(numLevels);
+	for (int l = 0; l < numLevels; l++) {
+		Level& level = levels[l];
+		uint64_t offset = 0, size = 0;
+
+		level.width = glm::max(width >> l, 1);
+		level.height = glm::max(height >> l, 1);
+
+		size_t expected = format == +BlockFormat::None ? (size_t)level.width * level.height * channels * bytesPerChannel :
+			BlockCompression::compressedSize(format, level.width, level.height);
+
+		if (!reader.read(offset) || !reader.read(size) || size != expected || offset > mappingSize || size > mappingSize - offset) {
+			report(error, "{0} has an invalid level table\n", filename);
+			return false;
+		}
+
+		level.data = mapping + offset;
+		level.size = (size_t)size;
+	}
+
+	return true;
+}
+
+bool TextureFile::open(const std::string& filename, std::string* error)
+{
+	close();
+
+	if (!map(filename)) {
+		report(error, "Unable to map {0}\n", filename);
+		return false;
+	}
+
+	if (!parse(filename, error)) {
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+template <typename T>
+static void writeValue(std::ofstream& out, const T& value)
+{
+	out.write((const char*)&value, sizeof(T));
+}
+
+bool TextureFile::write(const std::string& filename, const MipChain& chain, const std::string& source,
+	std::string* error)
+{
+	if (chain.levels.empty()) return false;
+
+	const ImageIO::DecodedImage& image = chain.levels[0];
+
+	// Everything up to the first level, so the offsets are known before writing
+	size_t headerSize = 4 + sizeof(uint32_t) + 6 * sizeof(int32_t) + sizeof(uint32_t) + source.size() +
+		chain.levels.size() * 2 * sizeof(uint64_t);
+
+	std::vector<uint64_t> offsets;
+	size_t offset = headerSize;
+	for (auto& level : chain.levels) {
+		offset = (offset + levelAlignment - 1) / levelAlignment * levelAlignment;
+		offsets.push_back(offset);
+		offset += level.pixels.size();
+	}
+
+	std::string temporary = fmt::format("{0}.{1}.tmp", filename, std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+	{
+		std::ofstream out(temporary, std::ios::binary);
+		if (!out) {
+			report(error, "Unable to write the texture file {0}\n", filename);
+			return false;
+		}
+
+		int32_t header[6] = { image.width, image.height, image.channels, chain.format._to_integral(), (int32_t)chain.levels.size(),
+			image.bytesPerChannel };
+
+		out.write("TEXF", 4);
+		writeValue(out, fileVersion);
+		writeValue(out, header);
+		writeValue(out, (uint32_t)source.size());
+		out.write(source.data(), source.size());
+
+		for (size_t l = 0; l < chain.levels.size(); l++) {
+			writeValue(out, offsets[l]);
+			writeValue(out, (uint64_t)chain.levels[l].pixels.size());
+		}
+
+		for (size_t l = 0; l < chain.levels.size(); l++) {
+			static const char padding[levelAlignment] = {};
+			out.write(padding, offsets[l] - (uint64_t)out.tellp());
+			out.write((const char*)chain.levels[l].pixels.data(), chain.levels[l].pixels.size());
+		}
+
+		if (!out) {
+			report(error, "Unable to write the texture file {0}\n", filename);
+			out.close();
+			std::error_code removeError;
+			std::filesystem::remove(temporary, removeError);
+			return false;
+		}
+	}
+
+	std::error_code renameError;
+	std::filesystem::rename(temporary, filename, renameError);
+	if (renameError) {
+		std::filesystem::remove(temporary, renameError);
+		return false;
+	}
+
+	return true;
+}
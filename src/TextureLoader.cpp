@@ -0,0 +1,168 @@
+#include "TextureLoader.h"
+
+#include "Texture.h"
+
+TextureLoader& TextureLoader::get()
+{
+	static TextureLoader loader;
+	return loader;
+}
+
+s_ptr<Texture> TextureLoader::load(const std::string& filename)
+{
+	return load(filename, Texture::getSettings(filename));
+}
+
+s_ptr<Texture> TextureLoader::load(const std::string& filename, MipSettings settings)
+{
+	auto request = std::make_shared<Request>();
+	request->settings = settings;
+	request->texture = std::make_shared<Texture>(filename, false);
+	request->texture->settings = settings;
+
+	start(request);
+
+	return request->texture;
+}
+
+void TextureLoader::reload(s_ptr<Texture> texture, int droppedLevels)
+{
+	auto request = std::make_shared<Request>();
+	request->settings = texture->settings;
+	request->texture = texture;
+	request->firstLevel = droppedLevels;
+
+	start(request);
+}
+
+void TextureLoader::start(s_ptr<Request> request)
+{
+	request->texture->ready = request->promise.get_future().share();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		numPending++;
+	}
+
+	decodes.run([this, request]() {
+		request->decoded = request->chain.load(request->texture->filename, request->settings, &request->error, &request->file);
+
+		// A smaller chain than asked for (the file changed) keeps at least its last level
+		if (request->decoded) {
+			request->firstLevel = glm::min(request->firstLevel, request->numLevels() - 1);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		decoded.push_back(request);
+	});
+}
+
+void TextureLoader::update()
+{
+	// Without worker threads nobody else runs the decodes, so do one a frame here
+	if (JobSystem::get().threadCount() == 1) {
+		JobSystem::get().runOne();
+	}
+
+	_time start = _clock::now();
+
+	do {
+		s_ptr<Request> request;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (decoded.empty()) return;
+			request = decoded.front();
+		}
+
+		Texture& texture = *request->texture;
+
+		if (!request->error.empty()) {
+			log("{0}", request->error);
+			request->error.clear();
+		}
+
+		bool finished = !request->decoded;
+
+		if (request->decoded) {
+			// Smallest level first, so the texture shows a blurry version of the image almost at
+			// once and sharpens as the larger levels arrive
+			// Levels on the GPU, which start at the chain's firstLevel
+			int numLevels = request->numLevels() - request->firstLevel;
+			int level = numLevels - 1 - request->level;
+			TextureFile::Level image = request->getLevel(request->firstLevel + level);
+
+			bool mapped = !request->file.levels.empty();
+			int channels = mapped ? request->file.channels : request->chain.levels[0].channels;
+			int bytesPerChannel = mapped ? request->file.bytesPerChannel : request->chain.levels[0].bytesPerChannel;
+
+			if (request->level == 0 && request->uploadedRows == 0) {
+				TextureFile::Level largest = request->getLevel(request->firstLevel);
+				texture.beginUpload(uvec2(largest.width, largest.height), channels, numLevels, request->chain.format,
+					bytesPerChannel);
+				texture.droppedLevels = request->firstLevel;
+			}
+
+			// Compressed images go up in whole rows of blocks
+			int rowStep = request->chain.format == +BlockFormat::None ? 1 : 4;
+			size_t rowSize = request->chain.format == +BlockFormat::None ? (size_t)image.width * channels * bytesPerChannel :
+				BlockCompression::compressedSize(request->chain.format, image.width, 4) / 4;
+
+			int numRows = (int)glm::max<size_t>(stripSize / glm::max<size_t>(1, rowSize) / rowStep, 1) * rowStep;
+			numRows = glm::min(numRows, image.height - request->uploadedRows);
+
+			texture.uploadRows(image.data, request->uploadedRows, numRows, level);
+			request->uploadedRows += numRows;
+
+			if (request->uploadedRows == image.height) {
+				request->level++;
+				request->uploadedRows = 0;
+
+				if (request->level == numLevels) {
+					texture.finishUpload();
+					finished = true;
+				}
+				else {
+					texture.setBaseLevel(level);
+				}
+			}
+		}
+		else {
+			log("Failed to load texture from file {0}\n", texture.filename);
+		}
+
+		if (finished) {
+			request->promise.set_value(request->decoded);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			decoded.pop_front();
+			numPending--;
+		}
+	} while (_elapsed(_clock::now() - start).count() < uploadBudget);
+}
+
+int TextureLoader::Request::numLevels() const
+{
+	return file.levels.empty() ? (int)chain.levels.size() : (int)file.levels.size();
+}
+
+TextureFile::Level TextureLoader::Request::getLevel(int l) const
+{
+	if (!file.levels.empty()) {
+		return file.levels[l];
+	}
+
+	const ImageIO::DecodedImage& image = chain.levels[l];
+
+	TextureFile::Level level;
+	level.width = image.width;
+	level.height = image.height;
+	level.data = image.pixels.data();
+	level.size = image.pixels.size();
+	return level;
+}
+
+size_t TextureLoader::pending() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return numPending;
+}
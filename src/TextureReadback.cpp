@@ -0,0 +1,199 @@
+#include "TextureReadback.h"
+
+#include "Framebuffer.h"
+#include "Texture.h"
+
+#include <cstring>
+
+TextureReadback& TextureReadback::get()
+{
+	static TextureReadback readback;
+	return readback;
+}
+
+bool TextureReadback::supported()
+{
+	return GLEW_VERSION_3_2 || GLEW_ARB_sync;
+}
+
+static std::shared_future<bool> resolved(bool value)
+{
+	std::promise<bool> promise;
+	promise.set_value(value);
+	return promise.get_future().share();
+}
+
+std::shared_future<bool> TextureReadback::read(s_ptr<Texture> texture, ivec4 rect, s_ptr<TextureMemory> destination)
+{
+	if (!texture || !texture->memory) return resolved(false);
+
+	if (rect.z == 0 || rect.w == 0) {
+		rect = ivec4(0, 0, texture->memory->width, texture->memory->height);
+	}
+
+	if (destination && (destination->width != texture->memory->width || destination->height != texture->memory->height ||
+		destination->type != texture->memory->type || destination->stride != texture->memory->stride)) {
+		log("Texture readback destination doesn't match the memory of texture {0}\n", texture->id);
+		return resolved(false);
+	}
+
+	if (!supported()) {
+		texture->copyToMemory();
+		if (destination) {
+			memcpy(destination->value, texture->memory->value, destination->size);
+		}
+		return resolved(true);
+	}
+
+	auto request = std::make_shared<Request>();
+	request->texture = texture;
+	request->rect = rect;
+	request->memory = destination;
+	request->frame = frame;
+	auto future = request->promise.get_future().share();
+
+	if ((int)slots.size() < ringSize) {
+		slots.resize(ringSize);
+	}
+
+	// Issued right away when a buffer is free, so the pixels arrive as early as they can
+	for (Slot& slot : slots) {
+		if (!slot.request) {
+			issue(slot, request);
+			return future;
+		}
+	}
+
+	queued.push_back(request);
+	return future;
+}
+
+bool TextureReadback::issue(Slot& slot, s_ptr<Request> request)
+{
+	s_ptr<Texture> texture = request->texture.lock();
+	ivec4 rect = request->rect;
+
+	if (!texture || !texture->memory || (request->memory && request->memory->width != texture->memory->width) ||
+		(request->memory && request->memory->height != texture->memory->height) || rect.x < 0 || rect.y < 0 || rect.z <= 0 || rect.w <= 0 ||
+		rect.x + rect.z > (int)texture->memory->width || rect.y + rect.w > (int)texture->memory->height) {
+		request->promise.set_value(false);
+		return false;
+	}
+
+	if (!request->memory) {
+		request->memory = texture->memory;
+	}
+	request->wholeImage = !texture->framebuffer;
+
+	const TextureMemory& memory = *request->memory;
+	size_t unitSize = memory.stride * memory.typeSize;
+	size_t size = request->wholeImage ? memory.size : (size_t)rect.z * rect.w * unitSize;
+
+	if (!slot.buffer) {
+		glGenBuffers(1, &slot.buffer);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	if (slot.capacity < size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+		slot.capacity = size;
+	}
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	// With a pack buffer bound the pointers are offsets into it
+	if (texture->framebuffer) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, texture->framebuffer->framebuffer);
+		bool color = texture->attachment >= GL_COLOR_ATTACHMENT0 && texture->attachment < GL_COLOR_ATTACHMENT0 + Framebuffer::maxTextures;
+		if (color) glReadBuffer(texture->attachment);
+		glReadPixels(rect.x, rect.y, rect.z, rect.w, texture->format, memory.type, nullptr);
+		if (color) glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	}
+	else {
+		glBindTexture(texture->bindTarget, texture->id);
+		glGetTexImage(texture->bindTarget, 0, texture->format, memory.type, nullptr);
+		glBindTexture(texture->bindTarget, 0);
+	}
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.request = request;
+
+	return true;
+}
+
+void TextureReadback::finish(Slot& slot)
+{
+	s_ptr<Request> request = slot.request;
+	TextureMemory& memory = *request->memory;
+	ivec4 rect = request->rect;
+
+	size_t unitSize = memory.stride * memory.typeSize;
+	size_t rowSize = (size_t)rect.z * unitSize;
+	size_t size = request->wholeImage ? memory.size : rowSize * rect.w;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+	if (pixels) {
+		// Rows of the rect within the memory's (and, for whole images, the buffer's) full rows
+		size_t sourceStride = request->wholeImage ? memory.width * unitSize : rowSize;
+		const unsigned char* source = pixels + (request->wholeImage ? rect.y * sourceStride + rect.x * unitSize : 0);
+
+		for (int y = 0; y < rect.w; y++) {
+			unsigned char* destination = (unsigned char*)memory.value + ((size_t)(rect.y + y) * memory.width + rect.x) * unitSize;
+			memcpy(destination, source + y * sourceStride, rowSize);
+		}
+
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else {
+		log("Unable to map a texture readback buffer\n");
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+	slot.request = nullptr;
+
+	double latency = (double)(frame - request->frame);
+	averageLatency = averageLatency == 0.0 ? latency : glm::mix(averageLatency, latency, 0.1);
+
+	request->promise.set_value(pixels != nullptr);
+}
+
+void TextureReadback::update()
+{
+	frame++;
+
+	for (Slot& slot : slots) {
+		if (!slot.fence) continue;
+
+		GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+			finish(slot);
+		}
+	}
+
+	for (Slot& slot : slots) {
+		// Requests for textures that are gone don't take the slot
+		while (!slot.request && !queued.empty()) {
+			s_ptr<Request> request = queued.front();
+			queued.pop_front();
+			issue(slot, request);
+		}
+	}
+}
+
+size_t TextureReadback::pending() const
+{
+	size_t count = queued.size();
+	for (const Slot& slot : slots) {
+		if (slot.request) count++;
+	}
+	return count;
+}
@@ -0,0 +1,113 @@
+#include "TextureRegistry.h"
+
+#include "Texture.h"
+#include "TextureLoader.h"
+
+#include "imgui.h"
+
+#include <algorithm>
+
+TextureRegistry& TextureRegistry::get()
+{
+	// Never destroyed: textures owned by other statics unregister themselves on the way out,
+	// possibly after a static registry would have been destroyed
+	static TextureRegistry* registry = new TextureRegistry();
+	return *registry;
+}
+
+void TextureRegistry::add(Texture* texture)
+{
+	textures.push_back(texture);
+}
+
+void TextureRegistry::remove(Texture* texture)
+{
+	textures.erase(std::remove(textures.begin(), textures.end(), texture), textures.end());
+}
+
+size_t TextureRegistry::imageBytes() const
+{
+	size_t total = 0;
+	for (Texture* texture : textures) {
+		if (!texture->framebuffer) total += texture->memorySize();
+	}
+	return total;
+}
+
+size_t TextureRegistry::framebufferBytes() const
+{
+	size_t total = 0;
+	for (Texture* texture : textures) {
+		if (texture->framebuffer) total += texture->memorySize();
+	}
+	return total;
+}
+
+void TextureRegistry::update()
+{
+	frame++;
+
+	// Only textures from files can be reloaded, and only once their last load has finished
+	std::vector<Texture*> reloadable;
+	for (Texture* texture : textures) {
+		if (!texture->framebuffer && !texture->filename.empty() && texture->isReady()) {
+			reloadable.push_back(texture);
+		}
+	}
+
+	// Textures bound since the last update get their levels back
+	for (Texture* texture : reloadable) {
+		if (texture->droppedLevels > 0 && texture->lastUsed + 1 >= frame) {
+			TextureLoader::get().reload(texture->shared_from_this(), 0);
+		}
+	}
+
+	if (budget == 0) return;
+
+	size_t total = imageBytes();
+	if (total <= budget) return;
+
+	std::sort(reloadable.begin(), reloadable.end(), [](Texture* a, Texture* b) { return a->lastUsed < b->lastUsed; });
+
+	for (Texture* texture : reloadable) {
+		if (total <= budget) break;
+
+		// Textures that were never touched may be in use somewhere that doesn't track it
+		bool idle = texture->lastUsed > 0 && texture->lastUsed + idleFrames < frame;
+		if (!idle || texture->mipLevels <= 1 || texture->droppedLevels >= maxDroppedLevels) continue;
+
+		// The level below the largest is a quarter of its size, so the rest of the chain is too
+		size_t size = texture->memorySize();
+		total -= size - size / 4;
+
+		TextureLoader::get().reload(texture->shared_from_this(), texture->droppedLevels + 1);
+	}
+}
+
+void TextureRegistry::renderUI()
+{
+	const double megabyte = 1024.0 * 1024.0;
+
+	ImGui::Text("Texture memory: %.2f MB in %zu textures (images %.2f MB, framebuffers %.2f MB)",
+		(imageBytes() + framebufferBytes()) / megabyte, textures.size(), imageBytes() / megabyte, framebufferBytes() / megabyte);
+
+	size_t fullBytes = 0;
+	for (Texture* texture : textures) {
+		if (!texture->framebuffer) fullBytes += texture->fullSize();
+	}
+	if (fullBytes > 0) {
+		double saved = (double)fullBytes - (double)imageBytes();
+		ImGui::Text("Storage formats save %.2f MB (%.0f%%) over full storage", saved / megabyte, 100.0 * saved / fullBytes);
+	}
+
+	int budgetMB = (int)(budget / (1024 * 1024));
+	if (ImGui::InputInt("Texture budget (MB, 0 for none)", &budgetMB)) {
+		budget = (size_t)glm::max(0, budgetMB) * 1024 * 1024;
+	}
+
+	int dropped = 0;
+	for (Texture* texture : textures) {
+		if (texture->droppedLevels > 0) dropped++;
+	}
+	ImGui::Text("Textures with dropped mip levels: %d", dropped);
+}
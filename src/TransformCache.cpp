@@ -0,0 +1,164 @@
+#include "TransformCache.h"
+
+#include "JobSystem.h"
+#include "Primitives.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TRANSFORM_SSE2
+#endif
+
+namespace {
+
+// Up to 4 transforms, a component per array
+struct TransformBatch {
+	alignas(16) float tx[4], ty[4], tz[4];
+	alignas(16) float qx[4], qy[4], qz[4], qw[4];
+	alignas(16) float sx[4], sy[4], sz[4];
+
+	// The columns of R * S and R * S^-1
+	alignas(16) float world[9][4];
+	alignas(16) float normal[9][4];
+};
+
+// A rotation of angle radians around axis; none for a zero axis, which glm::rotate would turn into NaNs
+vec4 quaternion(vec3 axis, float angle)
+{
+	float length = glm::length(axis);
+	if (angle == 0.0f || length == 0.0f) return vec4(0, 0, 0, 1);
+
+	return vec4(axis / length * glm::sin(angle * 0.5f), glm::cos(angle * 0.5f));
+}
+
+void pack(TransformBatch& batch, int lane, const Transform2D& transform)
+{
+	vec4 q = quaternion(vec3(transform.rotation), transform.rotation.w);
+
+	batch.tx[lane] = transform.translation.x;
+	batch.ty[lane] = transform.translation.y;
+	batch.tz[lane] = transform.translation.z;
+	batch.qx[lane] = q.x;
+	batch.qy[lane] = q.y;
+	batch.qz[lane] = q.z;
+	batch.qw[lane] = q.w;
+	batch.sx[lane] = transform.scale.x;
+	batch.sy[lane] = transform.scale.y;
+	batch.sz[lane] = transform.scale.z;
+}
+
+void compute(TransformBatch& batch)
+{
+#ifdef TRANSFORM_SSE2
+	__m128 x = _mm_load_ps(batch.qx), y = _mm_load_ps(batch.qy), z = _mm_load_ps(batch.qz), w = _mm_load_ps(batch.qw);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+	__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+	__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+	// The rotation's columns
+	__m128 rotation[9] = {
+		_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))),
+		_mm_mul_ps(two, _mm_add_ps(xy, wz)),
+		_mm_mul_ps(two, _mm_sub_ps(xz, wy)),
+
+		_mm_mul_ps(two, _mm_sub_ps(xy, wz)),
+		_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))),
+		_mm_mul_ps(two, _mm_add_ps(yz, wx)),
+
+		_mm_mul_ps(two, _mm_add_ps(xz, wy)),
+		_mm_mul_ps(two, _mm_sub_ps(yz, wx)),
+		_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))),
+	};
+
+	// A zero scale flattens the object; its normals keep the other axes rather than going infinite
+	__m128 scales[3] = { _mm_load_ps(batch.sx), _mm_load_ps(batch.sy), _mm_load_ps(batch.sz) };
+	for (int column = 0; column < 3; column++) {
+		__m128 scale = scales[column];
+		__m128 inverse = _mm_andnot_ps(_mm_cmpeq_ps(scale, zero), _mm_div_ps(one, scale));
+
+		for (int row = 0; row < 3; row++) {
+			__m128 r = rotation[column * 3 + row];
+			_mm_store_ps(batch.world[column * 3 + row], _mm_mul_ps(r, scale));
+			_mm_store_ps(batch.normal[column * 3 + row], _mm_mul_ps(r, inverse));
+		}
+	}
+#else
+	for (int lane = 0; lane < 4; lane++) {
+		mat3 rotation = glm::mat3_cast(glm::quat(batch.qw[lane], batch.qx[lane], batch.qy[lane], batch.qz[lane]));
+		vec3 scale(batch.sx[lane], batch.sy[lane], batch.sz[lane]);
+
+		for (int column = 0; column < 3; column++) {
+			float inverse = scale[column] == 0.0f ? 0.0f : 1.0f / scale[column];
+
+			for (int row = 0; row < 3; row++) {
+				batch.world[column * 3 + row][lane] = rotation[column][row] * scale[column];
+				batch.normal[column * 3 + row][lane] = rotation[column][row] * inverse;
+			}
+		}
+	}
+#endif
+}
+
+}
+
+void TransformCache::update(std::vector<SceneObject>& objects)
+{
+	size_t cached = std::min(world.size(), objects.size());
+
+	dirty.clear();
+	for (size_t i = 0; i < objects.size(); i++) {
+		if (i >= cached || objects[i].transform.dirty) {
+			dirty.push_back((int)i);
+			objects[i].transform.dirty = false;
+		}
+	}
+
+	world.resize(objects.size());
+	normal.resize(objects.size());
+	updated = dirty.size();
+
+	if (dirty.empty()) return;
+
+	// Batches of 4 dirty objects; only the last can be partly empty
+	int batches = (int)(dirty.size() + 3) / 4;
+
+	JobSystem::get().parallelFor(0, batches, 256, [&](int begin, int end) {
+		TransformBatch batch = {};
+
+		for (int b = begin; b < end; b++) {
+			int lanes = (int)std::min<size_t>(4, dirty.size() - b * 4);
+
+			for (int lane = 0; lane < 4; lane++) {
+				// Unused lanes get an identity transform so they compute nothing odd
+				if (lane < lanes) {
+					pack(batch, lane, objects[dirty[b * 4 + lane]].transform);
+				}
+				else {
+					batch.qx[lane] = batch.qy[lane] = batch.qz[lane] = 0.0f;
+					batch.qw[lane] = batch.sx[lane] = batch.sy[lane] = batch.sz[lane] = 1.0f;
+				}
+			}
+
+			compute(batch);
+
+			for (int lane = 0; lane < lanes; lane++) {
+				int object = dirty[b * 4 + lane];
+				mat4& model = world[object];
+				mat3& normalMatrix = normal[object];
+
+				for (int column = 0; column < 3; column++) {
+					for (int row = 0; row < 3; row++) {
+						model[column][row] = batch.world[column * 3 + row][lane];
+						normalMatrix[column][row] = batch.normal[column * 3 + row][lane];
+					}
+					model[column][3] = 0.0f;
+				}
+
+				model[3] = vec4(batch.tx[lane], batch.ty[lane], batch.tz[lane], 1.0f);
+			}
+		}
+	});
+}
@@ -0,0 +1,259 @@
+#include "Benchmark.h"
+
+#include "globals.h"
+
+#include "ImageIO.h"
+#include "InputOutput.h"
+#include "MemoryPool.h"
+#include "SoftwareScene.h"
+#include "Texture.h"
+
+namespace Benchmark
+{
+	struct SceneResult
+	{
+		std::string name;
+		std::string scene;
+		ivec2 resolution = ivec2(0);
+		size_t triangles = 0;
+		std::array<size_t, RasterPath::_size()> pathCounts = {};
+		int frames = 0;
+
+		double p50 = 0.0, p95 = 0.0, mean = 0.0, fastest = 0.0;
+		double setupP50 = 0.0, shadowP50 = 0.0, rasterP50 = 0.0, shadeP50 = 0.0;
+		std::string shading;
+
+		double psnr = 0.0;
+		bool hasReference = false;
+		bool passed = true;
+	};
+
+	// Nearest-rank percentile of a sorted list
+	static double percentile(const std::vector<double> & sorted, double p)
+	{
+		if (sorted.empty()) return 0.0;
+
+		size_t rank = (size_t)std::ceil(p * sorted.size());
+		return sorted[glm::clamp<size_t>(rank, 1, sorted.size()) - 1];
+	}
+
+	static bool runScene(const json & entry, const std::string & suitePath, int defaultFrames, int warmup,
+		double minPSNR, const Options & options, SceneResult & result)
+	{
+		result.name = entry.at("name").get<std::string>();
+		result.scene = entry.at("scene").get<std::string>();
+
+		SoftwareScene scene;
+		if (!scene.load(IO::joinPath(suitePath, result.scene))) {
+			result.passed = false;
+			return false;
+		}
+
+		if (entry.contains("shading")) {
+			scene.shading = SoftwareShading::_from_string_nocase(entry["shading"].get<std::string>().c_str());
+		}
+
+		if (entry.contains("shadows")) {
+			scene.shadows = entry["shadows"].get<bool>();
+		}
+
+		if (entry.contains("resolution")) {
+			scene.resolution = ivec2(entry["resolution"][0].get<int>(), entry["resolution"][1].get<int>());
+		}
+
+		result.resolution = scene.resolution;
+		result.frames = glm::max(1, entry.value("frames", defaultFrames));
+
+		TextureMemory memory(GL_FLOAT, scene.resolution.x, scene.resolution.y, 4);
+
+		// Warm up caches and the allocator before timing anything
+		for (int i = 0; i < warmup; i++) {
+			scene.render(memory, options.threads);
+		}
+
+		std::vector<double> frameTimes, setupTimes, shadowTimes, rasterTimes, shadeTimes;
+
+		for (int i = 0; i < result.frames; i++) {
+			frameTimes.push_back(scene.render(memory, options.threads));
+			setupTimes.push_back(scene.setupTime);
+			shadowTimes.push_back(scene.shadowTime);
+			rasterTimes.push_back(scene.rasterTime);
+			shadeTimes.push_back(scene.shadeTime);
+		}
+
+		result.shading = scene.shading._to_string();
+		result.triangles = scene.triangleCount();
+		result.pathCounts = scene.pathCounts;
+		result.mean = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / frameTimes.size();
+
+		std::sort(frameTimes.begin(), frameTimes.end());
+		std::sort(setupTimes.begin(), setupTimes.end());
+		std::sort(shadowTimes.begin(), shadowTimes.end());
+		std::sort(rasterTimes.begin(), rasterTimes.end());
+		std::sort(shadeTimes.begin(), shadeTimes.end());
+
+		result.fastest = frameTimes.front();
+		result.p50 = percentile(frameTimes, 0.50);
+		result.p95 = percentile(frameTimes, 0.95);
+		result.setupP50 = percentile(setupTimes, 0.50);
+		result.shadowP50 = percentile(shadowTimes, 0.50);
+		result.rasterP50 = percentile(rasterTimes, 0.50);
+		result.shadeP50 = percentile(shadeTimes, 0.50);
+
+		if (!entry.contains("reference")) {
+			return true;
+		}
+
+		std::string referenceFile = IO::joinPath(suitePath, entry["reference"].get<std::string>());
+		const float * pixels = (const float*)memory.value;
+
+		if (options.updateReferences) {
+			result.passed = ImageIO::writePNG(referenceFile, pixels, memory.width, memory.height, memory.stride);
+			return result.passed;
+		}
+
+		std::vector<float> reference;
+		int width = 0, height = 0;
+
+		if (!ImageIO::readImage(referenceFile, reference, width, height)) {
+			result.passed = false;
+			return false;
+		}
+
+		result.hasReference = true;
+
+		if (width != (int)memory.width || height != (int)memory.height) {
+			log("{0}: reference is {1}x{2} but the render is {3}x{4}\n", result.name, width, height, memory.width, memory.height);
+			result.passed = false;
+			return false;
+		}
+
+		result.psnr = ImageIO::psnr(pixels, memory.stride, reference.data(), 4, width, height);
+		result.passed = result.psnr >= entry.value("minPSNR", minPSNR);
+
+		return result.passed;
+	}
+
+	static json toJson(const SceneResult & result)
+	{
+		double pixels = (double)result.resolution.x * result.resolution.y;
+
+		json j;
+		j["name"] = result.name;
+		j["scene"] = result.scene;
+		j["shading"] = result.shading;
+		j["width"] = result.resolution.x;
+		j["height"] = result.resolution.y;
+		j["triangles"] = result.triangles;
+		j["frames"] = result.frames;
+
+		for (RasterPath path : RasterPath::_values()) {
+			j["rasterPaths"][path._to_string()] = result.pathCounts[path._to_integral()];
+		}
+
+		j["p50Ms"] = result.p50 * 1000;
+		j["p95Ms"] = result.p95 * 1000;
+		j["meanMs"] = result.mean * 1000;
+		j["minMs"] = result.fastest * 1000;
+		j["setupP50Ms"] = result.setupP50 * 1000;
+		j["shadowP50Ms"] = result.shadowP50 * 1000;
+		j["rasterP50Ms"] = result.rasterP50 * 1000;
+		j["shadeP50Ms"] = result.shadeP50 * 1000;
+		j["pixelsPerSecond"] = result.p50 > 0 ? pixels / result.p50 : 0.0;
+		j["trianglesPerSecond"] = result.p50 > 0 ? result.triangles / result.p50 : 0.0;
+
+		// json has no infinity, identical images are reported as 100 dB
+		if (result.hasReference) {
+			j["psnr"] = glm::min(result.psnr, 100.0);
+		}
+		else {
+			j["psnr"] = nullptr;
+		}
+
+		j["passed"] = result.passed;
+		return j;
+	}
+
+	int run(const Options & options)
+	{
+		std::ifstream fin(options.suiteFile);
+
+		if (!fin) {
+			log("Unable to open benchmark suite {0}\n", options.suiteFile);
+			return 1;
+		}
+
+		json suite;
+		try {
+			suite = json::parse(fin);
+		}
+		catch (const std::exception & e) {
+			log("Unable to parse benchmark suite {0}: {1}\n", options.suiteFile, e.what());
+			return 1;
+		}
+
+		std::string suitePath = IO::pathOfFile(options.suiteFile);
+		int defaultFrames = suite.value("frames", 10);
+		int warmup = suite.value("warmup", 2);
+		double minPSNR = suite.value("minPSNR", 40.0);
+
+		json results = json::array();
+		bool allPassed = true;
+
+		fmt::print("{0:<24} {1:>9} {2:>9} {3:>10} {4:>10} {5:>10} {6:>8}\n",
+			"scene", "triangles", "p50 ms", "p95 ms", "Mpixels/s", "Mtris/s", "PSNR");
+
+		for (auto & entry : suite.at("scenes")) {
+			SceneResult result;
+
+			try {
+				runScene(entry, suitePath, defaultFrames, warmup, minPSNR, options, result);
+			}
+			catch (const std::exception & e) {
+				log("Benchmark scene failed: {0}\n", e.what());
+				result.passed = false;
+			}
+
+			allPassed = allPassed && result.passed;
+
+			std::string psnr = !result.hasReference ? "-" :
+				(std::isinf(result.psnr) ? "exact" : fmt::format("{0:.2f}", result.psnr));
+
+			fmt::print("{0:<24} {1:>9} {2:>9.3f} {3:>10.3f} {4:>10.2f} {5:>10.2f} {6:>8}{7}\n",
+				result.name, result.triangles, result.p50 * 1000, result.p95 * 1000,
+				result.p50 > 0 ? result.resolution.x * result.resolution.y / result.p50 / 1e6 : 0.0,
+				result.p50 > 0 ? result.triangles / result.p50 / 1e6 : 0.0,
+				psnr, result.passed ? "" : "  FAILED");
+
+			results.push_back(toJson(result));
+		}
+
+		if (options.updateReferences) {
+			fmt::print("Updated reference images\n");
+		}
+
+		// Scenes of the same resolution reuse the last one's render target
+		MemoryPool::Stats pool = MemoryPool::get().getStats();
+		fmt::print("Memory pool: {0} hits, {1} misses, {2:.2f} MB pooled\n", pool.hits, pool.misses,
+			pool.pooledBytes / (1024.0 * 1024.0));
+
+		if (!options.jsonFile.empty()) {
+			json output;
+			output["suite"] = options.suiteFile;
+			output["label"] = options.label;
+			output["threads"] = options.threads;
+			output["time"] = (int64_t)current_time_t();
+			output["passed"] = allPassed;
+			output["results"] = results;
+
+			std::ofstream fout(options.jsonFile);
+			if (!fout) {
+				log("Unable to write {0}\n", options.jsonFile);
+				return 1;
+			}
+			fout << output.dump(2) << std::endl;
+		}
+
+		return allPassed ? 0 : 1;
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+// Performance and correctness regression suite for the software rasterizer. A suite file lists
+// scenes (see scenes/bench/suite.json); each one is rendered a number of times and compared
+// against a reference image, and the results can be saved as json to track them per commit.
+namespace Benchmark
+{
+	struct Options
+	{
+		std::string suiteFile;
+		// Where to write the json results, nothing is written when empty
+		std::string jsonFile;
+		// Stored in the json results so runs can be told apart, e.g. a commit hash
+		std::string label;
+		int threads = 1;
+		// Overwrite the reference images with this run's output instead of comparing
+		bool updateReferences = false;
+	};
+
+	// Returns the process exit code: 0 when every scene matched its reference
+	int run(const Options & options);
+}
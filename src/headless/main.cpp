@@ -0,0 +1,308 @@
+// Headless software renderer: draws a SoftwareScene with the CPU rasterization path and writes the
+// result to an image, without GLFW, a window or an OpenGL context. Built with "make headless".
+
+#include "globals.h"
+
+#include "Benchmark.h"
+#include "BlockCompression.h"
+#include "ImageIO.h"
+#include "JobSystem.h"
+#include "MipChain.h"
+#include "SoftwareScene.h"
+#include "Texture.h"
+#include "TextureFile.h"
+
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+static _time programStart = _clock::now();
+
+double getTime()
+{
+	return _elapsed(_clock::now() - programStart).count();
+}
+
+// log() already prints to stdout, and there's no console window to forward to
+void logString(const std::string&)
+{
+}
+
+static void printUsage(const char* exe)
+{
+	fmt::print(
+		"Usage: {0} --scene <scene.json> [options]\n"
+		"       {0} --bench <suite.json> [--json <results.json>] [--label <text>] [--update-references]\n"
+		"       {0} --compress <image>\n"
+		"       {0} --pack <image> [--out <file.tex>] [--no-compression]\n"
+		"  --scene <file>     Scene description to render (see scenes/)\n"
+		"  --out <file>       Write the last frame to a .png or .pfm file\n"
+		"  --width <n>        Override the scene's width in pixels\n"
+		"  --height <n>       Override the scene's height in pixels\n"
+		"  --frames <n>       Number of frames to render (default 1)\n"
+		"  --threads <n>      Number of worker threads (default: hardware concurrency)\n"
+		"  --pin-threads      Keep each worker thread on its own core\n"
+		"  --shading <mode>   Override the scene's shading: vertex, deferred or forward\n"
+		"  --shadows          Turn on shadow mapping (deferred and forward shading only)\n"
+		"  --timing           Print the time of every frame\n"
+		"  --bench <file>     Run a benchmark suite (see scenes/bench/suite.json)\n"
+		"  --json <file>      Write the benchmark results as json\n"
+		"  --label <text>     Label stored with the json results, e.g. a commit hash\n"
+		"  --update-references  Replace the suite's reference images with this run's output\n"
+		"  --compress <file>  Encode an image in every block format and print quality and speed\n"
+		"  --pack <file>      Write an image and its mip chain as a texture file (.tex) that loads\n"
+		"                     without decoding (--out defaults to the image's name with .tex)\n"
+		"  --no-compression   Keep the packed levels uncompressed\n",
+		exe);
+}
+
+// Encodes the image in each block format, decodes it again and compares the result with the
+// channels the format keeps
+static int runCompressionTest(const std::string& filename)
+{
+	ImageIO::DecodedImage image;
+	if (!ImageIO::decodeImage(filename, image)) {
+		log("Unable to read {0}\n", filename);
+		return 1;
+	}
+
+	fmt::print("{0}: {1}x{2}, {3} channel(s)\n", filename, image.width, image.height, image.channels);
+
+	double megapixels = (double)image.width * image.height / 1e6;
+
+	for (BlockFormat format : BlockFormat::_values()) {
+		if (format == +BlockFormat::None) continue;
+
+		_time start = _clock::now();
+		auto blocks = BlockCompression::encode(image, format);
+		_elapsed encodeTime = _clock::now() - start;
+
+		start = _clock::now();
+		auto decoded = BlockCompression::decode(blocks.data(), image.width, image.height, format);
+		_elapsed decodeTime = _clock::now() - start;
+
+		// Same expansion of gray and missing alpha as the encoder
+		double sumSquared = 0.0;
+		for (size_t i = 0; i < (size_t)image.width * image.height; i++) {
+			const unsigned char* pixel = image.pixels.data() + i * image.channels;
+			for (int c = 0; c < decoded.channels; c++) {
+				int original = 255;
+				if (c < 3) original = pixel[image.channels < 3 ? 0 : c];
+				else if (image.channels == 2 || image.channels == 4) original = pixel[image.channels - 1];
+
+				int diff = original - decoded.pixels[i * decoded.channels + c];
+				sumSquared += diff * diff;
+			}
+		}
+
+		double mse = sumSquared / ((double)image.width * image.height * decoded.channels);
+		double psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY;
+
+		fmt::print("{0}: {1:.1f} bits/texel, PSNR {2:.2f} dB over {3} channel(s), encode {4:.1f} ms ({5:.1f} MPix/s), decode {6:.1f} ms ({7:.1f} MPix/s)\n",
+			format._to_string(), 8.0 * blocks.size() / ((double)image.width * image.height), psnr, decoded.channels,
+			encodeTime.count() * 1000, megapixels / encodeTime.count(), decodeTime.count() * 1000, megapixels / decodeTime.count());
+	}
+
+	return 0;
+}
+
+// Builds an image's mip chain into a texture file, then times loading it both ways
+static int packTexture(const std::string& filename, std::string outFile, bool compress)
+{
+	if (outFile.empty()) {
+		outFile = std::filesystem::path(filename).replace_extension(TextureFile::extension).string();
+	}
+
+	MipSettings settings = MipSettings::forFile(filename);
+	settings.compress = compress;
+
+	_time start = _clock::now();
+
+	ImageIO::DecodedImage image;
+	// Height maps keep one channel, at 16 bits where the file has them, as MipChain::load reads them
+	if (!ImageIO::decodeImage(filename, image, settings.heightMap ? 1 : 0, true, settings.heightMap)) {
+		log("Unable to read {0}\n", filename);
+		return 1;
+	}
+
+	MipChain chain;
+	chain.build(std::move(image), settings);
+	_elapsed buildTime = _clock::now() - start;
+
+	if (!TextureFile::write(outFile, chain, std::filesystem::absolute(filename).string())) {
+		return 1;
+	}
+
+	// Opening maps the file; summing the levels makes every page of them come in from disk
+	start = _clock::now();
+	TextureFile file;
+	if (!file.open(outFile)) {
+		return 1;
+	}
+
+	size_t totalSize = 0, checksum = 0;
+	for (auto& level : file.levels) {
+		for (size_t i = 0; i < level.size; i += 64) {
+			checksum += level.data[i];
+		}
+		totalSize += level.size;
+	}
+	_elapsed mapTime = _clock::now() - start;
+
+	fmt::print("Wrote {0}: {1}x{2}, {3} levels, {4}, {5:.2f} MB\n", outFile, file.width, file.height, file.levels.size(),
+		file.format._to_string(), totalSize / (1024.0 * 1024.0));
+	fmt::print("Decoding and building the chain: {0:.1f} ms, mapping the texture file: {1:.1f} ms (checksum {2})\n",
+		buildTime.count() * 1000, mapTime.count() * 1000, checksum);
+
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	std::string sceneFile;
+	std::string outFile;
+	ivec2 resolution = ivec2(0);
+	int frames = 1;
+	int threads = glm::max(1, (int)std::thread::hardware_concurrency());
+	bool printFrames = false;
+	bool shadows = false;
+	bool pinThreads = false;
+	std::string shading;
+	std::string compressFile;
+	std::string packFile;
+	bool packCompressed = true;
+	Benchmark::Options bench;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--scene" && hasValue) sceneFile = argv[++i];
+		else if (arg == "--out" && hasValue) outFile = argv[++i];
+		else if (arg == "--width" && hasValue) resolution.x = std::atoi(argv[++i]);
+		else if (arg == "--height" && hasValue) resolution.y = std::atoi(argv[++i]);
+		else if (arg == "--frames" && hasValue) frames = glm::max(1, std::atoi(argv[++i]));
+		else if (arg == "--threads" && hasValue) threads = glm::max(1, std::atoi(argv[++i]));
+		else if (arg == "--pin-threads") pinThreads = true;
+		else if (arg == "--shading" && hasValue) shading = argv[++i];
+		else if (arg == "--shadows") shadows = true;
+		else if (arg == "--timing") printFrames = true;
+		else if (arg == "--bench" && hasValue) bench.suiteFile = argv[++i];
+		else if (arg == "--json" && hasValue) bench.jsonFile = argv[++i];
+		else if (arg == "--label" && hasValue) bench.label = argv[++i];
+		else if (arg == "--update-references") bench.updateReferences = true;
+		else if (arg == "--compress" && hasValue) compressFile = argv[++i];
+		else if (arg == "--pack" && hasValue) packFile = argv[++i];
+		else if (arg == "--no-compression") packCompressed = false;
+		else if (arg == "--help" || arg == "-h") {
+			printUsage(argv[0]);
+			return 0;
+		}
+		else {
+			log("Unknown argument {0}\n", arg);
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	JobSystem::get().start(threads, pinThreads);
+
+	if (!bench.suiteFile.empty()) {
+		bench.threads = threads;
+		return Benchmark::run(bench);
+	}
+
+	if (!compressFile.empty()) {
+		return runCompressionTest(compressFile);
+	}
+
+	if (!packFile.empty()) {
+		return packTexture(packFile, outFile, packCompressed);
+	}
+
+	if (sceneFile.empty()) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	SoftwareScene scene;
+	if (!scene.load(sceneFile)) {
+		return 1;
+	}
+
+	if (!shading.empty()) {
+		auto mode = SoftwareShading::_from_string_nocase_nothrow(shading.c_str());
+		if (!mode) {
+			log("Unknown shading mode {0}\n", shading);
+			return 1;
+		}
+		scene.shading = *mode;
+	}
+
+	if (shadows) scene.shadows = true;
+
+	if (resolution.x > 0) scene.resolution.x = resolution.x;
+	if (resolution.y > 0) scene.resolution.y = resolution.y;
+
+	TextureMemory memory(GL_FLOAT, scene.resolution.x, scene.resolution.y, 4);
+
+	double total = 0.0, fastest = DBL_MAX, slowest = 0.0;
+	double totalSetup = 0.0, totalShadow = 0.0, totalRaster = 0.0, totalShade = 0.0;
+
+	JobSystem::get().resetStats();
+
+	for (int frame = 0; frame < frames; frame++) {
+		double frameTime = scene.render(memory, threads);
+
+		total += frameTime;
+		totalSetup += scene.setupTime;
+		totalShadow += scene.shadowTime;
+		totalRaster += scene.rasterTime;
+		totalShade += scene.shadeTime;
+		fastest = glm::min(fastest, frameTime);
+		slowest = glm::max(slowest, frameTime);
+
+		if (printFrames) {
+			fmt::print("Frame {0}: {1:.3f} ms (setup {2:.3f} ms, shadows {3:.3f} ms, raster {4:.3f} ms, lighting {5:.3f} ms)\n",
+				frame, frameTime * 1000, scene.setupTime * 1000, scene.shadowTime * 1000, scene.rasterTime * 1000,
+				scene.shadeTime * 1000);
+		}
+	}
+
+	fmt::print("Rendered {0} at {1}x{2} with {3} shading: {4} triangles, {5} frame(s) on {6} thread(s)\n",
+		scene.name, scene.resolution.x, scene.resolution.y, scene.shading._to_string(), scene.triangleCount(), frames, threads);
+
+	if (scene.shading == +SoftwareShading::Vertex) {
+		size_t numTriangles = glm::max<size_t>(1, scene.screenTriangles.size());
+		fmt::print("Raster paths: {0} culled ({1:.1f}%), {2} micro ({3:.1f}%), {4} bounding box ({5:.1f}%)\n",
+			scene.pathCounts[RasterPath::Culled], 100.0 * scene.pathCounts[RasterPath::Culled] / numTriangles,
+			scene.pathCounts[RasterPath::Micro], 100.0 * scene.pathCounts[RasterPath::Micro] / numTriangles,
+			scene.pathCounts[RasterPath::BoundingBox], 100.0 * scene.pathCounts[RasterPath::BoundingBox] / numTriangles);
+	}
+
+	if (scene.shading != +SoftwareShading::Vertex && scene.shadows) {
+		fmt::print("Shadow map: {0}x{0}, {1} casters\n", scene.shadowMap.resolution, scene.shadowTriangles.size());
+	}
+
+	fmt::print("Frame time: avg {0:.3f} ms, min {1:.3f} ms, max {2:.3f} ms (setup {3:.3f} ms, shadows {4:.3f} ms, raster {5:.3f} ms, lighting {6:.3f} ms avg)\n",
+		total * 1000 / frames, fastest * 1000, slowest * 1000, totalSetup * 1000 / frames, totalShadow * 1000 / frames,
+		totalRaster * 1000 / frames, totalShade * 1000 / frames);
+
+	// How evenly the frames' work spread over the threads. Worker 0 is the main thread, which also
+	// does the serial parts of the frame outside of the jobs.
+	auto workerStats = JobSystem::get().getStats();
+	for (size_t i = 0; i < workerStats.size(); i++) {
+		fmt::print("Worker {0}: busy {1:.3f} ms/frame ({2:.1f}%), {3} jobs, {4} stolen\n", i,
+			workerStats[i].busySeconds * 1000 / frames, 100.0 * workerStats[i].busySeconds / glm::max(total, 1e-9),
+			workerStats[i].jobs, workerStats[i].steals);
+	}
+
+	if (!outFile.empty()) {
+		if (!ImageIO::writeImage(outFile, (const float*)memory.value, memory.width, memory.height, memory.stride)) {
+			return 1;
+		}
+		fmt::print("Wrote {0}\n", outFile);
+	}
+
+	return 0;
+}
@@ -16,6 +16,7 @@
 //#include <GL/gl.h>
 
 #include "Application.h"
+#include "JobSystem.h"
 //#include "Shader.h"
 #include "UIHelpers.h"
 #include "Renderer.h"
@@ -193,6 +194,10 @@ int main(int argc, char** argv)
 	Application& application = Application::get();
 	application.init(window);
 
+	// Worker threads for OBJ parsing, texture decoding and the CPU renderers, one per core. Started
+	// once, here: restarting joins the workers and replaces their deques.
+	JobSystem::get().start();
+
 
 	while (!application.quit && !glfwWindowShouldClose(window))
 	{
@@ -1,15 +1,26 @@
 __VERSION__
 
-uniform vec4 color;
-
-uniform vec3 lightDirection;
-uniform vec3 cameraPosition;
-
-uniform float Ia;
-uniform vec3 Ka;
+// Set once a frame (Project::FrameConstants)
+layout(std140) uniform FrameConstants {
+  mat4 viewProjection;
+  vec3 cameraPosition;
+  float Ia;
+  vec3 Ka;
+  float Id;
+  vec3 Kd;
+  float shininess;
+  vec3 Ks;
+  vec3 lightDirection;
+  vec3 outerTesselation;
+  vec3 innerTesselation;
+};
 
 uniform sampler2D inputTexture;
 uniform bool useTexture;
+uniform bool srgbTexture; // inputTexture has an sRGB format and samples as linear colors
+
+// The object's own texture, one image of an sRGB atlas (TextureAtlas)
+uniform sampler2DArray atlasTexture;
 
 uniform sampler2D normalTexture;
 uniform bool useNormalTexture;
@@ -23,21 +34,22 @@ uniform bool useDisplacementMap;
 uniform sampler2D displacementMap;
 uniform float displacementScale;
 
-// Diffuse
-uniform float Id;
-uniform vec3 Kd;
-
-// Specular
-uniform float shininess;
-uniform vec3 Ks;
-
 in vec3 fPos;
 in vec3 fNormal;
 in vec2 uv; // texture coordinates that is set in the vertex shader.
 in mat3 TBN;
+flat in vec4 fAtlasRect;  // origin and size of the image in the layer
+flat in float fAtlasLayer; // negative for objects without an image
 
 out vec4 FragColor;
 
+// The inverse of the sRGB decode the GPU does when sampling
+vec3 linearToSRGB(vec3 linear) {
+  vec3 low = linear * 12.92;
+  vec3 high = 1.055 * pow(linear, vec3(1.0 / 2.4)) - 0.055;
+  return mix(high, low, vec3(lessThanEqual(linear, vec3(0.0031308))));
+}
+
 vec2 uvCoord = uv;
 
 float heightScale = 0.1f; // Adjust value to control the intesity.
@@ -72,8 +84,10 @@ void main() {
   }
 
   if (useNormalTexture && validNormalTexture) {
-    normal = texture(normalTexture, uvCoord).rgb;
-    normal = normal * 2.0 - 1.0;
+    // Only x and y are read: z follows from the normal being unit length, so the same code
+    // works for RGB normal maps and two-channel (BC5) ones
+    normal.xy = texture(normalTexture, uvCoord).rg * 2.0 - 1.0;
+    normal.z = sqrt(max(0.0, 1.0 - dot(normal.xy, normal.xy)));
     normal = normalize(TBN * normal);
   } else {
     normal = normalize(fNormal);
@@ -98,8 +112,22 @@ void main() {
 
   vec4 texColor = vec4(1.0);
 
-  if (useTexture) {
+  if (fAtlasLayer >= 0.0) {
+    // Repeats within the image's rect. The derivatives are the unwrapped UVs',
+    // so the jump at the wrap doesn't select the smallest mip level.
+    vec2 atlasUV = fAtlasRect.xy + fract(uvCoord) * fAtlasRect.zw;
+    texColor = textureGrad(atlasTexture, vec3(atlasUV, fAtlasLayer),
+                           dFdx(uvCoord) * fAtlasRect.zw,
+                           dFdy(uvCoord) * fAtlasRect.zw);
+    texColor.rgb = linearToSRGB(texColor.rgb);
+  } else if (useTexture) {
     texColor = texture(inputTexture, uvCoord);
+
+    // Filtering happened in linear space; the lighting below still works on
+    // the colors as they are in the file
+    if (srgbTexture) {
+      texColor.rgb = linearToSRGB(texColor.rgb);
+    }
   }
 
   FragColor = vec4(finalColor * texColor.rgb, 1.0);
@@ -1,8 +1,38 @@
 __VERSION__
 
-uniform mat4 mvp;
-uniform mat4 model;
-uniform mat4 normalMatrix;
+// Set once a frame (Project::FrameConstants)
+layout(std140) uniform FrameConstants {
+  mat4 viewProjection;
+  vec3 cameraPosition;
+  float Ia;
+  vec3 Ka;
+  float Id;
+  vec3 Kd;
+  float shininess;
+  vec3 Ks;
+  vec3 lightDirection;
+  vec3 outerTesselation;
+  vec3 innerTesselation;
+};
+
+// Set once an object, each object's a range of the same buffer
+// (Project::ObjectConstants)
+layout(std140) uniform ObjectConstants {
+  mat4 mvp;
+  mat4 model;
+  mat4 normalMatrix;
+  vec4 atlasRect; // origin and size of the image in the layer
+  float atlasLayer;
+  bool useAtlas;
+};
+
+// Instanced draws (Project::InstanceData) take the object's constants from
+// per-instance attributes instead of ObjectConstants
+uniform bool useInstancing;
+in mat4 instanceModel;
+in mat3 instanceNormalMatrix;
+in vec4 instanceAtlasRect;
+in float instanceAtlasLayer; // negative without an atlas image
 
 uniform sampler2D displacementMap;
 uniform bool useDisplacementMap;
@@ -22,14 +52,31 @@ out vec3 fNormal;
 out vec2 uv;
 
 out mat3 TBN;
+flat out vec4 fAtlasRect;
+flat out float fAtlasLayer;
 
 void main() {
-  vec3 T = normalize(vec3(model * vec4(vTangent, 0.0)));
-  vec3 B = normalize(vec3(model * vec4(vBitangent, 0.0)));
-  vec3 N = (normalMatrix * vec4(vNormal, 0.0)).xyz;
+  mat4 objectModel = model;
+  mat3 objectNormalMatrix = mat3(normalMatrix);
+  mat4 objectMVP = mvp;
+
+  if (useInstancing) {
+    objectModel = instanceModel;
+    objectNormalMatrix = instanceNormalMatrix;
+    objectMVP = viewProjection * instanceModel;
+    fAtlasRect = instanceAtlasRect;
+    fAtlasLayer = instanceAtlasLayer;
+  } else {
+    fAtlasRect = atlasRect;
+    fAtlasLayer = useAtlas ? atlasLayer : -1.0;
+  }
+
+  vec3 T = normalize(vec3(objectModel * vec4(vTangent, 0.0)));
+  vec3 B = normalize(vec3(objectModel * vec4(vBitangent, 0.0)));
+  vec3 N = objectNormalMatrix * vNormal;
   TBN = mat3(T, B, N);
 
-  fPos = (model * vec4(vPosition, 1.0)).xyz;
+  fPos = (objectModel * vec4(vPosition, 1.0)).xyz;
   fNormal = N;
   uv = texCoord;
 
@@ -42,5 +89,5 @@ void main() {
     temp = newPosition;
   }
 
-  gl_Position = mvp * vec4(temp, 1.0);
+  gl_Position = objectMVP * vec4(temp, 1.0);
 }